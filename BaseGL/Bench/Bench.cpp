@@ -0,0 +1,297 @@
+// Timings of the mesh generators, and the cost of the icosphere against the UV sphere, printed as
+// tables. Not part of the application: built with -DBASEGL_BUILD_BENCH=ON, and run from the build
+// directory. The rasterization timings need an OpenGL 4.5 context, and are skipped without one.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "Mesh.hpp"
+
+/*
+ * The sphere and torus generators as they were before the ring kernel: cosf and sinf for every
+ * vertex, every float appended with push_back
+ */
+
+static void referenceSphere (size_t resolution, Geometry & sphere) {
+    int N = resolution;
+    float R = 1.0;
+    float theta, fi;
+    float x, y, z;
+    const float pi = 3.14159;
+
+    for (int j = 0; j < N+1; j++) {
+        for (int i = 0; i < N+1; i++) {
+            theta = i*2*pi/N;
+            fi = j*pi/N-pi/2;
+
+            x = R*cosf(theta)*cosf(fi);
+            y = R*sinf(theta)*cosf(fi);
+            z = R*cosf(fi);
+
+            sphere.vertexPositions.push_back(x);
+            sphere.vertexPositions.push_back(y);
+            sphere.vertexPositions.push_back(z);
+            sphere.vertexColors.push_back(1.f);
+            sphere.vertexColors.push_back(0.f);
+            sphere.vertexColors.push_back((j%3 == 1) ? 1.f : 0.f);
+        }
+    }
+
+    for (int t = 0; t < (N*N-1); t++) {
+        sphere.triangleIndices.push_back(t);
+        sphere.triangleIndices.push_back(t+1);
+        sphere.triangleIndices.push_back(t+N);
+        sphere.triangleIndices.push_back(t+1);
+        sphere.triangleIndices.push_back(t+1+N);
+        sphere.triangleIndices.push_back(t+N);
+    }
+}
+
+static void referenceTorus (size_t resolution, Geometry & torus) {
+    int N = resolution;
+    float a = 0.2;
+    float b = 1.0 - a;
+    float theta, fi;
+    float x, y, z;
+    const float pi = 3.14159;
+
+    for (int j = 0; j < N; j++) {
+        for (int i = 0; i < N; i++) {
+            theta = i*2*pi/N;
+            fi = j*2*pi/N;
+
+            x = (b + a*cos(fi))*cos(theta);
+            y = (b + a*cos(fi))*sin(theta);
+            z = a*sin(fi);
+
+            torus.vertexPositions.push_back(x);
+            torus.vertexPositions.push_back(y);
+            torus.vertexPositions.push_back(z);
+            torus.vertexColors.push_back(0.f);
+            torus.vertexColors.push_back(1.f);
+            torus.vertexColors.push_back(0.f);
+        }
+    }
+
+    for (int t = 0; t < (N-1)*(N-1); t++) {
+        torus.triangleIndices.push_back(t);
+        torus.triangleIndices.push_back(t+1);
+        torus.triangleIndices.push_back(t+N);
+        torus.triangleIndices.push_back(t+1);
+        torus.triangleIndices.push_back(t+1+N);
+        torus.triangleIndices.push_back(t+N);
+    }
+}
+
+// Best time in milliseconds over enough runs to fill about a quarter of a second, each on a fresh
+// geometry, so that allocation is part of the measure
+static double bestTime (const std::function<void (Geometry &)> & generate) {
+    double best = std::numeric_limits<double>::max (), total = 0.0;
+    for (int run = 0; run < 3 || (total < 250.0 && run < 1000); run++) {
+        Geometry geometry;
+        auto start = std::chrono::steady_clock::now ();
+        generate (geometry);
+        double time = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - start).count ();
+        best = std::min (best, time);
+        total += time;
+    }
+    return best;
+}
+
+static void benchGenerators () {
+    std::printf ("Generation, best of several runs (ms), per-vertex reference vs ring kernel\n");
+    std::printf ("%10s %12s %12s %8s %12s %12s %8s\n", "resolution", "sphere ref", "sphere", "speedup", "torus ref", "torus", "speedup");
+    for (size_t resolution = 16; resolution <= 4096; resolution *= 2) {
+        double sphereReference = bestTime ([=] (Geometry & g) { referenceSphere (resolution, g); });
+        double sphere = bestTime ([=] (Geometry & g) { g.allocate (Mesh::sphereSize (resolution)); Mesh::fillSphere (resolution, 1.f, g.view ()); });
+        double torusReference = bestTime ([=] (Geometry & g) { referenceTorus (resolution, g); });
+        double torus = bestTime ([=] (Geometry & g) { g.allocate (Mesh::torusSize (resolution)); Mesh::fillTorus (resolution, 0.2f, g.view ()); });
+        std::printf ("%10zu %12.3f %12.3f %7.2fx %12.3f %12.3f %7.2fx\n", resolution,
+                     sphereReference, sphere, sphereReference / sphere, torusReference, torus, torusReference / torus);
+    }
+}
+
+/*
+ * Icosphere against UV sphere
+ */
+
+// Distance from the center of the sphere to the closest point of a triangle
+static float distanceToTriangle (const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c) {
+    glm::vec3 n = glm::cross (b - a, c - a);
+    float area2 = glm::dot (n, n);
+    if (area2 > 0.f) {
+        glm::vec3 foot = glm::dot (a, n) / area2 * n; // Of the center, on the plane of the triangle
+        if (glm::dot (glm::cross (b - a, foot - a), n) >= 0.f && glm::dot (glm::cross (c - b, foot - b), n) >= 0.f
+            && glm::dot (glm::cross (a - c, foot - c), n) >= 0.f)
+            return glm::length (foot);
+    }
+    float distance = std::numeric_limits<float>::max ();
+    const glm::vec3 corners[3] = { a, b, c };
+    for (int e = 0; e < 3; e++) {
+        glm::vec3 p = corners[e], d = corners[(e + 1) % 3] - p;
+        float t = glm::dot (d, d) > 0.f ? glm::clamp (-glm::dot (p, d) / glm::dot (d, d), 0.f, 1.f) : 0.f;
+        distance = std::min (distance, glm::length (p + t * d));
+    }
+    return distance;
+}
+
+// Largest gap between the unit sphere and its tessellation, the error seen on the silhouette
+static float silhouetteError (const Geometry & geometry) {
+    const std::vector<float> & p = geometry.vertexPositions;
+    float error = 0.f;
+    for (size_t t = 0; t < geometry.triangleIndices.size (); t += 3) {
+        const unsigned int * index = &geometry.triangleIndices[t];
+        glm::vec3 a = glm::make_vec3 (&p[3 * index[0]]), b = glm::make_vec3 (&p[3 * index[1]]), c = glm::make_vec3 (&p[3 * index[2]]);
+        error = std::max (error, 1.f - distanceToTriangle (a, b, c));
+    }
+    return error;
+}
+
+static std::shared_ptr<Geometry> uvSphere (size_t resolution) {
+    std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> ();
+    geometry->allocate (Mesh::sphereSize (resolution));
+    Mesh::fillSphere (resolution, 1.f, geometry->view ());
+    return geometry;
+}
+
+static std::shared_ptr<Geometry> icosphere (size_t subdivisions) {
+    std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> ();
+    geometry->allocate (Mesh::icosphereSize (subdivisions));
+    Mesh::fillIcosphere (subdivisions, 1.f, geometry->view ());
+    return geometry;
+}
+
+// Lowest UV sphere resolution whose error is at most error
+static size_t matchingResolution (float error) {
+    size_t low = 3, high = 4;
+    while (silhouetteError (*uvSphere (high)) > error) {
+        low = high;
+        high *= 2;
+    }
+    while (high - low > 1) {
+        size_t middle = (low + high) / 2;
+        if (silhouetteError (*uvSphere (middle)) > error)
+            low = middle;
+        else
+            high = middle;
+    }
+    return high;
+}
+
+static const char * rasterVertexShader =
+    "#version 450 core\n"
+    "layout(location=0) in vec3 vPosition;\n"
+    "layout(location=0) uniform vec3 positionScale;\n" // Set by Geometry::render, as for VertexShader.glsl
+    "layout(location=1) uniform vec3 positionOffset;\n"
+    "layout(location=2) uniform int normalEncoding;\n"
+    "uniform mat4 mvp;\n"
+    "void main () { gl_Position = mvp * vec4 (vPosition * positionScale + positionOffset, 1.0); }\n";
+
+static const char * rasterFragmentShader =
+    "#version 450 core\n"
+    "out vec4 color;\n"
+    "void main () { color = vec4 (1.0); }\n";
+
+// Hidden window with a context and a program drawing flat white triangles, false if there is no OpenGL 4.5
+static bool initRaster (GLFWwindow * & window) {
+    if (!glfwInit ())
+        return false;
+    glfwWindowHint (GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint (GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint (GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint (GLFW_VISIBLE, GLFW_FALSE);
+    window = glfwCreateWindow (1024, 1024, "BaseGLBench", nullptr, nullptr);
+    if (!window) {
+        glfwTerminate ();
+        return false;
+    }
+    glfwMakeContextCurrent (window);
+    if (!gladLoadGLLoader ((GLADloadproc)glfwGetProcAddress)) {
+        glfwDestroyWindow (window);
+        glfwTerminate ();
+        return false;
+    }
+
+    GLuint program = glCreateProgram ();
+    const char * sources[2] = { rasterVertexShader, rasterFragmentShader };
+    const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    for (int s = 0; s < 2; s++) {
+        GLuint shader = glCreateShader (types[s]);
+        glShaderSource (shader, 1, &sources[s], nullptr);
+        glCompileShader (shader);
+        glAttachShader (program, shader);
+        glDeleteShader (shader);
+    }
+    glLinkProgram (program);
+    glUseProgram (program);
+    glm::mat4 mvp = glm::perspective (glm::radians (45.f), 1.f, 0.1f, 10.f) * glm::lookAt (glm::vec3 (0.f, 0.f, 3.f), glm::vec3 (0.f), glm::vec3 (0.f, 1.f, 0.f));
+    glUniformMatrix4fv (glGetUniformLocation (program, "mvp"), 1, GL_FALSE, glm::value_ptr (mvp));
+    glEnable (GL_DEPTH_TEST);
+    glEnable (GL_CULL_FACE);
+    return true;
+}
+
+// GPU time of one draw of the geometry filling about half the viewport, in milliseconds, best of several batches
+static double rasterTime (Geometry & geometry) {
+    const int drawsPerBatch = 50;
+    geometry.initGPUGeometry ();
+    GLuint query;
+    glCreateQueries (GL_TIME_ELAPSED, 1, &query);
+    double best = std::numeric_limits<double>::max ();
+    for (int batch = 0; batch < 5; batch++) {
+        glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glBeginQuery (GL_TIME_ELAPSED, query);
+        for (int draw = 0; draw < drawsPerBatch; draw++)
+            geometry.render ();
+        glEndQuery (GL_TIME_ELAPSED);
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v (query, GL_QUERY_RESULT, &nanoseconds);
+        best = std::min (best, nanoseconds * 1e-6 / drawsPerBatch);
+    }
+    glDeleteQueries (1, &query);
+    geometry.clear ();
+    return best;
+}
+
+static void benchIcosphere () {
+    GLFWwindow * window = nullptr;
+    bool raster = initRaster (window);
+    std::printf ("\nIcosphere against the UV sphere of the same silhouette error%s\n", raster ? ", GPU time per draw (ms)" : " (no OpenGL 4.5 context: rasterization skipped)");
+    std::printf ("%12s %10s %10s %10s %10s %8s", "subdivisions", "error", "ico tris", "uv res", "uv tris", "saving");
+    if (raster)
+        std::printf (" %10s %10s %8s", "ico draw", "uv draw", "speedup");
+    std::printf ("\n");
+    for (size_t subdivisions = 1; subdivisions <= 7; subdivisions++) {
+        std::shared_ptr<Geometry> ico = icosphere (subdivisions);
+        float error = silhouetteError (*ico);
+        size_t resolution = matchingResolution (error);
+        std::shared_ptr<Geometry> uv = uvSphere (resolution);
+        size_t icoTriangles = ico->triangleIndices.size () / 3, uvTriangles = uv->triangleIndices.size () / 3;
+        std::printf ("%12zu %10.2e %10zu %10zu %10zu %7.0f%%", subdivisions, error, icoTriangles, resolution, uvTriangles,
+                     100.0 * (1.0 - double (icoTriangles) / uvTriangles));
+        if (raster) {
+            double icoTime = rasterTime (*ico), uvTime = rasterTime (*uv);
+            std::printf (" %10.4f %10.4f %7.2fx", icoTime, uvTime, uvTime / icoTime);
+        }
+        std::printf ("\n");
+    }
+    if (raster) {
+        glfwDestroyWindow (window);
+        glfwTerminate ();
+    }
+}
+
+int main () {
+    benchGenerators ();
+    benchIcosphere ();
+    return 0;
+}
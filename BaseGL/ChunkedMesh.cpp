@@ -0,0 +1,614 @@
+#include <glm/ext.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <numeric>
+
+#include "ChunkedMesh.hpp"
+#include "MappedFile.hpp"
+#include "Meshlet.hpp"
+#include "MeshOptimizer.hpp"
+#include "ThreadPool.hpp"
+
+static const char magic[8] = { 'B', 'a', 's', 'e', 'G', 'L', 'C', 'h' };
+static const uint32_t version = 2;
+static const uint64_t chunkAlignment = 4096; // Page size: a chunk is prefetched and read alone
+static const size_t uploadBytesPerFrame = size_t (32) << 20; // Upload budget, so that paging never stalls a frame for long
+
+struct ChunkFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint8_t position; // VertexLayout
+    uint8_t color;
+    uint8_t normal;
+    uint8_t interleaved;
+    uint64_t chunkCount;
+    uint64_t recordOffset; // Of the chunk records, after the chunks: their count is known last
+    uint64_t maxVertexCount;
+    uint64_t maxIndexCount;
+};
+
+struct ChunkRecord {
+    float center[3];
+    float radius;
+    float positionScale[3];
+    float positionOffset[3];
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint64_t offset; // Of the packed vertices, from the start of the file, a multiple of chunkAlignment; the indices follow
+};
+
+static uint64_t alignChunk (uint64_t offset) {
+    return (offset + chunkAlignment - 1) / chunkAlignment * chunkAlignment;
+}
+
+/* Offline split */
+
+// Splits the triangles at the median of their centroids along the longest axis, until every part
+// has at most maxTriangles of them. Returns the parts as ranges of order, in depth-first order, so
+// that neighboring chunks are mostly close in the file too.
+static std::vector<std::pair<size_t, size_t>> splitTriangles (const Geometry & geometry, const unsigned int * indices,
+                                                              size_t triangleCount, size_t maxTriangles, std::vector<unsigned int> & order) {
+    std::vector<glm::vec3> centroids (triangleCount);
+    ThreadPool::instance ().parallelFor (0, triangleCount, [&] (size_t first, size_t last) {
+        const float * p = geometry.vertexPositions.data ();
+        for (size_t t = first; t < last; t++) {
+            const unsigned int * c = indices + 3 * t;
+            centroids[t] = (glm::make_vec3 (p + 3 * c[0]) + glm::make_vec3 (p + 3 * c[1]) + glm::make_vec3 (p + 3 * c[2])) / 3.f;
+        }
+    });
+    order.resize (triangleCount);
+    std::iota (order.begin (), order.end (), 0u);
+
+    std::vector<std::pair<size_t, size_t>> parts, pending = { { 0, triangleCount } };
+    while (!pending.empty ()) {
+        std::pair<size_t, size_t> range = pending.back ();
+        pending.pop_back ();
+        if (range.second - range.first <= maxTriangles) {
+            parts.push_back (range);
+            continue;
+        }
+        glm::vec3 lo = centroids[order[range.first]], hi = lo;
+        for (size_t i = range.first; i < range.second; i++) {
+            lo = glm::min (lo, centroids[order[i]]);
+            hi = glm::max (hi, centroids[order[i]]);
+        }
+        glm::vec3 extent = hi - lo;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        size_t middle = range.first + (range.second - range.first) / 2;
+        std::nth_element (order.begin () + range.first, order.begin () + middle, order.begin () + range.second,
+                          [&] (unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+        pending.push_back ({ middle, range.second });
+        pending.push_back ({ range.first, middle }); // Popped first
+    }
+    return parts;
+}
+
+// A chunk packed for the file
+struct PackedChunk {
+    ChunkRecord record;
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned int> indices;
+};
+
+// Copies the triangles of a part into a geometry of their own, optimizes and packs it
+static void packChunk (const Geometry & geometry, const unsigned int * indices, const unsigned int * triangles, size_t triangleCount,
+                       const VertexLayout & layout, PackedChunk & out) {
+    std::vector<unsigned int> vertices (3 * triangleCount); // The vertices used, sorted, give the local numbering
+    for (size_t t = 0; t < triangleCount; t++)
+        for (size_t k = 0; k < 3; k++)
+            vertices[3 * t + k] = indices[3 * triangles[t] + k];
+    std::sort (vertices.begin (), vertices.end ());
+    vertices.erase (std::unique (vertices.begin (), vertices.end ()), vertices.end ());
+
+    Geometry chunk;
+    chunk.layout = layout;
+    chunk.vertexPositions.resize (3 * vertices.size ());
+    chunk.vertexColors.resize (3 * vertices.size ());
+    if (!geometry.vertexNormals.empty ())
+        chunk.vertexNormals.resize (3 * vertices.size ());
+    for (size_t v = 0; v < vertices.size (); v++) {
+        std::memcpy (&chunk.vertexPositions[3 * v], &geometry.vertexPositions[3 * size_t (vertices[v])], 3 * sizeof (float));
+        std::memcpy (&chunk.vertexColors[3 * v], &geometry.vertexColors[3 * size_t (vertices[v])], 3 * sizeof (float));
+        if (!chunk.vertexNormals.empty ())
+            std::memcpy (&chunk.vertexNormals[3 * v], &geometry.vertexNormals[3 * size_t (vertices[v])], 3 * sizeof (float));
+    }
+    chunk.triangleIndices.resize (3 * triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (size_t k = 0; k < 3; k++)
+            chunk.triangleIndices[3 * t + k] = static_cast<unsigned int> (
+                std::lower_bound (vertices.begin (), vertices.end (), indices[3 * triangles[t] + k]) - vertices.begin ());
+
+    MeshOptimizer::optimizeVertexCache (chunk.triangleIndices, chunk.vertexCount ());
+    MeshOptimizer::optimizeVertexFetch (chunk);
+    chunk.computeBounds ();
+
+    glm::vec3 scale, offset;
+    out.vertices.resize (chunk.gpuVertexBytes ());
+    chunk.packVertices (out.vertices.data (), scale, offset);
+    out.indices.swap (chunk.triangleIndices);
+    ChunkRecord & record = out.record;
+    std::memcpy (record.center, &chunk.boundsCenter[0], sizeof (record.center));
+    record.radius = chunk.boundsRadius;
+    std::memcpy (record.positionScale, &scale[0], sizeof (record.positionScale));
+    std::memcpy (record.positionOffset, &offset[0], sizeof (record.positionOffset));
+    record.vertexCount = static_cast<uint32_t> (chunk.vertexCount ());
+    record.indexCount = static_cast<uint32_t> (out.indices.size ());
+}
+
+// The source mesh, read a few vertices or triangles at a time from its CPU streams or from its
+// packed data, which a geometry or PLY file maps rather than loads: never copied whole
+struct SourceMesh {
+    const Geometry & geometry;
+    const unsigned int * indices;
+    size_t triangleCount;
+    bool normals;
+
+    SourceMesh (const Geometry & geometry) : geometry (geometry) {
+        GeometryLevel finest = geometry.level (0);
+        indices = (geometry.packed.vertices ? geometry.packed.indices : geometry.triangleIndices.data ()) + finest.firstIndex;
+        triangleCount = finest.indexCount / 3;
+        normals = geometry.packed.vertices ? geometry.layout.normal != VertexLayout::NormalNone : !geometry.vertexNormals.empty ();
+    }
+
+    // Attributes of vertex v, the normal only if there are normals
+    void read (unsigned int v, float * position, float * color, float * normal) const {
+        const PackedGeometry & packed = geometry.packed;
+        if (packed.vertices) {
+            geometry.layout.unpack (packed.vertices, packed.vertexCount, packed.positionScale, packed.positionOffset, position, color, normal, v, 1);
+            return;
+        }
+        std::memcpy (position, &geometry.vertexPositions[3 * size_t (v)], 3 * sizeof (float));
+        if (color)
+            std::memcpy (color, &geometry.vertexColors[3 * size_t (v)], 3 * sizeof (float));
+        if (normal && normals)
+            std::memcpy (normal, &geometry.vertexNormals[3 * size_t (v)], 3 * sizeof (float));
+    }
+
+    glm::vec3 centroid (size_t t) const {
+        glm::vec3 p[3];
+        for (size_t k = 0; k < 3; k++)
+            read (indices[3 * t + k], &p[k][0], nullptr, nullptr);
+        return (p[0] + p[1] + p[2]) / 3.f;
+    }
+};
+
+// Grid the triangles are binned in by centroid, its cells numbered in Morton order so that
+// consecutive cells are close in space
+struct BinningGrid {
+    static const size_t cellsPerAxis = 64;
+    static const size_t cellCount = cellsPerAxis * cellsPerAxis * cellsPerAxis;
+    glm::vec3 lo;
+    glm::vec3 cellsPerUnit;
+
+    size_t cell (const glm::vec3 & p) const {
+        glm::uvec3 c = glm::uvec3 (glm::clamp ((p - lo) * cellsPerUnit, glm::vec3 (0.f), glm::vec3 (cellsPerAxis - 1)));
+        size_t code = 0;
+        for (unsigned int bit = 0; (size_t (1) << bit) < cellsPerAxis; bit++)
+            for (int axis = 0; axis < 3; axis++)
+                code |= size_t ((c[axis] >> bit) & 1u) << (3 * bit + axis);
+        return code;
+    }
+};
+
+static const size_t binTriangles = size_t (1) << 20; // Source triangles in memory at once, unless a single cell holds more
+static const size_t scanTriangles = size_t (1) << 20; // Triangles binned per step of the scan
+static const size_t flushIndices = 3 * 4096; // Buffered per bin before they are written out
+
+// The box of the vertices of the source, which its triangle centroids lie in
+static void sourceBounds (const SourceMesh & source, glm::vec3 & lo, glm::vec3 & hi) {
+    std::mutex mutex;
+    lo = glm::vec3 (std::numeric_limits<float>::max ());
+    hi = -lo;
+    ThreadPool::instance ().parallelFor (0, source.geometry.vertexCount (), [&] (size_t first, size_t last) {
+        glm::vec3 blockLo (std::numeric_limits<float>::max ()), blockHi = -blockLo, p;
+        for (size_t v = first; v < last; v++) {
+            source.read (unsigned (v), &p[0], nullptr, nullptr);
+            blockLo = glm::min (blockLo, p);
+            blockHi = glm::max (blockHi, p);
+        }
+        std::lock_guard<std::mutex> lock (mutex);
+        lo = glm::min (lo, blockLo);
+        hi = glm::max (hi, blockHi);
+    });
+}
+
+// Copies the triangles of a bin and the vertices they use into a geometry of their own
+static void loadBin (const SourceMesh & source, const unsigned int * indices, size_t triangleCount, Geometry & bin) {
+    std::vector<unsigned int> vertices (indices, indices + 3 * triangleCount); // Sorted, they give the local numbering
+    std::sort (vertices.begin (), vertices.end ());
+    vertices.erase (std::unique (vertices.begin (), vertices.end ()), vertices.end ());
+    bin.vertexPositions.resize (3 * vertices.size ());
+    bin.vertexColors.resize (3 * vertices.size ());
+    bin.vertexNormals.resize (source.normals ? 3 * vertices.size () : 0);
+    bin.triangleIndices.resize (3 * triangleCount);
+    ThreadPool & pool = ThreadPool::instance ();
+    pool.parallelFor (0, vertices.size (), [&] (size_t first, size_t last) {
+        for (size_t v = first; v < last; v++)
+            source.read (vertices[v], &bin.vertexPositions[3 * v], &bin.vertexColors[3 * v], source.normals ? &bin.vertexNormals[3 * v] : nullptr);
+    });
+    pool.parallelFor (0, bin.triangleIndices.size (), [&] (size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+            bin.triangleIndices[i] = static_cast<unsigned int> (std::lower_bound (vertices.begin (), vertices.end (), indices[i]) - vertices.begin ());
+    });
+}
+
+bool ChunkedMesh::build (const Geometry & geometry, const std::string & filename, size_t maxChunkTriangles, const VertexLayout & layout) {
+    if (geometry.views.indexBuffer) {
+        std::cerr << "ERROR: Cannot split " << filename << ": the geometry is read in place from buffer views" << std::endl;
+        return false;
+    }
+    ThreadPool & pool = ThreadPool::instance ();
+    SourceMesh source (geometry);
+    if (source.triangleCount == 0) {
+        std::cerr << "ERROR: Cannot split " << filename << ": the geometry has no triangles" << std::endl;
+        return false;
+    }
+
+    // First pass: the triangles counted per cell of the grid, and the cells grouped, in order, into
+    // bins of at most binTriangles triangles
+    BinningGrid grid;
+    glm::vec3 hi;
+    sourceBounds (source, grid.lo, hi);
+    grid.cellsPerUnit = float (BinningGrid::cellsPerAxis) / glm::max (hi - grid.lo, glm::vec3 (std::numeric_limits<float>::min ()));
+    std::unique_ptr<std::atomic<uint64_t>[]> cellTriangles (new std::atomic<uint64_t>[BinningGrid::cellCount]);
+    for (size_t c = 0; c < BinningGrid::cellCount; c++)
+        cellTriangles[c] = 0;
+    pool.parallelFor (0, source.triangleCount, [&] (size_t first, size_t last) {
+        for (size_t t = first; t < last; t++)
+            cellTriangles[grid.cell (source.centroid (t))].fetch_add (1, std::memory_order_relaxed);
+    });
+    std::vector<uint32_t> cellBin (BinningGrid::cellCount);
+    std::vector<uint64_t> binFirst (1, 0); // Triangles in the bins before each, the total last
+    uint64_t binSize = 0;
+    for (size_t c = 0; c < BinningGrid::cellCount; c++) {
+        uint64_t count = cellTriangles[c];
+        if (binSize > 0 && binSize + count > binTriangles) {
+            binFirst.push_back (binFirst.back () + binSize);
+            binSize = 0;
+        }
+        cellBin[c] = uint32_t (binFirst.size () - 1);
+        binSize += count;
+    }
+    binFirst.push_back (binFirst.back () + binSize);
+    size_t binCount = binFirst.size () - 1;
+
+    // Second pass: the indices of the triangles written out bin after bin to a temporary file, through
+    // a small buffer per bin
+    std::string binFilename = filename + ".bins";
+    std::ofstream bins (binFilename.c_str (), std::ios::binary | std::ios::trunc);
+    std::vector<std::vector<unsigned int>> buffers (binCount);
+    std::vector<uint64_t> written (binFirst.begin (), binFirst.end () - 1); // Triangles, from the start of the file
+    auto flush = [&] (size_t b) {
+        bins.seekp (3 * sizeof (unsigned int) * written[b]);
+        bins.write (reinterpret_cast<const char *> (buffers[b].data ()), sizeof (unsigned int) * buffers[b].size ());
+        written[b] += buffers[b].size () / 3;
+        buffers[b].clear ();
+    };
+    std::vector<uint32_t> triangleBin (std::min (scanTriangles, source.triangleCount));
+    for (size_t step = 0; step < source.triangleCount; step += scanTriangles) {
+        size_t count = std::min (scanTriangles, source.triangleCount - step);
+        pool.parallelFor (0, count, [&] (size_t first, size_t last) {
+            for (size_t t = first; t < last; t++)
+                triangleBin[t] = cellBin[grid.cell (source.centroid (step + t))];
+        });
+        for (size_t t = 0; t < count; t++) {
+            std::vector<unsigned int> & buffer = buffers[triangleBin[t]];
+            buffer.insert (buffer.end (), source.indices + 3 * (step + t), source.indices + 3 * (step + t + 1));
+            if (buffer.size () >= flushIndices)
+                flush (triangleBin[t]);
+        }
+    }
+    for (size_t b = 0; b < binCount; b++)
+        if (!buffers[b].empty ())
+            flush (b);
+    bins.close ();
+    size_t binBytes = 0;
+    std::shared_ptr<const void> binMapping = bins ? MappedFile::map (binFilename, binBytes) : nullptr;
+    if (!binMapping || binBytes != 3 * sizeof (unsigned int) * binFirst.back ()) {
+        std::cerr << "ERROR: Cannot write the temporary file " << binFilename << std::endl;
+        std::remove (binFilename.c_str ());
+        return false;
+    }
+    const unsigned int * binIndices = static_cast<const unsigned int *> (binMapping.get ());
+
+    VertexLayout fileLayout = layout; // Normals dropped if there are none
+    if (!source.normals)
+        fileLayout.normal = VertexLayout::NormalNone;
+    ChunkFileHeader header = {};
+    std::memcpy (header.magic, magic, sizeof (magic));
+    header.version = version;
+    header.position = fileLayout.position;
+    header.color = fileLayout.color;
+    header.normal = fileLayout.normal;
+    header.interleaved = fileLayout.interleaved;
+
+    std::ofstream file (filename.c_str (), std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "ERROR: Cannot write chunk file " << filename << std::endl;
+        std::remove (binFilename.c_str ());
+        return false;
+    }
+    std::vector<ChunkRecord> records;
+    uint64_t position = 0, end = alignChunk (sizeof (header));
+
+    // Last pass: each bin loaded alone, split at the medians into chunks, which are packed in
+    // parallel, a batch at a time so that memory stays bounded, then written in order
+    size_t batchSize = 4 * pool.threadCount ();
+    std::vector<PackedChunk> batch (batchSize);
+    for (size_t b = 0; b < binCount; b++) {
+        size_t binTriangleCount = binFirst[b + 1] - binFirst[b];
+        if (binTriangleCount == 0)
+            continue;
+        Geometry bin;
+        loadBin (source, binIndices + 3 * binFirst[b], binTriangleCount, bin);
+        std::vector<unsigned int> order;
+        std::vector<std::pair<size_t, size_t>> parts = splitTriangles (bin, bin.triangleIndices.data (), binTriangleCount, std::max<size_t> (maxChunkTriangles, 1), order);
+        for (size_t first = 0; first < parts.size (); first += batchSize) {
+            size_t count = std::min (batchSize, parts.size () - first);
+            pool.parallelFor (0, count, [&] (size_t begin, size_t last) {
+                for (size_t i = begin; i < last; i++) {
+                    std::pair<size_t, size_t> part = parts[first + i];
+                    packChunk (bin, bin.triangleIndices.data (), order.data () + part.first, part.second - part.first, fileLayout, batch[i]);
+                }
+            });
+            for (size_t i = 0; i < count; i++) {
+                static const char padding[chunkAlignment] = {};
+                PackedChunk & chunk = batch[i];
+                chunk.record.offset = end;
+                records.push_back (chunk.record);
+                header.maxVertexCount = std::max<uint64_t> (header.maxVertexCount, chunk.record.vertexCount);
+                header.maxIndexCount = std::max<uint64_t> (header.maxIndexCount, chunk.record.indexCount);
+                file.seekp (end);
+                file.write (reinterpret_cast<const char *> (chunk.vertices.data ()), chunk.vertices.size ());
+                file.write (reinterpret_cast<const char *> (chunk.indices.data ()), sizeof (unsigned int) * chunk.indices.size ());
+                position = end + chunk.vertices.size () + sizeof (unsigned int) * chunk.indices.size ();
+                end = alignChunk (position);
+                file.write (padding, end - position);
+            }
+        }
+    }
+    binMapping.reset ();
+    std::remove (binFilename.c_str ());
+
+    header.chunkCount = records.size ();
+    header.recordOffset = end;
+    file.seekp (end);
+    file.write (reinterpret_cast<const char *> (records.data ()), sizeof (ChunkRecord) * records.size ());
+    file.seekp (0);
+    file.write (reinterpret_cast<const char *> (&header), sizeof (header));
+    if (!file) {
+        std::cerr << "ERROR: Failed writing chunk file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/* Runtime paging */
+
+std::shared_ptr<ChunkedMesh> ChunkedMesh::open (const std::string & filename, size_t poolBytes) {
+    size_t size = 0;
+    std::shared_ptr<const void> mapping = MappedFile::map (filename, size, false);
+    if (!mapping) {
+        std::cerr << "ERROR: Cannot map chunk file " << filename << std::endl;
+        return nullptr;
+    }
+    const unsigned char * base = static_cast<const unsigned char *> (mapping.get ());
+    ChunkFileHeader header;
+    if (size < sizeof (header)) {
+        std::cerr << "ERROR: Truncated chunk file " << filename << std::endl;
+        return nullptr;
+    }
+    std::memcpy (&header, base, sizeof (header));
+    if (std::memcmp (header.magic, magic, sizeof (magic)) != 0 || header.version != version) {
+        std::cerr << "ERROR: " << filename << " is not a chunk file of this version" << std::endl;
+        return nullptr;
+    }
+    if (header.recordOffset > size || header.chunkCount > (size - header.recordOffset) / sizeof (ChunkRecord)) {
+        std::cerr << "ERROR: Truncated chunk file " << filename << std::endl;
+        return nullptr;
+    }
+
+    std::shared_ptr<ChunkedMesh> mesh = std::make_shared<ChunkedMesh> ();
+    mesh->mapping = mapping;
+    mesh->layout.position = VertexLayout::PositionFormat (header.position);
+    mesh->layout.color = VertexLayout::ColorFormat (header.color);
+    mesh->layout.normal = VertexLayout::NormalFormat (header.normal);
+    mesh->layout.interleaved = header.interleaved != 0;
+    size_t vertexSize = mesh->layout.vertexSize ();
+    // No more per chunk than the file holds, so that the slot and pool sizes of init cannot wrap
+    if (header.maxVertexCount > size / std::max<size_t> (vertexSize, 1) || header.maxIndexCount > size / sizeof (unsigned int)) {
+        std::cerr << "ERROR: Truncated chunk file " << filename << std::endl;
+        return nullptr;
+    }
+    mesh->maxVertexCount = header.maxVertexCount;
+    mesh->maxIndexCount = header.maxIndexCount;
+    mesh->poolBytes = poolBytes;
+    mesh->chunks.resize (header.chunkCount);
+    uint64_t largestVertexCount = 0, largestIndexCount = 0;
+    for (size_t c = 0; c < mesh->chunks.size (); c++) {
+        ChunkRecord record;
+        std::memcpy (&record, base + header.recordOffset + sizeof (ChunkRecord) * c, sizeof (record));
+        uint64_t bytes = vertexSize * uint64_t (record.vertexCount) + sizeof (unsigned int) * uint64_t (record.indexCount);
+        if (record.vertexCount > header.maxVertexCount || record.indexCount > header.maxIndexCount
+            || record.offset > size || bytes > size - record.offset) {
+            std::cerr << "ERROR: Truncated chunk file " << filename << std::endl;
+            return nullptr;
+        }
+        largestVertexCount = std::max<uint64_t> (largestVertexCount, record.vertexCount);
+        largestIndexCount = std::max<uint64_t> (largestIndexCount, record.indexCount);
+        Chunk & chunk = mesh->chunks[c];
+        chunk.center = glm::make_vec3 (record.center);
+        chunk.radius = record.radius;
+        chunk.positionScale = glm::make_vec3 (record.positionScale);
+        chunk.positionOffset = glm::make_vec3 (record.positionOffset);
+        chunk.vertexCount = record.vertexCount;
+        chunk.indexCount = record.indexCount;
+        chunk.vertices = base + record.offset;
+    }
+    if (largestVertexCount != header.maxVertexCount || largestIndexCount != header.maxIndexCount) {
+        std::cerr << "ERROR: Corrupt chunk file " << filename << ": wrong largest chunk" << std::endl;
+        return nullptr;
+    }
+
+    // Every index within its chunk, which is drawn with a base vertex into a shared pool
+    std::atomic<bool> valid (true);
+    ThreadPool::instance ().parallelFor (0, mesh->chunks.size (), [&] (size_t first, size_t last) {
+        for (size_t c = first; c < last && valid; c++) {
+            const Chunk & chunk = mesh->chunks[c];
+            const unsigned char * indices = chunk.vertices + vertexSize * chunk.vertexCount; // Unaligned after some quantized vertices
+            for (size_t i = 0; i < chunk.indexCount; i++) {
+                unsigned int index;
+                std::memcpy (&index, indices + sizeof (unsigned int) * i, sizeof (index));
+                if (index >= chunk.vertexCount) {
+                    valid = false;
+                    break;
+                }
+            }
+        }
+    });
+    if (!valid) {
+        std::cerr << "ERROR: Corrupt chunk file " << filename << ": index out of range" << std::endl;
+        return nullptr;
+    }
+    return mesh;
+}
+
+void ChunkedMesh::init () {
+    // As many slots of the largest chunk as the pool holds, at least one, at most one per chunk
+    size_t slotBytes = std::max<size_t> (maxVertexCount * layout.vertexSize () + maxIndexCount * sizeof (unsigned int), 1);
+    size_t slotCount = std::min (std::max<size_t> (poolBytes / slotBytes, 1), chunks.size ());
+    slotCount = std::min<size_t> (slotCount, INT_MAX / std::max<size_t> (maxVertexCount, 1)); // Base vertices are GLint
+    slots.assign (slotCount, Slot ());
+    for (Chunk & chunk : chunks) {
+        chunk.slot = noSlot;
+        chunk.requestFrame = 0;
+    }
+    residentCount = 0;
+
+    glCreateBuffers (1, &vbo);
+    glCreateBuffers (1, &ibo);
+    glNamedBufferStorage (vbo, std::max<size_t> (slotCount * maxVertexCount * layout.vertexSize (), 1), NULL, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage (ibo, std::max<size_t> (slotCount * maxIndexCount * sizeof (unsigned int), 1), NULL, GL_DYNAMIC_STORAGE_BIT);
+    glCreateVertexArrays (1, &vao);
+    layout.bind (vao, vbo, slotCount * maxVertexCount); // The slots are drawn with a base vertex, in every attribute block
+    glVertexArrayElementBuffer (vao, ibo);
+}
+
+size_t ChunkedMesh::acquireSlot () {
+    size_t lru = noSlot;
+    for (size_t s = 0; s < slots.size (); s++) {
+        if (slots[s].lastUsed < frame && (lru == noSlot || slots[s].lastUsed < slots[lru].lastUsed))
+            lru = s;
+    }
+    if (lru != noSlot && slots[lru].chunk != noSlot) {
+        Chunk & evicted = chunks[slots[lru].chunk];
+        evicted.slot = noSlot;
+        evicted.requestFrame = 0; // To be prefetched again
+        slots[lru].chunk = noSlot;
+        residentCount--;
+    }
+    return lru;
+}
+
+// Copies the chunk from the mapping into its slot, attribute block by attribute block
+void ChunkedMesh::upload (size_t c, size_t slot) {
+    Chunk & chunk = chunks[c];
+    size_t poolVertexCount = slots.size () * maxVertexCount;
+    size_t firstVertex = slot * maxVertexCount;
+    size_t source = 0, target = 0;
+    for (size_t i = 0; i < layout.attributeCount (); i++) {
+        size_t size = layout.interleaved ? layout.vertexSize () : layout.attribute (i).size;
+        glNamedBufferSubData (vbo, target + firstVertex * size, chunk.vertexCount * size, chunk.vertices + source);
+        if (layout.interleaved)
+            break; // One block of records
+        source += size * chunk.vertexCount;
+        target += size * poolVertexCount;
+    }
+    glNamedBufferSubData (ibo, sizeof (unsigned int) * slot * maxIndexCount, sizeof (unsigned int) * chunk.indexCount,
+                          chunk.vertices + layout.vertexSize () * chunk.vertexCount);
+    chunk.slot = slot;
+    slots[slot].chunk = c;
+    residentCount++;
+}
+
+void ChunkedMesh::render (const glm::mat4 & viewMatrix, const glm::mat4 & projectionMatrix) {
+    frame++;
+    drawnCount = 0;
+    if (slots.empty ())
+        return;
+    glm::mat4 modelViewMatrix = viewMatrix * computeTransformationMatrix ();
+    MeshletCuller culler (modelViewMatrix, projectionMatrix);
+    glm::vec3 eye = glm::vec3 (glm::inverse (modelViewMatrix) * glm::vec4 (0.f, 0.f, 0.f, 1.f));
+    visible.clear ();
+    for (size_t c = 0; c < chunks.size (); c++)
+        if (culler.isVisible (chunks[c].center, chunks[c].radius))
+            visible.push_back (c);
+    std::sort (visible.begin (), visible.end (), [&] (size_t a, size_t b) { // Nearest first: they get the uploads and the slots
+        return glm::distance (chunks[a].center, eye) - chunks[a].radius < glm::distance (chunks[b].center, eye) - chunks[b].radius;
+    });
+
+    glUniform1i (VertexLayout::NormalEncodingUniform, layout.normalEncoding ());
+    glBindVertexArray (vao);
+
+    size_t uploaded = 0;
+    for (size_t c : visible) {
+        Chunk & chunk = chunks[c];
+        if (chunk.slot == noSlot) {
+            size_t bytes = layout.vertexSize () * chunk.vertexCount + sizeof (unsigned int) * chunk.indexCount;
+            if (chunk.requestFrame == 0) {
+                // Read in the background, uploaded in a later frame without waiting on the disk
+                MappedFile::prefetch (chunk.vertices, bytes);
+                chunk.requestFrame = frame;
+                continue;
+            }
+            if (chunk.requestFrame == frame || uploaded >= uploadBytesPerFrame)
+                continue;
+            size_t slot = acquireSlot ();
+            if (slot == noSlot)
+                continue; // Every slot holds a chunk drawn in this frame: the pool is too small for the view
+            upload (c, slot);
+            uploaded += bytes;
+        }
+        slots[chunk.slot].lastUsed = frame;
+        glUniform3fv (VertexLayout::PositionScaleUniform, 1, &chunk.positionScale[0]);
+        glUniform3fv (VertexLayout::PositionOffsetUniform, 1, &chunk.positionOffset[0]);
+        glDrawElementsBaseVertex (GL_TRIANGLES, static_cast<GLsizei> (chunk.indexCount), GL_UNSIGNED_INT,
+                                  reinterpret_cast<const void *> (sizeof (unsigned int) * chunk.slot * maxIndexCount),
+                                  static_cast<GLint> (chunk.slot * maxVertexCount));
+        drawnCount++;
+    }
+}
+
+void ChunkedMesh::clear () {
+    glDeleteVertexArrays (1, &vao);
+    glDeleteBuffers (1, &vbo);
+    glDeleteBuffers (1, &ibo);
+    vao = vbo = ibo = 0;
+    slots.clear ();
+    for (Chunk & chunk : chunks) {
+        chunk.slot = noSlot;
+        chunk.requestFrame = 0;
+    }
+    residentCount = 0;
+    drawnCount = 0;
+}
+
+size_t ChunkedMesh::chunkCount () const {
+    return chunks.size ();
+}
+
+size_t ChunkedMesh::residentChunkCount () const {
+    return residentCount;
+}
+
+size_t ChunkedMesh::drawnChunkCount () const {
+    return drawnCount;
+}
@@ -0,0 +1,85 @@
+#ifndef _CHUNKED_MESH_H
+#define _CHUNKED_MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Transform.hpp"
+#include "Geometry.hpp"
+
+// Mesh too large for memory and for one GPU buffer, split offline into spatial chunks stored in
+// one file. At runtime the file is mapped, never read as a whole: the chunks in the frustum are
+// prefetched in the background, uploaded a few per frame, nearest first, into a GPU pool of fixed
+// size, and evicted least recently drawn first when the pool is full. A chunk is drawn once it
+// is resident; until then the frame simply lacks it.
+class ChunkedMesh : public Transform {
+public:
+
+	// Offline: splits the finest level of geometry into chunks of at most maxChunkTriangles triangles
+	// and writes them to filename, each optimized for the vertex cache and packed in layout with its
+	// own quantization. The geometry is read from its CPU streams or its packed data, in bounded
+	// passes: the triangles are counted per cell of a grid, written out cell after cell to a temporary
+	// file next to filename, then read back a bin of cells at a time (about a million triangles) and
+	// cut at the median of the longest axis. A mesh larger than memory is thus split from its mapping,
+	// an uncompressed GeometryFile for instance, whose pages the system reclaims as it goes.
+	static bool build (const Geometry & geometry, const std::string & filename,
+	                   size_t maxChunkTriangles = 65536, const VertexLayout & layout = VertexLayout::compact ());
+
+	// Maps a chunk file, giving poolBytes of GPU memory to the resident chunks. nullptr, after
+	// printing why, if the file is missing or malformed.
+	static std::shared_ptr<ChunkedMesh> open (const std::string & filename, size_t poolBytes = size_t (256) << 20);
+
+	void init (); // Creates the empty GPU pool
+	void render (const glm::mat4 & viewMatrix, const glm::mat4 & projectionMatrix); // Draws the resident chunks in the frustum, pages in the others
+	void clear ();
+
+	size_t chunkCount () const;
+	size_t residentChunkCount () const;
+	size_t drawnChunkCount () const; // By the last render
+
+private:
+
+	static const size_t noSlot = ~size_t (0);
+
+	struct Chunk {
+		glm::vec3 center; // Bounding sphere
+		float radius;
+		glm::vec3 positionScale; // Dequantization of its positions
+		glm::vec3 positionOffset;
+		size_t vertexCount;
+		size_t indexCount;
+		const unsigned char * vertices; // In the mapping, the indices following
+		size_t slot = noSlot; // In the GPU pool
+		uint64_t requestFrame = 0; // When it was prefetched, 0 if it was not
+	};
+
+	struct Slot {
+		size_t chunk = noSlot;
+		uint64_t lastUsed = 0; // Frame
+	};
+
+	size_t acquireSlot (); // Frees the least recently used slot not drawn in this frame, noSlot if there is none
+	void upload (size_t chunk, size_t slot);
+
+	std::shared_ptr<const void> mapping;
+	VertexLayout layout;
+	size_t maxVertexCount = 0; // Per chunk, and per slot of the pool
+	size_t maxIndexCount = 0;
+	size_t poolBytes = 0;
+	std::vector<Chunk> chunks;
+	std::vector<Slot> slots;
+	std::vector<size_t> visible; // Chunks in the frustum, reused from frame to frame
+	uint64_t frame = 0;
+	size_t residentCount = 0;
+	size_t drawnCount = 0;
+
+	GLuint vbo = 0;
+	GLuint ibo = 0;
+	GLuint vao = 0;
+};
+
+#endif //_CHUNKED_MESH_H
@@ -3,6 +3,7 @@
 in vec3 fPosition; // Shader input, linearly interpolated by default from the previous stage (here the vertex shader)
 in vec3 fNormal;
 in vec3 fColor;
+in vec3 fViewPosition;
 
 out vec4 color; // Shader output: the color response attached to this fragment
 
@@ -22,8 +23,16 @@ struct Material {
 
 uniform Material material;
 
+// The interpolated vertex normal, or without one the normal of the facet, from the screen-space
+// derivatives of the view-space position
+vec3 surfaceNormal() {
+	if (fNormal == vec3 (0.0))
+		return normalize (cross (dFdx (fViewPosition), dFdy (fViewPosition)));
+	return normalize (fNormal);
+}
+
 vec3 specularIllumination() {
-	vec3 n = normalize (fNormal);
+	vec3 n = surfaceNormal ();
 	vec3 wi = normalize (lightSource.position - fPosition);
 	vec3 wo = normalize (-fPosition);
 	vec3 fd = material.kd * material.albedo;
@@ -36,7 +45,7 @@ vec3 specularIllumination() {
 
 vec3 diffuseIllumination() {
 	vec3 wi = normalize (lightSource.position - fPosition);
-	float lambertianTerm = max (0.0, dot (fNormal, wi));
+	float lambertianTerm = max (0.0, dot (surfaceNormal (), wi));
 	vec3 radiance = vec3 (
 		lambertianTerm * lightSource.color.x * lightSource.intensity,
 		lambertianTerm * lightSource.color.y * lightSource.intensity,
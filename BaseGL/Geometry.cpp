@@ -0,0 +1,474 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "Geometry.hpp"
+#include "GeometryCache.hpp"
+
+// Binding points of the attributes of buffer views, those of the blocks of VertexLayout. Binding 2 is left to InstancedMesh.
+static const GLuint viewBindings[3] = { 0, 1, 3 };
+
+GeometryBuffer::GeometryBuffer (std::shared_ptr<const void> storage, const void * data, size_t size)
+    : storage (storage), data (data), size (size) {}
+
+GLuint GeometryBuffer::acquire () {
+    if (users++ == 0) {
+        glCreateBuffers (1, &buffer);
+        glNamedBufferStorage (buffer, size, data, 0);
+    }
+    return buffer;
+}
+
+GLuint GeometryBuffer::name () const {
+    return buffer;
+}
+
+void GeometryBuffer::release () {
+    if (users > 0 && --users == 0) {
+        glDeleteBuffers (1, &buffer);
+        buffer = 0;
+    }
+}
+
+void Geometry::allocate (const GeometrySize & size) {
+    vertexPositions.resize (3 * size.vertexCount);
+    vertexColors.resize (3 * size.vertexCount);
+    vertexNormals.resize (3 * size.vertexCount);
+    triangleIndices.resize (size.indexCount);
+}
+
+GeometryView Geometry::view () {
+    return { vertexPositions.data (), vertexColors.data (), vertexNormals.data (), triangleIndices.data () };
+}
+
+std::shared_ptr<Geometry> Geometry::copy () {
+    finishBuild (true);
+    std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> (*this);
+    geometry->vao = geometry->vbo = geometry->ibo = 0;
+    geometry->gpuUsers = geometry->upload = 0;
+    geometry->streaming = Streaming ();
+    return geometry;
+}
+
+void Geometry::unpack () {
+    finishBuild (true);
+    if (!packed.vertices)
+        return;
+    size_t count = packed.vertexCount;
+    vertexPositions.resize (3 * count);
+    vertexColors.resize (3 * count);
+    vertexNormals.resize (layout.normal == VertexLayout::NormalNone ? 0 : 3 * count);
+    layout.unpack (packed.vertices, count, packed.positionScale, packed.positionOffset,
+                   vertexPositions.data (), vertexColors.data (), vertexNormals.empty () ? nullptr : vertexNormals.data ());
+    triangleIndices.assign (packed.indices, packed.indices + packed.indexCount);
+    packed = PackedGeometry ();
+}
+
+bool Geometry::isOnGPU () const {
+    return vao != 0;
+}
+
+size_t Geometry::gpuUpload () const {
+    return upload;
+}
+
+// Id of a new set of GPU buffers, never 0. GL reuses deleted names, so they cannot tell two apart.
+static size_t nextUpload () {
+    static size_t last = 0;
+    return ++last;
+}
+
+size_t Geometry::vertexCount () const {
+    if (views.indexBuffer)
+        return views.vertexCount;
+    return packed.vertices ? packed.vertexCount : vertexPositions.size () / 3;
+}
+
+GLsizei Geometry::indexCount () const {
+    if (views.indexBuffer)
+        return static_cast<GLsizei> (views.indexCount);
+    return static_cast<GLsizei> (packed.vertices ? packed.indexCount : triangleIndices.size ());
+}
+
+GLenum Geometry::indexType () const {
+    return views.indexBuffer ? views.indexType : GL_UNSIGNED_INT;
+}
+
+const void * Geometry::indexOffset (size_t firstIndex) const {
+    if (!views.indexBuffer)
+        return reinterpret_cast<const void *> (sizeof (unsigned int) * firstIndex);
+    size_t indexSize = views.indexType == GL_UNSIGNED_BYTE ? 1 : (views.indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+    return reinterpret_cast<const void *> (views.indexOffset + indexSize * firstIndex);
+}
+
+size_t Geometry::levelCount () const {
+    return levels.empty () ? 1 : levels.size ();
+}
+
+GeometryLevel Geometry::level (size_t index) const {
+    if (levels.empty ())
+        return { 0, static_cast<unsigned int> (indexCount ()), std::numeric_limits<float>::max () };
+    return levels[index];
+}
+
+void Geometry::computeBounds () {
+    if (vertexCount () == 0)
+        return;
+    glm::vec3 lo (vertexPositions[0], vertexPositions[1], vertexPositions[2]), hi = lo;
+    for (size_t v = 1; v < vertexCount (); v++) {
+        glm::vec3 p (vertexPositions[3*v], vertexPositions[3*v+1], vertexPositions[3*v+2]);
+        lo = glm::min (lo, p);
+        hi = glm::max (hi, p);
+    }
+    boundsCenter = 0.5f * (lo + hi);
+    float radius2 = 0.f;
+    for (size_t v = 0; v < vertexCount (); v++) {
+        glm::vec3 d = glm::vec3 (vertexPositions[3*v], vertexPositions[3*v+1], vertexPositions[3*v+2]) - boundsCenter;
+        radius2 = std::max (radius2, glm::dot (d, d));
+    }
+    boundsRadius = std::sqrt (radius2);
+}
+
+size_t Geometry::gpuVertexBytes () const {
+    return effectiveLayout ().vertexSize () * vertexCount ();
+}
+
+// The requested layout, without its normal attribute if there are no normals to upload
+VertexLayout Geometry::effectiveLayout () const {
+    VertexLayout effective = layout;
+    if (vertexNormals.empty () && !packed.vertices) // Packed data comes with the layout it was packed in
+        effective.normal = VertexLayout::NormalNone;
+    return effective;
+}
+
+// Passes the layout-dependent decoding parameters to the current GPU program, at their fixed locations
+void Geometry::setShaderUniforms () const {
+    GLint normalEncoding = effectiveLayout ().normalEncoding ();
+    if (views.indexBuffer) // Float normals, if any
+        normalEncoding = std::any_of (views.attributes.begin (), views.attributes.end (), [] (const BufferAttribute & a) { return a.format.location == 2; }) ? 1 : 0;
+    glUniform3fv (VertexLayout::PositionScaleUniform, 1, &positionScale[0]);
+    glUniform3fv (VertexLayout::PositionOffsetUniform, 1, &positionOffset[0]);
+    glUniform1i (VertexLayout::NormalEncodingUniform, normalEncoding);
+}
+
+void Geometry::render () {
+    renderLevel (0);
+}
+
+void Geometry::renderLevel (size_t index) {
+    index = std::max (index, firstStreamedLevel ());
+    if (index >= levelCount ())
+        return; // Nothing streamed yet
+    GeometryLevel range = level (index);
+    setShaderUniforms ();
+    glBindVertexArray (vao); // Activate the VAO storing geometry data
+    glDrawElements (GL_TRIANGLES, range.indexCount, indexType (), indexOffset (range.firstIndex)); // Call for rendering: stream the current GPU geometry through the current GPU program
+}
+
+void Geometry::renderInstanced (GLuint instanceVao, GLsizei instanceCount) {
+    size_t index = firstStreamedLevel ();
+    if (index >= levelCount ())
+        return;
+    GeometryLevel range = level (index);
+    setShaderUniforms ();
+    glBindVertexArray (instanceVao);
+    glDrawElementsInstanced (GL_TRIANGLES, range.indexCount, indexType (), indexOffset (range.firstIndex), instanceCount); // A single call streams every instance
+}
+
+void Geometry::renderRanges (const GLsizei * counts, const void * const * offsets, GLsizei rangeCount) {
+    setShaderUniforms ();
+    glBindVertexArray (vao);
+    glMultiDrawElements (GL_TRIANGLES, counts, indexType (), offsets, rangeCount);
+}
+
+void Geometry::clear () {
+    if (gpuUsers > 0 && --gpuUsers > 0)
+        return; // Still drawn by another mesh
+    if (!isOnGPU ())
+        return;
+    glDeleteVertexArrays (1, &vao);
+    if (views.indexBuffer) {
+        for (const BufferAttribute & attribute : views.attributes)
+            attribute.buffer->release ();
+        views.indexBuffer->release ();
+    }
+    glDeleteBuffers (1, &vbo);
+    glDeleteBuffers (1, &ibo);
+    vao = vbo = ibo = 0;
+    upload = 0;
+    streaming.levelCount = 0;
+    streaming.levelStarted = false;
+}
+
+void Geometry::quantization (glm::vec3 & scale, glm::vec3 & offset) const {
+    if (packed.vertices) {
+        scale = packed.positionScale;
+        offset = packed.positionOffset;
+    } else if (effectiveLayout ().position == VertexLayout::PositionSnorm16 && vertexCount () > 0) {
+        // Quantize in the bounding box: the shader maps [-1, 1] back to [min, max]
+        glm::vec3 lo (vertexPositions[0], vertexPositions[1], vertexPositions[2]), hi = lo;
+        for (size_t v = 1; v < vertexCount (); v++) {
+            glm::vec3 p (vertexPositions[3*v], vertexPositions[3*v+1], vertexPositions[3*v+2]);
+            lo = glm::min (lo, p);
+            hi = glm::max (hi, p);
+        }
+        offset = 0.5f * (lo + hi);
+        scale = glm::max (0.5f * (hi - lo), glm::vec3 (1e-20f));
+    } else {
+        offset = glm::vec3 (0.f);
+        scale = glm::vec3 (1.f);
+    }
+}
+
+void Geometry::packVertices (void * out, glm::vec3 & scale, glm::vec3 & offset) const {
+    VertexLayout effective = effectiveLayout ();
+    quantization (scale, offset);
+    if (vertexCount () > 0)
+        effective.pack (vertexPositions.data (), vertexColors.data (), vertexNormals.empty () ? nullptr : vertexNormals.data (),
+                        vertexCount (), scale, offset, out);
+}
+
+void Geometry::initGPUGeometry () {
+    gpuUsers++;
+    if (isOnGPU ())
+        return; // Already uploaded by another Mesh sharing this geometry
+    if (streamBudget > 0 && !views.indexBuffer)
+        return; // Left to stream ()
+    finishBuild (true);
+
+    if (views.indexBuffer) {
+        // Every buffer is shared and uploaded as it is, on first use
+        for (const BufferAttribute & attribute : views.attributes)
+            attribute.buffer->acquire ();
+        views.indexBuffer->acquire ();
+        glCreateVertexArrays (1, &vao);
+        bindAttributes (vao);
+        upload = nextUpload ();
+        return;
+    }
+
+    glCreateBuffers (1, &vbo); // Generate a GPU buffer to store the attributes of the vertices
+    glCreateBuffers (1, &ibo); // Same for the index buffer, that stores the list of indices of the triangles forming the mesh
+    size_t vertexBufferSize = gpuVertexBytes ();
+    size_t indexBufferSize = sizeof (unsigned int) * indexCount ();
+
+    if (packed.vertices) {
+        // Already in the GPU format: the driver reads the (mapped) source as it copies it, nothing is decoded on the way
+        positionScale = packed.positionScale;
+        positionOffset = packed.positionOffset;
+        glNamedBufferStorage (vbo, vertexBufferSize, packed.vertices, 0);
+        glNamedBufferStorage (ibo, indexBufferSize, packed.indices, 0);
+    } else {
+        glNamedBufferStorage (vbo, vertexBufferSize, NULL, GL_MAP_WRITE_BIT); // Creta a data store on the GPU
+        if (vertexBufferSize > 0) {
+            // Pack the CPU float streams straight into the mapped GPU store, without an intermediate copy
+            void * mapped = glMapNamedBufferRange (vbo, 0, vertexBufferSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            packVertices (mapped, positionScale, positionOffset);
+            glUnmapNamedBuffer (vbo);
+        } else {
+            packVertices (nullptr, positionScale, positionOffset);
+        }
+        glNamedBufferStorage (ibo, indexBufferSize, NULL, GL_DYNAMIC_STORAGE_BIT);
+        glNamedBufferSubData (ibo, 0, indexBufferSize, triangleIndices.data ());
+    }
+
+    glCreateVertexArrays (1, &vao); // Create a single hangle that joins together attributes (vertex positions, normals) and connectivity (triangles indices)
+    bindAttributes (vao);
+    upload = nextUpload ();
+}
+
+void Geometry::bindAttributes (GLuint targetVao) const {
+    if (views.indexBuffer) {
+        bindViews (targetVao);
+        return;
+    }
+    effectiveLayout ().bind (targetVao, vbo, vertexCount ());
+    glVertexArrayElementBuffer (targetVao, ibo);
+}
+
+// Each attribute reads its own buffer through its own binding, with the offset and stride of the view
+void Geometry::bindViews (GLuint targetVao) const {
+    for (size_t i = 0; i < views.attributes.size (); i++) {
+        const BufferAttribute & attribute = views.attributes[i];
+        const VertexLayout::Attribute & format = attribute.format;
+        glVertexArrayVertexBuffer (targetVao, viewBindings[i], attribute.buffer->name (), attribute.offset, attribute.stride);
+        glVertexArrayAttribFormat (targetVao, format.location, format.components, format.type, format.normalized, 0);
+        glVertexArrayAttribBinding (targetVao, format.location, viewBindings[i]);
+        glEnableVertexArrayAttrib (targetVao, format.location);
+    }
+    glVertexArrayElementBuffer (targetVao, views.indexBuffer->name ());
+}
+
+/* Progressive loading */
+
+void Geometry::buildAsync (const std::function<std::shared_ptr<Geometry> ()> & build) {
+    streaming.build = std::make_shared<std::future<std::pair<std::shared_ptr<Geometry>, bool>>> (std::async (std::launch::async, [build] {
+        std::shared_ptr<Geometry> built = build ();
+        // Ours alone, and out of the cache: quantize it here too, off the render thread. A geometry
+        // the cache can still hand out is left untouched, for the render thread to copy.
+        bool owned = built && GeometryCache::release (built);
+        if (owned)
+            built->quantization (built->positionScale, built->positionOffset);
+        return std::make_pair (built, owned);
+    }));
+}
+
+bool Geometry::finishBuild (bool wait) {
+    if (!streaming.build)
+        return true;
+    if (!wait && streaming.build->wait_for (std::chrono::seconds (0)) != std::future_status::ready)
+        return false;
+    std::pair<std::shared_ptr<Geometry>, bool> result = streaming.build->get ();
+    std::shared_ptr<Geometry> built = result.first;
+    result.first.reset ();
+    streaming.build.reset ();
+    if (!built)
+        return true; // The build failed, and said why: the geometry stays empty
+
+    // Take over its data, moved if nobody else holds it, copied otherwise (a cached geometry, for
+    // instance), but never its GPU buffers
+    size_t budget = streamBudget, users = gpuUsers;
+    bool quantized = result.second;
+    if (GeometryCache::release (built))
+        *this = std::move (*built);
+    else
+        *this = *built;
+    vao = vbo = ibo = 0;
+    upload = 0;
+    streamBudget = budget;
+    gpuUsers = users;
+    streaming = Streaming ();
+    streaming.quantized = quantized;
+    return true;
+}
+
+size_t Geometry::firstStreamedLevel () const {
+    if (streamBudget == 0 || views.indexBuffer)
+        return 0;
+    return levelCount () - std::min (streaming.levelCount, levelCount ());
+}
+
+bool Geometry::stream () {
+    if (streamBudget == 0 || views.indexBuffer)
+        return true;
+    if (streaming.levelCount == levelCount ())
+        return true;
+    if (!finishBuild (false) || indexCount () == 0)
+        return false;
+    if (!isOnGPU ())
+        beginStreaming ();
+
+    const unsigned int * indices = packed.vertices ? packed.indices : triangleIndices.data ();
+    size_t vertexSize = effectiveLayout ().vertexSize ();
+    size_t budget = streamBudget;
+    while (budget > 0 && streaming.levelCount < levelCount ()) {
+        if (!streaming.levelStarted)
+            startStreamLevel ();
+        if (!streaming.vertexQueue.empty ()) {
+            std::pair<size_t, size_t> & range = streaming.vertexQueue.back ();
+            size_t count = std::min (range.second - range.first, std::max<size_t> (1, budget / vertexSize));
+            streamVertices (range.first, count);
+            range.first += count;
+            if (range.first == range.second)
+                streaming.vertexQueue.pop_back ();
+            budget -= std::min (budget, count * vertexSize);
+        } else if (streaming.indexFirst < streaming.indexEnd) {
+            size_t count = std::min (streaming.indexEnd - streaming.indexFirst, std::max<size_t> (1, budget / sizeof (unsigned int)));
+            glNamedBufferSubData (ibo, sizeof (unsigned int) * streaming.indexFirst, sizeof (unsigned int) * count, indices + streaming.indexFirst);
+            streaming.indexFirst += count;
+            budget -= std::min (budget, count * sizeof (unsigned int));
+        }
+        if (streaming.vertexQueue.empty () && streaming.indexFirst == streaming.indexEnd) {
+            streaming.levelCount++; // Drawable from now on
+            streaming.levelStarted = false;
+        }
+    }
+    return streaming.levelCount > 0;
+}
+
+// Creates the GPU buffers, without any data yet
+void Geometry::beginStreaming () {
+    if (!streaming.quantized)
+        quantization (positionScale, positionOffset);
+    glCreateBuffers (1, &vbo);
+    glCreateBuffers (1, &ibo);
+    glNamedBufferStorage (vbo, gpuVertexBytes (), NULL, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage (ibo, sizeof (unsigned int) * indexCount (), NULL, GL_DYNAMIC_STORAGE_BIT);
+    glCreateVertexArrays (1, &vao);
+    bindAttributes (vao);
+    upload = nextUpload ();
+    streaming.levelCount = 0;
+    streaming.levelStarted = false;
+    streaming.uploaded.clear ();
+    streaming.vertexQueue.clear ();
+}
+
+// Queues the indices of the next level, and the vertices they use that no coarser level uploaded
+void Geometry::startStreamLevel () {
+    GeometryLevel range = level (levelCount () - 1 - streaming.levelCount);
+    streaming.indexFirst = range.firstIndex;
+    streaming.indexEnd = range.firstIndex + range.indexCount;
+    streaming.levelStarted = true;
+    if (range.indexCount == 0)
+        return;
+
+    const unsigned int * indices = packed.vertices ? packed.indices : triangleIndices.data ();
+    auto bounds = std::minmax_element (indices + streaming.indexFirst, indices + streaming.indexEnd);
+    size_t first = *bounds.first, last = *bounds.second + size_t (1);
+    size_t cursor = first;
+    for (const std::pair<size_t, size_t> & done : streaming.uploaded) {
+        if (done.first >= last)
+            break;
+        if (done.first > cursor)
+            streaming.vertexQueue.push_back ({ cursor, done.first });
+        cursor = std::max (cursor, done.second);
+    }
+    if (cursor < last)
+        streaming.vertexQueue.push_back ({ cursor, last });
+
+    // Merge [first, last) into the uploaded ranges
+    std::vector<std::pair<size_t, size_t>> merged;
+    streaming.uploaded.push_back ({ first, last });
+    std::sort (streaming.uploaded.begin (), streaming.uploaded.end ());
+    for (const std::pair<size_t, size_t> & done : streaming.uploaded) {
+        if (!merged.empty () && done.first <= merged.back ().second)
+            merged.back ().second = std::max (merged.back ().second, done.second);
+        else
+            merged.push_back (done);
+    }
+    streaming.uploaded.swap (merged);
+}
+
+// Uploads count vertices from first, packed on the way unless they already are
+void Geometry::streamVertices (size_t first, size_t count) {
+    VertexLayout effective = effectiveLayout ();
+    const unsigned char * source;
+    size_t sourceFirst, sourceCount; // Vertex of the source at first, and vertices it holds
+    if (packed.vertices) {
+        source = static_cast<const unsigned char *> (packed.vertices);
+        sourceFirst = first;
+        sourceCount = vertexCount ();
+    } else {
+        streaming.scratch.resize (effective.vertexSize () * count);
+        effective.pack (&vertexPositions[3 * first], &vertexColors[3 * first], vertexNormals.empty () ? nullptr : &vertexNormals[3 * first],
+                        count, positionScale, positionOffset, streaming.scratch.data ());
+        source = streaming.scratch.data ();
+        sourceFirst = 0;
+        sourceCount = count;
+    }
+
+    if (effective.interleaved) {
+        size_t size = effective.vertexSize ();
+        glNamedBufferSubData (vbo, size * first, size * count, source + size * sourceFirst);
+        return;
+    }
+    // One block per attribute, in the buffer as in the source
+    size_t blockOffset = 0, sourceBlockOffset = 0;
+    for (size_t a = 0; a < effective.attributeCount (); a++) {
+        size_t size = effective.attribute (a).size;
+        glNamedBufferSubData (vbo, blockOffset + size * first, size * count, source + sourceBlockOffset + size * sourceFirst);
+        blockOffset += size * vertexCount ();
+        sourceBlockOffset += size * sourceCount;
+    }
+}
@@ -0,0 +1,189 @@
+#ifndef _GEOMETRY_H
+#define _GEOMETRY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <functional>
+#include <future>
+#include <vector>
+#include <memory>
+
+#include "VertexLayout.hpp"
+#include "Meshlet.hpp"
+
+// Number of vertices and indices of a shape, known before generating it
+struct GeometrySize {
+	size_t vertexCount;
+	size_t indexCount;
+};
+
+// Caller-owned output of a generator: three floats per vertex for positions, colors and unit
+// normals, three indices per triangle. The arrays must hold the counts of the matching GeometrySize.
+struct GeometryView {
+	float * positions;
+	float * colors;
+	float * normals;
+	unsigned int * indices;
+};
+
+// Range of the index buffer drawn at one level of detail
+struct GeometryLevel {
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float maxScreenSize; // Largest projected diameter, as a fraction of the viewport height, the level is meant for
+};
+
+// Vertex and index data already in the GPU format of a layout, for instance mapped from a geometry
+// file. The storage keeps the memory alive as long as the data is in use.
+struct PackedGeometry {
+	std::shared_ptr<const void> storage;
+	const void * vertices = nullptr;
+	size_t vertexCount = 0;
+	const unsigned int * indices = nullptr;
+	size_t indexCount = 0;
+	glm::vec3 positionScale = glm::vec3 (1.f); // Dequantization the vertices were packed with
+	glm::vec3 positionOffset = glm::vec3 (0.f);
+};
+
+// Bytes uploaded as they are into one GL buffer, shared by every geometry reading from it (a glTF
+// buffer view, for instance). The GL buffer lives while a geometry on the GPU uses it.
+class GeometryBuffer {
+public:
+	GeometryBuffer (std::shared_ptr<const void> storage, const void * data, size_t size);
+
+	GLuint acquire (); // Uploads on the first call, returns the GL buffer
+	void release (); // Deletes the GL buffer once every acquire has been released
+	GLuint name () const;
+
+private:
+	std::shared_ptr<const void> storage; // Keeps data alive
+	const void * data;
+	size_t size;
+	GLuint buffer = 0;
+	size_t users = 0;
+};
+
+// Vertex attribute read in place from a GeometryBuffer, stride bytes from one vertex to the next
+struct BufferAttribute {
+	std::shared_ptr<GeometryBuffer> buffer;
+	VertexLayout::Attribute format; // The size is left unused
+	size_t offset;
+	GLsizei stride;
+};
+
+// Vertex and index data read in place, each attribute with its own buffer, offset, stride and
+// format (the accessors of a glTF primitive, for instance)
+struct BufferViews {
+	std::vector<BufferAttribute> attributes;
+	std::shared_ptr<GeometryBuffer> indexBuffer;
+	size_t indexOffset = 0; // In bytes
+	GLenum indexType = GL_UNSIGNED_INT;
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+};
+
+// Block of vertex and index data, together with the GPU buffers built from it.
+// A Geometry is shared by every Mesh instance drawn with the same shape, so it
+// must be treated as immutable once it has been handed out by the GeometryCache.
+class Geometry {
+public:
+	void initGPUGeometry (); // Counts one more user of the GPU buffers, uploading the CPU data for the first (not when streaming)
+	void render (); // Draws the finest level
+	void renderLevel (size_t level);
+	void renderInstanced (GLuint instanceVao, GLsizei instanceCount); // Draws instanceCount copies through a VAO set up with bindAttributes
+	void renderRanges (const GLsizei * counts, const void * const * offsets, GLsizei rangeCount); // Draws several ranges of the index buffer at once
+	void bindAttributes (GLuint targetVao) const; // Attaches the vertex streams and the index buffer to another VAO
+	void clear (); // Drops a user of the GPU buffers, releasing them after the last one
+
+	void allocate (const GeometrySize & size); // Sizes the CPU arrays once, normals included, before filling them through view ()
+	GeometryView view ();
+
+	// Copy of the data (CPU streams, packed data or buffer views, levels, meshlets), once buildAsync is
+	// done, without the GPU buffers: a geometry of its own for a Mesh about to change a shared one
+	std::shared_ptr<Geometry> copy ();
+
+	// Once buildAsync is done, decodes the packed data, if any, into the CPU streams and drops it, for
+	// the CPU passes. The layout stays, and quantized formats keep their loss.
+	void unpack ();
+
+	bool isOnGPU () const;
+	size_t gpuUpload () const; // Different each time the GPU buffers are created, 0 while there are none: VAOs bound to them elsewhere check it
+	size_t vertexCount () const;
+	GLsizei indexCount () const;
+	size_t gpuVertexBytes () const; // Size of the vertex buffer in the current layout
+	void packVertices (void * out, glm::vec3 & positionScale, glm::vec3 & positionOffset) const; // The gpuVertexBytes () of the vertex buffer, and their dequantization
+	size_t levelCount () const;
+	GeometryLevel level (size_t index) const; // The whole index buffer when there are no levels
+	void computeBounds (); // Bounding sphere of the vertices, for the level of detail selection
+
+	std::vector<float> vertexPositions;
+	std::vector<float> vertexColors;
+	std::vector<float> vertexNormals; // Optional: uploaded only when not empty and the layout has a normal attribute
+	std::vector<unsigned int> triangleIndices;
+
+	VertexLayout layout; // GPU storage format, to be chosen before initGPUGeometry
+
+	// Optional: data uploaded as is in place of the CPU streams, which then stay empty. The layout
+	// must be the one it was packed in. The CPU passes (optimization, simplification) unpack it first.
+	PackedGeometry packed;
+
+	// Optional: data read in place from shared buffers instead of the CPU streams and of packed, with
+	// the formats and strides of each attribute. The CPU passes do not apply either.
+	BufferViews views;
+
+	std::vector<GeometryLevel> levels; // Optional levels of detail sharing the buffers, finest first, each with its own vertices
+	glm::vec3 boundsCenter = glm::vec3 (0.f);
+	float boundsRadius = 0.f;
+
+	std::vector<Meshlet> meshlets; // Optional clusters of triangleIndices, for CPU culling, never straddling two levels
+
+	// Progressive upload, when not 0: initGPUGeometry does nothing, the first stream () creates the
+	// GPU buffers, empty, and each stream () then uploads at most streamBudget more bytes, coarsest
+	// level first. Until every level is there, draws fall back to the finest level complete so far.
+	// Buffer views are always uploaded at once.
+	size_t streamBudget = 0;
+	bool stream (); // Once per frame before drawing: false while no level can be drawn yet
+	size_t firstStreamedLevel () const; // Finest level complete on the GPU, levelCount () before the coarsest is
+
+	// Runs build on a background thread and returns at once. The geometry stays empty until stream ()
+	// (or initGPUGeometry, which waits) finds build done and takes over the data of the geometry it returned.
+	void buildAsync (const std::function<std::shared_ptr<Geometry> ()> & build);
+
+private:
+	VertexLayout effectiveLayout () const;
+	void setShaderUniforms () const;
+	void bindViews (GLuint targetVao) const;
+	GLenum indexType () const;
+	const void * indexOffset (size_t firstIndex) const; // In the index buffer, as glDrawElements takes it
+	void quantization (glm::vec3 & scale, glm::vec3 & offset) const; // Of the positions, in the current layout
+	bool finishBuild (bool wait); // Takes over the result of buildAsync, false if it is still running
+	void beginStreaming ();
+	void startStreamLevel ();
+	void streamVertices (size_t first, size_t count);
+
+	glm::vec3 positionScale = glm::vec3 (1.f); // Dequantization of the positions, for snorm16 layouts
+	glm::vec3 positionOffset = glm::vec3 (0.f);
+
+	GLuint vbo = 0; // Every attribute of the layout, interleaved or in consecutive blocks
+	GLuint ibo = 0;
+	GLuint vao = 0;
+	size_t gpuUsers = 0; // initGPUGeometry calls not yet matched by a clear, from the meshes sharing this geometry
+	size_t upload = 0; // gpuUpload
+
+	// State of the progressive upload
+	struct Streaming {
+		// buildAsync in progress, shared to keep Geometry copyable: its geometry, and whether the build
+		// thread took it out of the cache and quantized it
+		std::shared_ptr<std::future<std::pair<std::shared_ptr<Geometry>, bool>>> build;
+		bool quantized = false; // positionScale and positionOffset computed by the build thread
+		size_t levelCount = 0; // Complete on the GPU, counted from the coarsest
+		bool levelStarted = false;
+		std::vector<std::pair<size_t, size_t>> uploaded; // Vertex ranges on the GPU, sorted and disjoint
+		std::vector<std::pair<size_t, size_t>> vertexQueue; // Still to upload for the level in progress
+		size_t indexFirst = 0; // Its indices still to upload
+		size_t indexEnd = 0;
+		std::vector<unsigned char> scratch; // Packed vertices on their way to the GPU
+	} streaming;
+};
+
+#endif //_GEOMETRY_H
@@ -0,0 +1,64 @@
+#include "GeometryCache.hpp"
+
+std::map<GeometryCache::Key, std::weak_ptr<Geometry>> & GeometryCache::entries () {
+    static std::map<Key, std::weak_ptr<Geometry>> cache;
+    return cache;
+}
+
+std::mutex & GeometryCache::mutex () {
+    static std::mutex cacheMutex;
+    return cacheMutex;
+}
+
+std::shared_ptr<Geometry> GeometryCache::get (const Key & key, const std::function<void (Geometry &)> & build) {
+    {
+        std::lock_guard<std::mutex> lock (mutex ());
+        std::shared_ptr<Geometry> geometry = entries ()[key].lock ();
+        if (geometry)
+            return geometry;
+    }
+
+    // Built without the lock, so that a background build (Geometry::buildAsync) does not hold up the
+    // render thread; if two threads miss the same key at once, the first one to finish wins
+    std::shared_ptr<Geometry> built = std::make_shared<Geometry> ();
+    build (*built);
+    std::lock_guard<std::mutex> lock (mutex ());
+    std::weak_ptr<Geometry> & entry = entries ()[key];
+    std::shared_ptr<Geometry> geometry = entry.lock ();
+    if (!geometry) {
+        geometry = built;
+        entry = geometry;
+    }
+    return geometry;
+}
+
+size_t GeometryCache::size () {
+    std::lock_guard<std::mutex> lock (mutex ());
+    return entries ().size ();
+}
+
+void GeometryCache::purge () {
+    std::lock_guard<std::mutex> lock (mutex ());
+    std::map<Key, std::weak_ptr<Geometry>> & cache = entries ();
+    for (auto it = cache.begin (); it != cache.end ();) {
+        if (it->second.expired ())
+            it = cache.erase (it);
+        else
+            ++it;
+    }
+}
+
+// Under the lock, no other thread can get a new reference from the cache between the count and the erase
+bool GeometryCache::release (const std::shared_ptr<Geometry> & geometry) {
+    std::lock_guard<std::mutex> lock (mutex ());
+    if (geometry.use_count () > 1)
+        return false;
+    std::map<Key, std::weak_ptr<Geometry>> & cache = entries ();
+    for (auto it = cache.begin (); it != cache.end (); ++it) {
+        if (!it->second.owner_before (geometry) && !geometry.owner_before (it->second)) {
+            cache.erase (it);
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef _GEOMETRY_CACHE_H
+#define _GEOMETRY_CACHE_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+#include "Geometry.hpp"
+
+// Hands out one shared Geometry per (shape, resolution, parameters, levels) key, so that
+// repeated primitives cost a single CPU block and a single set of GPU buffers.
+// Entries are held weakly: a geometry is released once no Mesh references it.
+// The cache may be used from several threads at once.
+class GeometryCache {
+public:
+	enum Shape { Sphere, Cone, Cylinder, Cube, Torus, Icosphere };
+
+	struct Key {
+		Shape shape;
+		size_t resolution;
+		float param0;
+		float param1;
+		size_t levelCount = 1;
+
+		bool operator< (const Key & other) const {
+			return std::tie (shape, resolution, param0, param1, levelCount) < std::tie (other.shape, other.resolution, other.param0, other.param1, other.levelCount);
+		}
+	};
+
+	// Returns the cached geometry for key, calling build to create it on a miss
+	static std::shared_ptr<Geometry> get (const Key & key, const std::function<void (Geometry &)> & build);
+
+	static size_t size ();
+	static void purge (); // Drops the entries whose geometry has been released
+
+	// True when geometry is the only reference to it: its entry, if any, is then dropped, so that the
+	// caller may change the geometry and the next get for that key builds a new one
+	static bool release (const std::shared_ptr<Geometry> & geometry);
+
+private:
+	static std::map<Key, std::weak_ptr<Geometry>> & entries ();
+	static std::mutex & mutex ();
+};
+
+#endif //_GEOMETRY_CACHE_H
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "GeometryFile.hpp"
+#include "MappedFile.hpp"
+#include "MeshCodec.hpp"
+#include "ThreadPool.hpp"
+
+static const char magic[8] = { 'B', 'a', 's', 'e', 'G', 'L', 'G', 'e' };
+static const uint32_t version = 2;
+static const uint64_t blobAlignment = 4096; // Page size: each blob could be mapped on its own
+
+struct GeometryFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t levelSize; // sizeof (GeometryLevel) and sizeof (Meshlet) when written
+    uint32_t meshletSize;
+    uint8_t position; // VertexLayout
+    uint8_t color;
+    uint8_t normal;
+    uint8_t interleaved;
+    uint8_t compressed; // Vertex and index blobs as MeshCodec streams
+    uint8_t padding[7];
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t levelCount;
+    uint64_t meshletCount;
+    uint64_t vertexOffset; // From the start of the file, multiples of blobAlignment
+    uint64_t indexOffset;
+    uint64_t levelOffset;
+    uint64_t meshletOffset;
+    uint64_t vertexBytes; // Sizes of the vertex and index blobs as stored
+    uint64_t indexBytes;
+    float positionScale[3];
+    float positionOffset[3];
+    float boundsCenter[3];
+    float boundsRadius;
+};
+
+static uint64_t alignBlob (uint64_t offset) {
+    return (offset + blobAlignment - 1) / blobAlignment * blobAlignment;
+}
+
+// Whether length bytes at offset lie within a file of size bytes, written so that nothing can wrap
+// around, and start on a blob boundary as save writes them (the mapped blobs are then aligned)
+static bool withinFile (uint64_t offset, uint64_t length, uint64_t size) {
+    return offset % blobAlignment == 0 && offset <= size && length <= size - offset;
+}
+
+// Whether the counts of the header are possible in a file of size bytes: below 2^32, as the indices
+// are 32-bit, and no more elements than the stored bytes can hold (for a compressed blob, a group
+// of 16 vertices takes a byte at least, and a triangle a byte)
+static bool plausibleCounts (const GeometryFileHeader & header, uint64_t vertexSize, uint64_t size) {
+    if (header.vertexCount > UINT32_MAX || header.indexCount > UINT32_MAX || header.indexCount % 3 != 0
+        || header.levelCount > size / sizeof (GeometryLevel) || header.meshletCount > size / sizeof (Meshlet))
+        return false;
+    if (header.compressed)
+        return header.vertexCount <= 16 * header.vertexBytes && header.indexCount <= 3 * header.indexBytes;
+    return header.vertexCount <= size / vertexSize && header.indexCount <= size / sizeof (unsigned int);
+}
+
+// Whether every index is below vertexCount, checked on the thread pool
+static bool indicesInRange (const unsigned int * indices, size_t indexCount, size_t vertexCount) {
+    std::atomic<bool> valid (true);
+    ThreadPool::instance ().parallelFor (0, indexCount, [&] (size_t first, size_t last) {
+        if (*std::max_element (indices + first, indices + last) >= vertexCount)
+            valid = false;
+    });
+    return valid;
+}
+
+// Whether the ranges of the levels and meshlets lie within the indexCount indices
+template<typename Range>
+static bool rangesInRange (const std::vector<Range> & ranges, uint64_t indexCount) {
+    return std::all_of (ranges.begin (), ranges.end (), [=] (const Range & range) {
+        return uint64_t (range.firstIndex) + range.indexCount <= indexCount;
+    });
+}
+
+// The vertex buffer as codec streams, {offset, stride} each: the records of an interleaved layout,
+// or each attribute block
+static std::vector<std::pair<size_t, size_t>> vertexStreams (const VertexLayout & layout, size_t vertexCount) {
+    if (layout.interleaved)
+        return { { 0, layout.vertexSize () } };
+    std::vector<std::pair<size_t, size_t>> streams;
+    size_t offset = 0;
+    for (size_t i = 0; i < layout.attributeCount (); i++) {
+        size_t size = layout.attribute (i).size;
+        streams.push_back ({ offset, size });
+        offset += size * vertexCount;
+    }
+    return streams;
+}
+
+// The compressed vertex blob: each stream, after its size
+static std::vector<unsigned char> encodeVertices (const VertexLayout & layout, const void * vertices, size_t vertexCount) {
+    std::vector<unsigned char> blob;
+    for (const std::pair<size_t, size_t> & stream : vertexStreams (layout, vertexCount)) {
+        std::vector<unsigned char> encoded = MeshCodec::encodeVertices (static_cast<const unsigned char *> (vertices) + stream.first, vertexCount, stream.second);
+        if (encoded.empty ())
+            return encoded;
+        uint64_t size = encoded.size ();
+        blob.insert (blob.end (), reinterpret_cast<const unsigned char *> (&size), reinterpret_cast<const unsigned char *> (&size + 1));
+        blob.insert (blob.end (), encoded.begin (), encoded.end ());
+    }
+    return blob;
+}
+
+static bool decodeVertices (const VertexLayout & layout, const unsigned char * blob, uint64_t blobBytes, size_t vertexCount, unsigned char * out) {
+    for (const std::pair<size_t, size_t> & stream : vertexStreams (layout, vertexCount)) {
+        uint64_t size;
+        if (blobBytes < sizeof (size))
+            return false;
+        std::memcpy (&size, blob, sizeof (size));
+        blob += sizeof (size);
+        blobBytes -= sizeof (size);
+        if (size > blobBytes || !MeshCodec::decodeVertices (out + stream.first, vertexCount, stream.second, blob, size))
+            return false;
+        blob += size;
+        blobBytes -= size;
+    }
+    return blobBytes == 0;
+}
+
+// Decoded blobs of a compressed file, kept until the upload
+struct DecodedBlobs {
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned int> indices;
+};
+
+bool GeometryFile::save (const Geometry & geometry, const std::string & filename, bool compressed) {
+    if (geometry.views.indexBuffer) {
+        std::cerr << "ERROR: Cannot save " << filename << ": the geometry is read in place from buffer views" << std::endl;
+        return false;
+    }
+    GeometryFileHeader header = {};
+    std::memcpy (header.magic, magic, sizeof (magic));
+    header.version = version;
+    header.levelSize = sizeof (GeometryLevel);
+    header.meshletSize = sizeof (Meshlet);
+
+    // The vertices in the layout they will be drawn with, normals dropped if there are none
+    VertexLayout layout = geometry.layout;
+    if (geometry.vertexNormals.empty () && !geometry.packed.vertices)
+        layout.normal = VertexLayout::NormalNone;
+    header.position = layout.position;
+    header.color = layout.color;
+    header.normal = layout.normal;
+    header.interleaved = layout.interleaved;
+    header.compressed = compressed;
+
+    std::vector<unsigned char> packedVertices;
+    glm::vec3 positionScale, positionOffset;
+    const void * vertices = geometry.packed.vertices;
+    const unsigned int * indices = geometry.packed.vertices ? geometry.packed.indices : geometry.triangleIndices.data ();
+    if (vertices) {
+        positionScale = geometry.packed.positionScale;
+        positionOffset = geometry.packed.positionOffset;
+    } else {
+        packedVertices.resize (geometry.gpuVertexBytes ());
+        geometry.packVertices (packedVertices.data (), positionScale, positionOffset);
+        vertices = packedVertices.data ();
+    }
+    std::memcpy (header.positionScale, &positionScale[0], sizeof (header.positionScale));
+    std::memcpy (header.positionOffset, &positionOffset[0], sizeof (header.positionOffset));
+    std::memcpy (header.boundsCenter, &geometry.boundsCenter[0], sizeof (header.boundsCenter));
+    header.boundsRadius = geometry.boundsRadius;
+
+    header.vertexCount = geometry.vertexCount ();
+    header.indexCount = geometry.indexCount ();
+    header.levelCount = geometry.levels.size ();
+    header.meshletCount = geometry.meshlets.size ();
+    header.vertexBytes = geometry.gpuVertexBytes ();
+    header.indexBytes = sizeof (unsigned int) * header.indexCount;
+    std::vector<unsigned char> encodedVertices, encodedIndices;
+    if (compressed) {
+        encodedVertices = encodeVertices (layout, vertices, header.vertexCount);
+        encodedIndices = MeshCodec::encodeIndices (indices, header.indexCount);
+        if (encodedVertices.empty () || encodedIndices.empty ()) {
+            std::cerr << "ERROR: Cannot compress the geometry of " << filename << std::endl;
+            return false;
+        }
+        vertices = encodedVertices.data ();
+        header.vertexBytes = encodedVertices.size ();
+        indices = reinterpret_cast<const unsigned int *> (encodedIndices.data ());
+        header.indexBytes = encodedIndices.size ();
+    }
+    uint64_t levelBytes = sizeof (GeometryLevel) * header.levelCount;
+    uint64_t meshletBytes = sizeof (Meshlet) * header.meshletCount;
+    header.vertexOffset = alignBlob (sizeof (header));
+    header.indexOffset = alignBlob (header.vertexOffset + header.vertexBytes);
+    header.levelOffset = alignBlob (header.indexOffset + header.indexBytes);
+    header.meshletOffset = alignBlob (header.levelOffset + levelBytes);
+
+    std::ofstream file (filename.c_str (), std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "ERROR: Cannot write geometry file " << filename << std::endl;
+        return false;
+    }
+    uint64_t position = 0;
+    auto writeBlob = [&] (uint64_t offset, const void * data, uint64_t size) {
+        static const char padding[blobAlignment] = {};
+        file.write (padding, offset - position);
+        file.write (static_cast<const char *> (data), size);
+        position = offset + size;
+    };
+    writeBlob (0, &header, sizeof (header));
+    writeBlob (header.vertexOffset, vertices, header.vertexBytes);
+    writeBlob (header.indexOffset, indices, header.indexBytes);
+    writeBlob (header.levelOffset, geometry.levels.data (), levelBytes);
+    writeBlob (header.meshletOffset, geometry.meshlets.data (), meshletBytes);
+    if (!file) {
+        std::cerr << "ERROR: Failed writing geometry file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<Geometry> GeometryFile::load (const std::string & filename) {
+    size_t size = 0;
+    std::shared_ptr<const void> storage = MappedFile::map (filename, size);
+    if (!storage) {
+        std::cerr << "ERROR: Cannot map geometry file " << filename << std::endl;
+        return nullptr;
+    }
+    const unsigned char * base = static_cast<const unsigned char *> (storage.get ());
+    GeometryFileHeader header;
+    if (size < sizeof (header)) {
+        std::cerr << "ERROR: Truncated geometry file " << filename << std::endl;
+        return nullptr;
+    }
+    std::memcpy (&header, base, sizeof (header));
+    if (std::memcmp (header.magic, magic, sizeof (magic)) != 0 || header.version != version
+        || header.levelSize != sizeof (GeometryLevel) || header.meshletSize != sizeof (Meshlet)) {
+        std::cerr << "ERROR: " << filename << " is not a geometry file of this version" << std::endl;
+        return nullptr;
+    }
+
+    if (header.position > VertexLayout::PositionHalf || header.color > VertexLayout::ColorUnorm8
+        || header.normal > VertexLayout::NormalOctahedral16 || header.interleaved > 1 || header.compressed > 1) {
+        std::cerr << "ERROR: Corrupted geometry file " << filename << " (unknown vertex layout)" << std::endl;
+        return nullptr;
+    }
+    std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> ();
+    geometry->layout.position = VertexLayout::PositionFormat (header.position);
+    geometry->layout.color = VertexLayout::ColorFormat (header.color);
+    geometry->layout.normal = VertexLayout::NormalFormat (header.normal);
+    geometry->layout.interleaved = header.interleaved != 0;
+
+    // Every product below is bounded by the file size once the counts are known to be plausible
+    if (!withinFile (header.vertexOffset, header.vertexBytes, size) || !withinFile (header.indexOffset, header.indexBytes, size)
+        || !plausibleCounts (header, geometry->layout.vertexSize (), size)) {
+        std::cerr << "ERROR: Truncated geometry file " << filename << std::endl;
+        return nullptr;
+    }
+    uint64_t vertexBytes = geometry->layout.vertexSize () * header.vertexCount;
+    uint64_t indexBytes = sizeof (unsigned int) * header.indexCount;
+    uint64_t levelBytes = sizeof (GeometryLevel) * header.levelCount;
+    uint64_t meshletBytes = sizeof (Meshlet) * header.meshletCount;
+    if ((!header.compressed && (header.vertexBytes != vertexBytes || header.indexBytes != indexBytes))
+        || !withinFile (header.levelOffset, levelBytes, size) || !withinFile (header.meshletOffset, meshletBytes, size)) {
+        std::cerr << "ERROR: Truncated geometry file " << filename << std::endl;
+        return nullptr;
+    }
+
+    PackedGeometry & packed = geometry->packed;
+    packed.vertexCount = header.vertexCount;
+    packed.indexCount = header.indexCount;
+    if (header.compressed) {
+        std::shared_ptr<DecodedBlobs> decoded = std::make_shared<DecodedBlobs> ();
+        decoded->vertices.resize (vertexBytes);
+        decoded->indices.resize (header.indexCount);
+        if (!decodeVertices (geometry->layout, base + header.vertexOffset, header.vertexBytes, header.vertexCount, decoded->vertices.data ())
+            || !MeshCodec::decodeIndices (decoded->indices.data (), header.indexCount, base + header.indexOffset, header.indexBytes)) {
+            std::cerr << "ERROR: Corrupted geometry file " << filename << std::endl;
+            return nullptr;
+        }
+        packed.storage = decoded;
+        packed.vertices = decoded->vertices.data ();
+        packed.indices = decoded->indices.data ();
+    } else {
+        packed.storage = storage;
+        packed.vertices = base + header.vertexOffset;
+        packed.indices = reinterpret_cast<const unsigned int *> (base + header.indexOffset);
+    }
+    packed.positionScale = glm::vec3 (header.positionScale[0], header.positionScale[1], header.positionScale[2]);
+    packed.positionOffset = glm::vec3 (header.positionOffset[0], header.positionOffset[1], header.positionOffset[2]);
+
+    // The small tables are copied: they are used on the CPU at every frame
+    const GeometryLevel * levels = reinterpret_cast<const GeometryLevel *> (base + header.levelOffset);
+    geometry->levels.assign (levels, levels + header.levelCount);
+    const Meshlet * meshlets = reinterpret_cast<const Meshlet *> (base + header.meshletOffset);
+    geometry->meshlets.assign (meshlets, meshlets + header.meshletCount);
+    if (!rangesInRange (geometry->levels, header.indexCount) || !rangesInRange (geometry->meshlets, header.indexCount)
+        || !indicesInRange (packed.indices, header.indexCount, header.vertexCount)) {
+        std::cerr << "ERROR: Corrupted geometry file " << filename << " (indices out of range)" << std::endl;
+        return nullptr;
+    }
+    geometry->boundsCenter = glm::vec3 (header.boundsCenter[0], header.boundsCenter[1], header.boundsCenter[2]);
+    geometry->boundsRadius = header.boundsRadius;
+    return geometry;
+}
@@ -0,0 +1,27 @@
+#ifndef _GEOMETRY_FILE_H
+#define _GEOMETRY_FILE_H
+
+#include <memory>
+#include <string>
+
+#include "Geometry.hpp"
+
+// Binary cache of a Geometry in its GPU format: a header, then the packed vertex blob, the index
+// blob, the levels and the meshlets, each starting on a page boundary. Loading maps the file and
+// hands the blobs to initGPUGeometry as they are, so a load costs the disk reads and a check of the
+// indices.
+// Files are written in the byte order and structure layout of the machine: they are a cache, and a
+// file written elsewhere or by another version is rejected, to be regenerated.
+//
+// A compressed file stores the vertex and index blobs as MeshCodec streams instead: three to five
+// times smaller with a quantized layout, decoded on the thread pool at load time faster than the
+// raw blobs would be read from disk, at the cost of a copy in memory until the upload.
+class GeometryFile {
+public:
+	static bool save (const Geometry & geometry, const std::string & filename, bool compressed = false);
+
+	// Returns nullptr, after printing why, if the file is missing or not a valid geometry file
+	static std::shared_ptr<Geometry> load (const std::string & filename);
+};
+
+#endif //_GEOMETRY_FILE_H
@@ -0,0 +1,606 @@
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+#include "GltfLoader.hpp"
+#include "MappedFile.hpp"
+
+static const uint32_t glbMagic = 0x46546C67; // "glTF"
+static const uint32_t jsonChunk = 0x4E4F534A; // "JSON"
+static const uint32_t binaryChunk = 0x004E4942; // "BIN\0"
+static const size_t maxJsonDepth = 256;
+static const size_t maxNodeDepth = 256;
+
+/*
+ * JSON: just what the glTF document needs
+ */
+
+struct JsonValue {
+    enum Type { Null, Bool, Number, String, Array, Object };
+    Type type = Null;
+    double number = 0.;
+    std::string string;
+    std::vector<JsonValue> items; // Array elements, or object values
+    std::vector<std::string> keys; // Object keys, matching items
+
+    // The member or element, a null value if there is none
+    const JsonValue & operator[] (const char * key) const {
+        for (size_t i = 0; i < keys.size (); i++)
+            if (keys[i] == key)
+                return items[i];
+        return null ();
+    }
+    const JsonValue & operator[] (size_t index) const {
+        return type == Array && index < items.size () ? items[index] : null ();
+    }
+    size_t size () const {
+        return type == Array ? items.size () : 0;
+    }
+    bool isNull () const {
+        return type == Null;
+    }
+    double numberOr (double fallback) const {
+        return type == Number ? number : fallback;
+    }
+    // Index into another array of the document, or -1
+    long index () const {
+        return type == Number && number >= 0. && number == std::floor (number) ? static_cast<long> (number) : -1;
+    }
+
+    static const JsonValue & null () {
+        static const JsonValue value;
+        return value;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser (const char * begin, const char * end) : p (begin), end (end) {}
+
+    bool parse (JsonValue & value) {
+        if (!parseValue (value, 0))
+            return false;
+        skipSpaces ();
+        return p == end;
+    }
+
+private:
+    void skipSpaces () {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    bool parseValue (JsonValue & value, size_t depth) {
+        skipSpaces ();
+        if (p == end || depth > maxJsonDepth)
+            return false;
+        switch (*p) {
+        case '{': {
+            value.type = JsonValue::Object;
+            p++;
+            skipSpaces ();
+            if (p < end && *p == '}') {
+                p++;
+                return true;
+            }
+            while (true) {
+                skipSpaces ();
+                value.keys.emplace_back ();
+                value.items.emplace_back ();
+                if (!parseString (value.keys.back ()))
+                    return false;
+                skipSpaces ();
+                if (p == end || *p++ != ':' || !parseValue (value.items.back (), depth + 1))
+                    return false;
+                skipSpaces ();
+                if (p == end || *p != ',')
+                    return p < end && *p++ == '}';
+                p++;
+            }
+        }
+        case '[': {
+            value.type = JsonValue::Array;
+            p++;
+            skipSpaces ();
+            if (p < end && *p == ']') {
+                p++;
+                return true;
+            }
+            while (true) {
+                value.items.emplace_back ();
+                if (!parseValue (value.items.back (), depth + 1))
+                    return false;
+                skipSpaces ();
+                if (p == end || *p != ',')
+                    return p < end && *p++ == ']';
+                p++;
+            }
+        }
+        case '"':
+            value.type = JsonValue::String;
+            return parseString (value.string);
+        case 't':
+        case 'f':
+        case 'n': {
+            static const char * const words[] = { "true", "false", "null" };
+            for (const char * word : words) {
+                size_t length = std::strlen (word);
+                if (static_cast<size_t> (end - p) >= length && std::memcmp (p, word, length) == 0) {
+                    value.type = word[0] == 'n' ? JsonValue::Null : JsonValue::Bool;
+                    value.number = word[0] == 't' ? 1. : 0.;
+                    p += length;
+                    return true;
+                }
+            }
+            return false;
+        }
+        default: {
+            // Numbers are short: copied to be terminated for strtod
+            const char * start = p;
+            while (p < end && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+                p++;
+            std::string text (start, p);
+            char * parsed = nullptr;
+            value.type = JsonValue::Number;
+            value.number = std::strtod (text.c_str (), &parsed);
+            return !text.empty () && parsed == text.c_str () + text.size ();
+        }
+        }
+    }
+
+    bool parseString (std::string & out) {
+        if (p == end || *p++ != '"')
+            return false;
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                out += *p++;
+                continue;
+            }
+            if (++p == end)
+                return false;
+            char escaped = *p++;
+            switch (escaped) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                if (end - p < 4)
+                    return false;
+                unsigned long code = std::strtoul (std::string (p, p + 4).c_str (), nullptr, 16);
+                p += 4;
+                // UTF-8, surrogate pairs left as they are: names are only compared, never shown
+                if (code < 0x80) {
+                    out += static_cast<char> (code);
+                } else if (code < 0x800) {
+                    out += static_cast<char> (0xC0 | (code >> 6));
+                    out += static_cast<char> (0x80 | (code & 0x3F));
+                } else {
+                    out += static_cast<char> (0xE0 | (code >> 12));
+                    out += static_cast<char> (0x80 | ((code >> 6) & 0x3F));
+                    out += static_cast<char> (0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default: out += escaped; break; // Quote, backslash and slash
+            }
+        }
+        return p < end && *p++ == '"';
+    }
+
+    const char * p;
+    const char * end;
+};
+
+/*
+ * Document
+ */
+
+// Bytes of a glTF buffer, in the .glb or in a file of its own
+struct GltfBuffer {
+    std::shared_ptr<const void> storage;
+    const unsigned char * data = nullptr;
+    size_t size = 0;
+};
+
+struct GltfView {
+    size_t buffer;
+    size_t offset;
+    size_t size;
+    size_t stride; // 0 when tightly packed
+    std::shared_ptr<GeometryBuffer> geometryBuffer; // Created on first use
+};
+
+// Accessor resolved against its view: the format of an attribute, and where its elements are
+struct GltfAccessor {
+    size_t view;
+    size_t offset; // In the view
+    size_t count;
+    GLenum componentType;
+    GLint components;
+    GLboolean normalized;
+    size_t elementSize;
+    size_t stride;
+    glm::vec3 min, max;
+    bool bounds; // min and max were given
+};
+
+class GltfDocument {
+public:
+    bool load (const std::string & filename);
+    std::vector<std::shared_ptr<Mesh>> instantiate ();
+
+private:
+    bool fail (const std::string & message);
+    bool resolveAccessor (const JsonValue & index, GltfAccessor & accessor);
+    std::shared_ptr<GeometryBuffer> viewBuffer (size_t view);
+    std::shared_ptr<Geometry> primitiveGeometry (const JsonValue & primitive);
+    bool checkNodeGraph ();
+    void addNode (long node, const glm::mat4 & parentMatrix, size_t depth, std::vector<std::shared_ptr<Mesh>> & meshes);
+
+    std::string filename;
+    JsonValue root;
+    std::vector<GltfBuffer> buffers;
+    std::vector<GltfView> views;
+    std::map<std::pair<long, size_t>, std::shared_ptr<Geometry>> geometries; // Per mesh and primitive
+    bool scaleWarned = false;
+};
+
+bool GltfDocument::fail (const std::string & message) {
+    std::cerr << "ERROR: " << filename << ": " << message << std::endl;
+    return false;
+}
+
+template<typename T>
+static T readAs (const unsigned char * p) {
+    T value;
+    std::memcpy (&value, p, sizeof (T));
+    return value;
+}
+
+bool GltfDocument::load (const std::string & path) {
+    filename = path;
+    size_t size = 0;
+    std::shared_ptr<const void> mapping = MappedFile::map (filename, size);
+    if (!mapping) {
+        std::cerr << "ERROR: Cannot map glTF file " << filename << std::endl;
+        return false;
+    }
+    const unsigned char * base = static_cast<const unsigned char *> (mapping.get ());
+    if (size < 20 || readAs<uint32_t> (base) != glbMagic || readAs<uint32_t> (base + 4) != 2)
+        return fail ("not a binary glTF 2.0 file");
+    if (readAs<uint32_t> (base + 8) > size)
+        return fail ("truncated file");
+
+    // Chunks: the JSON document, then optionally the binary buffer
+    const unsigned char * binary = nullptr;
+    size_t binarySize = 0, length = readAs<uint32_t> (base + 8);
+    bool json = false;
+    for (size_t offset = 12; offset + 8 <= length; ) {
+        size_t chunkSize = readAs<uint32_t> (base + offset);
+        uint32_t chunkType = readAs<uint32_t> (base + offset + 4);
+        const unsigned char * chunk = base + offset + 8;
+        if (chunkSize > length - offset - 8)
+            return fail ("truncated chunk");
+        if (!json && chunkType != jsonChunk)
+            return fail ("the first chunk is not JSON");
+        if (!json) {
+            const char * text = reinterpret_cast<const char *> (chunk);
+            if (!JsonParser (text, text + chunkSize).parse (root) || root.type != JsonValue::Object)
+                return fail ("malformed JSON");
+            json = true;
+        } else if (chunkType == binaryChunk && !binary) {
+            binary = chunk;
+            binarySize = chunkSize;
+        }
+        offset += 8 + (chunkSize + 3) / 4 * 4;
+    }
+    if (!json)
+        return fail ("no JSON chunk");
+    if (root["extensionsRequired"].size () > 0)
+        return fail ("requires the extension " + root["extensionsRequired"][size_t (0)].string);
+
+    // Buffers: the binary chunk, or files named relative to the .glb
+    std::string directory = filename.substr (0, filename.find_last_of ("/\\") + 1);
+    const JsonValue & bufferList = root["buffers"];
+    for (size_t b = 0; b < bufferList.size (); b++) {
+        const JsonValue & uri = bufferList[b]["uri"];
+        GltfBuffer buffer;
+        if (uri.isNull ()) {
+            if (b != 0 || !binary)
+                return fail ("buffer without uri or binary chunk");
+            buffer.storage = mapping;
+            buffer.data = binary;
+            buffer.size = binarySize;
+        } else if (uri.string.compare (0, 5, "data:") == 0) {
+            return fail ("embedded base64 buffers are not supported");
+        } else {
+            buffer.storage = MappedFile::map (directory + uri.string, buffer.size);
+            if (!buffer.storage)
+                return fail ("cannot map buffer " + uri.string);
+            buffer.data = static_cast<const unsigned char *> (buffer.storage.get ());
+        }
+        if (bufferList[b]["byteLength"].numberOr (0.) > buffer.size)
+            return fail ("buffer shorter than its byteLength");
+        buffers.push_back (buffer);
+    }
+
+    const JsonValue & viewList = root["bufferViews"];
+    for (size_t v = 0; v < viewList.size (); v++) {
+        const JsonValue & view = viewList[v];
+        long buffer = view["buffer"].index ();
+        GltfView resolved;
+        resolved.offset = static_cast<size_t> (view["byteOffset"].numberOr (0.));
+        resolved.size = static_cast<size_t> (view["byteLength"].numberOr (0.));
+        resolved.stride = static_cast<size_t> (view["byteStride"].numberOr (0.));
+        if (buffer < 0 || static_cast<size_t> (buffer) >= buffers.size ()
+            || resolved.offset > buffers[buffer].size || resolved.size > buffers[buffer].size - resolved.offset)
+            return fail ("buffer view " + std::to_string (v) + " outside of its buffer");
+        resolved.buffer = buffer;
+        views.push_back (resolved);
+    }
+    return true;
+}
+
+bool GltfDocument::resolveAccessor (const JsonValue & index, GltfAccessor & accessor) {
+    const JsonValue & a = root["accessors"][index.index () < 0 ? ~size_t (0) : static_cast<size_t> (index.index ())];
+    long view = a["bufferView"].index ();
+    if (a.isNull () || view < 0 || static_cast<size_t> (view) >= views.size () || !a["sparse"].isNull ())
+        return false; // Missing, or sparse or without view: they would need the data to be built on the CPU
+    static const char * const types[] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+    accessor.components = 0;
+    for (int t = 0; t < 4; t++)
+        if (a["type"].string == types[t])
+            accessor.components = t + 1;
+    accessor.componentType = static_cast<GLenum> (a["componentType"].numberOr (0.));
+    size_t componentSize = 0;
+    switch (accessor.componentType) {
+    case GL_BYTE: case GL_UNSIGNED_BYTE: componentSize = 1; break;
+    case GL_SHORT: case GL_UNSIGNED_SHORT: componentSize = 2; break;
+    case GL_UNSIGNED_INT: case GL_FLOAT: componentSize = 4; break;
+    }
+    if (accessor.components == 0 || componentSize == 0)
+        return false;
+    accessor.view = view;
+    accessor.offset = static_cast<size_t> (a["byteOffset"].numberOr (0.));
+    accessor.count = static_cast<size_t> (a["count"].numberOr (0.));
+    accessor.normalized = a["normalized"].number != 0. ? GL_TRUE : GL_FALSE;
+    accessor.elementSize = componentSize * accessor.components;
+    accessor.stride = views[view].stride ? views[view].stride : accessor.elementSize;
+    accessor.bounds = a["min"].size () >= 3 && a["max"].size () >= 3;
+    for (int k = 0; k < 3 && accessor.bounds; k++) {
+        accessor.min[k] = static_cast<float> (a["min"][k].number);
+        accessor.max[k] = static_cast<float> (a["max"][k].number);
+    }
+    // Every element inside the view
+    const GltfView & v = views[view];
+    return accessor.count > 0 && accessor.offset <= v.size && accessor.elementSize <= v.size - accessor.offset
+        && (accessor.count - 1) <= (v.size - accessor.offset - accessor.elementSize) / accessor.stride;
+}
+
+std::shared_ptr<GeometryBuffer> GltfDocument::viewBuffer (size_t view) {
+    GltfView & v = views[view];
+    if (!v.geometryBuffer) {
+        const GltfBuffer & buffer = buffers[v.buffer];
+        v.geometryBuffer = std::make_shared<GeometryBuffer> (buffer.storage, buffer.data + v.offset, v.size);
+    }
+    return v.geometryBuffer;
+}
+
+// Geometry reading the accessors of a triangle primitive in place, or nullptr if it has none usable
+std::shared_ptr<Geometry> GltfDocument::primitiveGeometry (const JsonValue & primitive) {
+    if (primitive["mode"].numberOr (GL_TRIANGLES) != GL_TRIANGLES) {
+        std::cerr << "WARNING: " << filename << ": skipped a primitive that is not made of triangles" << std::endl;
+        return nullptr;
+    }
+    const JsonValue & attributes = primitive["attributes"];
+    GltfAccessor position;
+    if (!resolveAccessor (attributes["POSITION"], position) || position.componentType != GL_FLOAT || position.components != 3) {
+        fail ("primitive without float POSITION in a buffer view");
+        return nullptr;
+    }
+
+    std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> ();
+    BufferViews & out = geometry->views;
+    out.vertexCount = position.count;
+    auto addAttribute = [&] (const GltfAccessor & accessor, GLuint location) {
+        out.attributes.push_back ({ viewBuffer (accessor.view), { location, accessor.components, accessor.componentType, accessor.normalized, 0 },
+                                    accessor.offset, static_cast<GLsizei> (accessor.stride) });
+    };
+    addAttribute (position, 0);
+
+    GltfAccessor color, normal;
+    if (resolveAccessor (attributes["COLOR_0"], color) && color.count == position.count && color.components >= 3
+        && (color.componentType == GL_FLOAT || color.normalized))
+        addAttribute (color, 1);
+    if (resolveAccessor (attributes["NORMAL"], normal) && normal.count == position.count && normal.componentType == GL_FLOAT && normal.components == 3)
+        addAttribute (normal, 2);
+
+    // Indices as they are, checked against the vertex count; a primitive without any gets 0, 1, 2, ...
+    const JsonValue & indices = primitive["indices"];
+    if (!indices.isNull ()) {
+        GltfAccessor index;
+        if (!resolveAccessor (indices, index) || index.components != 1 || index.stride != index.elementSize
+            || (index.componentType != GL_UNSIGNED_BYTE && index.componentType != GL_UNSIGNED_SHORT && index.componentType != GL_UNSIGNED_INT)) {
+            fail ("malformed indices");
+            return nullptr;
+        }
+        const unsigned char * data = buffers[views[index.view].buffer].data + views[index.view].offset + index.offset;
+        size_t maxIndex = 0;
+        for (size_t i = 0; i < index.count; i++) {
+            size_t value = index.elementSize == 1 ? data[i] : (index.elementSize == 2 ? readAs<uint16_t> (data + 2 * i) : readAs<uint32_t> (data + 4 * i));
+            maxIndex = std::max (maxIndex, value);
+        }
+        if (maxIndex >= position.count) {
+            fail ("index out of range");
+            return nullptr;
+        }
+        out.indexBuffer = viewBuffer (index.view);
+        out.indexOffset = index.offset;
+        out.indexType = index.componentType;
+        out.indexCount = index.count;
+    } else {
+        std::shared_ptr<std::vector<unsigned int>> sequence = std::make_shared<std::vector<unsigned int>> (position.count);
+        for (size_t i = 0; i < position.count; i++)
+            (*sequence)[i] = static_cast<unsigned int> (i);
+        out.indexBuffer = std::make_shared<GeometryBuffer> (sequence, sequence->data (), sizeof (unsigned int) * sequence->size ());
+        out.indexCount = position.count;
+    }
+
+    // Bounds from the accessor, which glTF requires for positions
+    glm::vec3 lo = position.min, hi = position.max;
+    if (!position.bounds) {
+        const unsigned char * data = buffers[views[position.view].buffer].data + views[position.view].offset + position.offset;
+        lo = hi = readAs<glm::vec3> (data);
+        for (size_t v = 1; v < position.count; v++) {
+            lo = glm::min (lo, readAs<glm::vec3> (data + v * position.stride));
+            hi = glm::max (hi, readAs<glm::vec3> (data + v * position.stride));
+        }
+    }
+    geometry->boundsCenter = 0.5f * (lo + hi);
+    geometry->boundsRadius = 0.5f * glm::length (hi - lo);
+    return geometry;
+}
+
+// Local matrix of a node, from its matrix or its translation, rotation and scale
+static glm::mat4 nodeMatrix (const JsonValue & node) {
+    const JsonValue & matrix = node["matrix"];
+    if (matrix.size () == 16) {
+        glm::mat4 m;
+        for (int i = 0; i < 16; i++)
+            m[i / 4][i % 4] = static_cast<float> (matrix[i].number); // Column-major, as in glm
+        return m;
+    }
+    const JsonValue & t = node["translation"], & r = node["rotation"], & s = node["scale"];
+    glm::vec3 translation (t[size_t (0)].numberOr (0.), t[1].numberOr (0.), t[2].numberOr (0.));
+    glm::quat rotation (static_cast<float> (r[3].numberOr (1.)), static_cast<float> (r[size_t (0)].numberOr (0.)),
+                        static_cast<float> (r[1].numberOr (0.)), static_cast<float> (r[2].numberOr (0.))); // w first in glm
+    glm::vec3 scale (s[size_t (0)].numberOr (1.), s[1].numberOr (1.), s[2].numberOr (1.));
+    glm::mat4 m = glm::mat4_cast (rotation);
+    m[0] *= scale.x;
+    m[1] *= scale.y;
+    m[2] *= scale.z;
+    m[3] = glm::vec4 (translation, 1.f);
+    return m;
+}
+
+// Transform (translation, then uniform scale, then rotations about x, y and z in degrees) closest to
+// m: the scale is the geometric mean of the scales of the axes. Sets exact to false if that loses
+// a non-uniform scale, a shear or a mirror.
+static Transform transformOf (const glm::mat4 & m, bool & exact) {
+    glm::vec3 axes[3] = { glm::vec3 (m[0]), glm::vec3 (m[1]), glm::vec3 (m[2]) };
+    glm::vec3 lengths (glm::length (axes[0]), glm::length (axes[1]), glm::length (axes[2]));
+    float determinant = glm::determinant (glm::mat3 (m));
+    float scale = std::cbrt (std::fabs (determinant));
+    exact = determinant > 0.f && glm::all (glm::lessThan (glm::abs (lengths - scale), glm::vec3 (1e-3f * scale)));
+    glm::mat3 r (1.f);
+    if (scale > 0.f)
+        r = glm::mat3 (axes[0] / lengths.x, axes[1] / lengths.y, axes[2] / lengths.z);
+
+    // r = Rx (a) Ry (b) Rz (c), whose third column is (sin b, -sin a cos b, cos a cos b)
+    float a, b = std::asin (glm::clamp (r[2][0], -1.f, 1.f)), c;
+    if (std::fabs (r[2][0]) < 0.9999f) {
+        a = std::atan2 (-r[2][1], r[2][2]);
+        c = std::atan2 (-r[1][0], r[0][0]);
+    } else { // Gimbal lock: only a + c or a - c is defined
+        a = std::atan2 (r[0][1], r[1][1]);
+        c = 0.f;
+    }
+    return Transform (glm::vec3 (m[3]), glm::degrees (a), glm::degrees (b), glm::degrees (c), scale);
+}
+
+// The nodes must form disjoint trees: no node with two parents, none reaching itself
+bool GltfDocument::checkNodeGraph () {
+    const JsonValue & nodes = root["nodes"];
+    std::vector<unsigned int> parents (nodes.size (), 0);
+    for (size_t n = 0; n < nodes.size (); n++)
+        for (size_t c = 0; c < nodes[n]["children"].size (); c++) {
+            long child = nodes[n]["children"][c].index ();
+            if (child >= 0 && static_cast<size_t> (child) < parents.size () && ++parents[child] > 1)
+                return fail ("cyclic node hierarchy");
+        }
+    // With at most one parent each, a node not reached from a root lies on or below a cycle
+    std::vector<bool> reached (nodes.size (), false);
+    std::vector<size_t> stack;
+    for (size_t n = 0; n < nodes.size (); n++)
+        if (parents[n] == 0)
+            stack.push_back (n);
+    while (!stack.empty ()) {
+        size_t n = stack.back ();
+        stack.pop_back ();
+        reached[n] = true;
+        for (size_t c = 0; c < nodes[n]["children"].size (); c++) {
+            long child = nodes[n]["children"][c].index ();
+            if (child >= 0 && static_cast<size_t> (child) < reached.size ())
+                stack.push_back (static_cast<size_t> (child));
+        }
+    }
+    for (size_t n = 0; n < reached.size (); n++)
+        if (!reached[n])
+            return fail ("cyclic node hierarchy");
+    return true;
+}
+
+void GltfDocument::addNode (long index, const glm::mat4 & parentMatrix, size_t depth, std::vector<std::shared_ptr<Mesh>> & meshes) {
+    const JsonValue & node = root["nodes"][index < 0 ? ~size_t (0) : static_cast<size_t> (index)];
+    if (node.isNull () || depth > maxNodeDepth)
+        return;
+    glm::mat4 matrix = parentMatrix * nodeMatrix (node);
+
+    long mesh = node["mesh"].index ();
+    const JsonValue & primitives = root["meshes"][mesh < 0 ? ~size_t (0) : static_cast<size_t> (mesh)]["primitives"];
+    for (size_t p = 0; p < primitives.size (); p++) {
+        std::shared_ptr<Geometry> & geometry = geometries[std::make_pair (mesh, p)];
+        if (!geometry)
+            geometry = primitiveGeometry (primitives[p]);
+        if (!geometry)
+            continue;
+        bool exact;
+        std::shared_ptr<Mesh> instance = std::make_shared<Mesh> (geometry);
+        static_cast<Transform &> (*instance) = transformOf (matrix, exact);
+        if (!exact && !scaleWarned) {
+            std::cerr << "WARNING: " << filename << ": non-uniform scales, shears and mirrors are approximated" << std::endl;
+            scaleWarned = true;
+        }
+        meshes.push_back (instance);
+    }
+
+    const JsonValue & children = node["children"];
+    for (size_t c = 0; c < children.size (); c++)
+        addNode (children[c].index (), matrix, depth + 1, meshes);
+}
+
+std::vector<std::shared_ptr<Mesh>> GltfDocument::instantiate () {
+    std::vector<std::shared_ptr<Mesh>> meshes;
+    if (!checkNodeGraph ())
+        return {};
+    const JsonValue & scene = root["scenes"][static_cast<size_t> (std::max (0L, root["scene"].index ()))];
+    if (!scene.isNull ()) {
+        for (size_t n = 0; n < scene["nodes"].size (); n++)
+            addNode (scene["nodes"][n].index (), glm::mat4 (1.f), 0, meshes);
+        return meshes;
+    }
+    // No scene: every root node
+    std::vector<bool> isChild (root["nodes"].size (), false);
+    for (size_t n = 0; n < isChild.size (); n++)
+        for (size_t c = 0; c < root["nodes"][n]["children"].size (); c++)
+            if (root["nodes"][n]["children"][c].index () >= 0 && static_cast<size_t> (root["nodes"][n]["children"][c].index ()) < isChild.size ())
+                isChild[root["nodes"][n]["children"][c].index ()] = true;
+    for (size_t n = 0; n < isChild.size (); n++)
+        if (!isChild[n])
+            addNode (n, glm::mat4 (1.f), 0, meshes);
+    return meshes;
+}
+
+std::vector<std::shared_ptr<Mesh>> GltfLoader::load (const std::string & filename) {
+    GltfDocument document;
+    if (!document.load (filename))
+        return {};
+    return document.instantiate ();
+}
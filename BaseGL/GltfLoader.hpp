@@ -0,0 +1,25 @@
+#ifndef _GLTF_LOADER_H
+#define _GLTF_LOADER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Mesh.hpp"
+
+// Binary glTF 2.0 (.glb) reader. The file is mapped once; every buffer view used by a primitive
+// becomes one shared GeometryBuffer, uploaded as it is, and the accessors become the attribute
+// bindings of the geometries (Geometry::views), offsets and strides included: nothing is copied or
+// repacked on the CPU. Reads the triangle primitives with their POSITION, NORMAL and COLOR_0
+// attributes; a primitive without indices gets sequential ones. Buffers may also be external files
+// next to the .glb. Files requiring extensions (compressed meshes, ...) are rejected.
+class GltfLoader {
+public:
+	// One Mesh per primitive of every node of the default scene, its Transform set from the world
+	// matrix of the node, the primitives of a mesh used by several nodes sharing their geometry.
+	// Transform has a uniform scale and no mirror: other scales are approximated, with a warning.
+	// Returns an empty list, after printing why, if the file is missing or malformed.
+	static std::vector<std::shared_ptr<Mesh>> load (const std::string & filename);
+};
+
+#endif //_GLTF_LOADER_H
@@ -0,0 +1,93 @@
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include <algorithm>
+
+#include "InstancedMesh.hpp"
+
+static const GLuint instanceBinding = 2; // Binding points 0 and 1 are used by the geometry streams
+static const GLuint instanceFirstLocation = 4;
+
+InstancedMesh::InstancedMesh (std::shared_ptr<Geometry> geometry) : geometry (geometry) {}
+
+size_t InstancedMesh::addInstance (const Transform & transform) {
+    instances.push_back (transform);
+    dirty = true;
+    return instances.size () - 1;
+}
+
+Transform & InstancedMesh::getInstance (size_t index) {
+    dirty = true;
+    return instances[index];
+}
+
+size_t InstancedMesh::instanceCount () const {
+    return instances.size ();
+}
+
+std::shared_ptr<Geometry> InstancedMesh::getGeometry () const {
+    return geometry;
+}
+
+void InstancedMesh::init () {
+    geometry->initGPUGeometry ();
+
+    glCreateVertexArrays (1, &vao);
+    boundUpload = geometry->gpuUpload ();
+    if (boundUpload != 0)
+        geometry->bindAttributes (vao);
+
+    // Two mat4 per instance, each spread over four vec4 attributes advancing once per instance
+    for (GLuint column = 0; column < 8; column++) {
+        GLuint location = instanceFirstLocation + column;
+        glVertexArrayAttribFormat (vao, location, 4, GL_FLOAT, GL_FALSE, column * sizeof (glm::vec4));
+        glVertexArrayAttribBinding (vao, location, instanceBinding);
+        glEnableVertexArrayAttrib (vao, location);
+    }
+    glVertexArrayBindingDivisor (vao, instanceBinding, 1);
+
+    updateInstanceBuffer ();
+}
+
+void InstancedMesh::updateInstanceBuffer () {
+    instanceMatrices.resize (2 * instances.size ());
+    for (size_t i = 0; i < instances.size (); i++) {
+        glm::mat4 modelMatrix = instances[i].computeTransformationMatrix ();
+        instanceMatrices[2*i] = modelMatrix;
+        instanceMatrices[2*i+1] = glm::transpose (glm::inverse (modelMatrix));
+    }
+
+    size_t bufferSize = sizeof (glm::mat4) * instanceMatrices.size ();
+    if (instances.size () > instanceCapacity) {
+        // Buffer storage is immutable: grow it by reallocating, doubling to amortize repeated additions
+        glDeleteBuffers (1, &instanceVbo);
+        instanceCapacity = std::max (instances.size (), 2 * instanceCapacity);
+        glCreateBuffers (1, &instanceVbo);
+        glNamedBufferStorage (instanceVbo, 2 * sizeof (glm::mat4) * instanceCapacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+        glVertexArrayVertexBuffer (vao, instanceBinding, instanceVbo, 0, 2 * sizeof (glm::mat4));
+    }
+    if (bufferSize > 0)
+        glNamedBufferSubData (instanceVbo, 0, bufferSize, instanceMatrices.data ());
+    dirty = false;
+}
+
+void InstancedMesh::render () {
+    if (dirty)
+        updateInstanceBuffer (); // Static instances cost no CPU work per frame
+    if (instances.empty () || !geometry->stream ())
+        return;
+    if (boundUpload != geometry->gpuUpload ()) {
+        geometry->bindAttributes (vao);
+        boundUpload = geometry->gpuUpload ();
+    }
+    geometry->renderInstanced (vao, static_cast<GLsizei> (instances.size ()));
+}
+
+void InstancedMesh::clear () {
+    glDeleteVertexArrays (1, &vao);
+    glDeleteBuffers (1, &instanceVbo);
+    vao = instanceVbo = 0;
+    instanceCapacity = 0;
+    boundUpload = 0;
+    geometry->clear ();
+}
@@ -0,0 +1,45 @@
+#ifndef _INSTANCED_MESH_H
+#define _INSTANCED_MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <memory>
+
+#include "Transform.hpp"
+#include "Geometry.hpp"
+
+// Draws many copies of one Geometry with a single glDrawElementsInstanced call.
+// Each copy has its own Transform; their model matrices live in a GPU buffer
+// read per instance by the vertex shader (attribute locations 4 to 11).
+class InstancedMesh {
+public:
+
+	InstancedMesh (std::shared_ptr<Geometry> geometry);
+
+	size_t addInstance (const Transform & transform = Transform ());
+	Transform & getInstance (size_t index); // Marks the instance buffer for re-upload
+	size_t instanceCount () const;
+
+	std::shared_ptr<Geometry> getGeometry () const;
+
+	void init ();
+	void render ();
+	void clear ();
+
+private:
+
+	void updateInstanceBuffer ();
+
+	std::shared_ptr<Geometry> geometry;
+	std::vector<Transform> instances;
+	std::vector<glm::mat4> instanceMatrices; // Model matrix followed by its inverse transpose, per instance
+	bool dirty = true;
+
+	GLuint instanceVbo = 0;
+	GLuint vao = 0;
+	size_t boundUpload = 0; // Geometry::gpuUpload of the buffers bound to vao, rebound whenever the geometry is uploaded anew
+	size_t instanceCapacity = 0;
+};
+
+#endif //_INSTANCED_MESH_H
@@ -0,0 +1,488 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Isosurface.hpp"
+#include "ThreadPool.hpp"
+
+static const size_t noLayer = ~size_t (0);
+static const float edgeMargin = 1e-3f; // Of the edge length, between a vertex and the samples of its edge
+
+/*
+ * Case table
+ */
+
+// Corner k of a cell is at (k & 1, (k >> 1) & 1, k >> 2) from its first sample, and bit k of the
+// case of the cell is set when corner k is inside. The table is derived from the faces of the cell
+// rather than typed in: on each face, a contour segment cuts off every run of inside corners, with
+// them on its left seen from outside the cell. The segments of the six faces chain into closed
+// loops, each fanned into triangles.
+struct MarchingCubesTable {
+    static const size_t maxTriangles = 5;
+
+    unsigned char corners[12][2]; // Of each edge, lowest first: edges 4a to 4a+3 run along axis a
+    unsigned char triangleCount[256];
+    unsigned char edges[256][3 * maxTriangles];
+
+    MarchingCubesTable () {
+        size_t count = 0;
+        for (unsigned int axis = 0; axis < 3; axis++) {
+            for (unsigned int c = 0; c < 8; c++) {
+                if (!(c & (1u << axis))) {
+                    corners[count][0] = c;
+                    corners[count][1] = c | (1u << axis);
+                    count++;
+                }
+            }
+        }
+        for (unsigned int cell = 0; cell < 256; cell++)
+            build (cell);
+    }
+
+    unsigned int edge (unsigned int a, unsigned int b) const {
+        unsigned int e = 0;
+        while (!(corners[e][0] == std::min (a, b) && corners[e][1] == std::max (a, b)))
+            e++;
+        return e;
+    }
+
+    // True when the edges a and b lie on the same face of the cell
+    bool shareFace (unsigned int a, unsigned int b) const {
+        for (unsigned int axis = 0; axis < 3; axis++) {
+            unsigned int bit = 1u << axis;
+            if (a / 4 != axis && b / 4 != axis && (corners[a][0] & bit) == (corners[b][0] & bit))
+                return true;
+        }
+        return false;
+    }
+
+    bool diagonalsInside (const unsigned char * loop, size_t length, size_t apex) const {
+        for (size_t i = 2; i + 1 < length; i++)
+            if (shareFace (loop[apex], loop[(apex + i) % length]))
+                return false;
+        return true;
+    }
+
+    void build (unsigned int cell) {
+        auto inside = [cell] (unsigned int c) { return ((cell >> c) & 1u) != 0; };
+        int next[12]; // Following edge of the contour, from each edge it crosses
+        std::fill (next, next + 12, -1);
+        for (unsigned int axis = 0; axis < 3; axis++) {
+            for (unsigned int side = 0; side < 2; side++) {
+                unsigned int u = 1u << ((axis + 1) % 3), v = 1u << ((axis + 2) % 3), base = side << axis;
+                unsigned int face[4] = { base, base | u, base | u | v, base | v }; // Counterclockwise around +axis
+                if (side == 0)
+                    std::swap (face[1], face[3]);
+                for (unsigned int k = 0; k < 4; k++) {
+                    if (inside (face[k]) || !inside (face[(k+1) % 4]))
+                        continue;
+                    unsigned int m = (k+1) % 4; // Last corner of the run of inside corners entered at k
+                    while (inside (face[(m+1) % 4]))
+                        m = (m+1) % 4;
+                    next[edge (face[m], face[(m+1) % 4])] = edge (face[k], face[(k+1) % 4]);
+                }
+            }
+        }
+
+        size_t count = 0;
+        for (int first = 0; first < 12; first++) {
+            unsigned char loop[12];
+            size_t length = 0;
+            for (int e = first; next[e] >= 0; ) {
+                loop[length++] = e;
+                int following = next[e];
+                next[e] = -1;
+                e = following;
+            }
+            if (length == 0)
+                continue;
+            size_t apex = 0; // Whose diagonals do not cross a face: they would be shared with the next cell
+            while (apex < length && !diagonalsInside (loop, length, apex))
+                apex++;
+            apex %= length;
+            for (size_t i = 1; i + 1 < length; i++, count++) { // The loops turn around the inside, clockwise seen from outside
+                edges[cell][3*count] = loop[apex];
+                edges[cell][3*count + 1] = loop[(apex + i + 1) % length];
+                edges[cell][3*count + 2] = loop[(apex + i) % length];
+            }
+        }
+        triangleCount[cell] = static_cast<unsigned char> (count);
+    }
+};
+
+static const MarchingCubesTable & marchingCubesTable () {
+    static const MarchingCubesTable table;
+    return table;
+}
+
+/*
+ * Vectorized classification
+ */
+
+// inside[i] = 1 when values[i] < isoValue, 0 otherwise (NaN included)
+static void classify (const float * values, size_t count, float isoValue, unsigned char * inside) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128 iso = _mm_set1_ps (isoValue);
+    __m128i one = _mm_set1_epi8 (1);
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_castps_si128 (_mm_cmplt_ps (_mm_loadu_ps (values + i), iso)); // All ones or zero per lane
+        __m128i b = _mm_castps_si128 (_mm_cmplt_ps (_mm_loadu_ps (values + i + 4), iso));
+        __m128i c = _mm_castps_si128 (_mm_cmplt_ps (_mm_loadu_ps (values + i + 8), iso));
+        __m128i d = _mm_castps_si128 (_mm_cmplt_ps (_mm_loadu_ps (values + i + 12), iso));
+        __m128i bytes = _mm_packs_epi16 (_mm_packs_epi32 (a, b), _mm_packs_epi32 (c, d));
+        _mm_storeu_si128 (reinterpret_cast<__m128i *> (inside + i), _mm_and_si128 (bytes, one));
+    }
+#endif
+    for (; i < count; i++)
+        inside[i] = values[i] < isoValue ? 1 : 0;
+}
+
+// Number of i < count where a[i] != b[i], for arrays of 0 and 1
+static size_t countDifferences (const unsigned char * a, const unsigned char * b, size_t count) {
+    size_t i = 0, differences = 0;
+#if defined(__SSE2__)
+    __m128i sum = _mm_setzero_si128 ();
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_xor_si128 (_mm_loadu_si128 (reinterpret_cast<const __m128i *> (a + i)),
+                                   _mm_loadu_si128 (reinterpret_cast<const __m128i *> (b + i)));
+        sum = _mm_add_epi64 (sum, _mm_sad_epu8 (x, _mm_setzero_si128 ()));
+    }
+    uint64_t halves[2];
+    _mm_storeu_si128 (reinterpret_cast<__m128i *> (halves), sum);
+    differences = size_t (halves[0] + halves[1]);
+#endif
+    for (; i < count; i++)
+        differences += a[i] ^ b[i];
+    return differences;
+}
+
+// Cases of a row of count cells, from the classification of the four rows of samples around it:
+// rows[k >> 1] holds corner k, at column x + (k & 1) for cell x
+static void cellCases (const unsigned char * const rows[4], size_t count, unsigned char * cases) {
+    size_t x = 0;
+#if defined(__SSE2__)
+    for (; x + 16 <= count; x += 16) {
+        __m128i c = _mm_setzero_si128 ();
+        for (int k = 7; k >= 0; k--) { // Bit by bit from the highest, doubling bytes of at most 255
+            __m128i corner = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (rows[k >> 1] + x + (k & 1)));
+            c = _mm_add_epi8 (_mm_add_epi8 (c, c), corner);
+        }
+        _mm_storeu_si128 (reinterpret_cast<__m128i *> (cases + x), c);
+    }
+#endif
+    for (; x < count; x++) {
+        unsigned int c = 0;
+        for (int k = 0; k < 8; k++)
+            c |= unsigned (rows[k >> 1][x + (k & 1)]) << k;
+        cases[x] = static_cast<unsigned char> (c);
+    }
+}
+
+// Calls f (i) for every i < count where a[i] != b[i], skipping eight equal bytes at a time
+template<typename Function>
+static void forEachDifference (const unsigned char * a, const unsigned char * b, size_t count, const Function & f) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint64_t wordA, wordB;
+        std::memcpy (&wordA, a + i, 8);
+        std::memcpy (&wordB, b + i, 8);
+        if (wordA == wordB)
+            continue;
+        for (size_t k = i; k < i + 8; k++)
+            if (a[k] != b[k])
+                f (k);
+    }
+    for (; i < count; i++)
+        if (a[i] != b[i])
+            f (i);
+}
+
+// Calls f (x, case) for every cell the surface crosses, skipping eight empty or full cells at a time
+template<typename Function>
+static void forEachSurfaceCell (const unsigned char * cases, size_t count, const Function & f) {
+    size_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        uint64_t word;
+        std::memcpy (&word, cases + x, 8);
+        if (word == 0 || word == ~uint64_t (0))
+            continue;
+        for (size_t k = x; k < x + 8; k++)
+            if (cases[k] != 0 && cases[k] != 255)
+                f (k, cases[k]);
+    }
+    for (; x < count; x++)
+        if (cases[x] != 0 && cases[x] != 255)
+            f (x, cases[x]);
+}
+
+/*
+ * Extraction
+ */
+
+// The samples of a few consecutive layers. A grid holding its values is read in place; otherwise
+// each layer asked for is sampled into the slot of the lowest layer held, so that a pass moving
+// up the grid keeps the last four.
+class LayerWindow {
+public:
+    LayerWindow (const VolumeGrid & grid) : grid (grid), layerSize (grid.sizeX * grid.sizeY) {}
+
+    const float * get (size_t z) {
+        if (grid.values)
+            return grid.values + z * layerSize;
+        Slot * slot = &slots[0];
+        for (Slot & s : slots) {
+            if (s.z == z)
+                return s.values.data ();
+            if (age (s.z) < age (slot->z))
+                slot = &s;
+        }
+        slot->values.resize (layerSize);
+        grid.sampleLayer (z, slot->values.data ());
+        slot->z = z;
+        return slot->values.data ();
+    }
+
+private:
+    struct Slot {
+        size_t z = noLayer;
+        std::vector<float> values;
+    };
+
+    static size_t age (size_t z) {
+        return z == noLayer ? 0 : z + 1;
+    }
+
+    const VolumeGrid & grid;
+    size_t layerSize;
+    Slot slots[4];
+};
+
+// Vertices on the edges from the samples of layer z, and triangles of the cells between layers z
+// and z + 1, the last layer having neither z edges nor cells
+struct LayerCounts {
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+    size_t firstVertex = 0;
+    size_t firstTriangle = 0;
+};
+
+// Within a layer, the vertices are numbered row by row, the x edges of a row and then its y edges,
+// and the z edges of the layer come last. The next layer can then number its x and y edges
+// from its own classification alone.
+class IsosurfaceBuilder {
+public:
+    IsosurfaceBuilder (const VolumeGrid & grid, float isoValue, Geometry & geometry)
+        : grid (grid), isoValue (isoValue), geometry (geometry), table (marchingCubesTable ()),
+          sizeX (grid.sizeX), sizeY (grid.sizeY), sizeZ (grid.sizeZ), layerSize (grid.sizeX * grid.sizeY), layers (grid.sizeZ) {
+        for (unsigned int e = 0; e < 12; e++) {
+            unsigned int corner = table.corners[e][0], axis = e / 4;
+            edgeIds[e] = axis == 2 ? 4 : 2 * (corner >> 2) + axis;
+            edgeOffsets[e] = ((corner >> 1) & 1) * sizeX + (corner & 1);
+        }
+    }
+
+    // Counts the layers [first, last)
+    void count (size_t first, size_t last) {
+        LayerWindow window (grid);
+        ClassifiedLayer below (sizeX, sizeY), above (sizeX, sizeY);
+        std::vector<unsigned char> cases (sizeX - 1);
+        for (size_t z = first; z < last; z++) {
+            LayerCounts & layer = layers[z];
+            if (z == first)
+                classifyLayer (window.get (z), below);
+            else
+                std::swap (below, above); // Classified as the layer above the previous one
+            layer.vertexCount += below.xCrossings + countDifferences (below.inside.data (), &below.inside[sizeX], layerSize - sizeX);
+            if (z + 1 == sizeZ)
+                continue;
+            classifyLayer (window.get (z + 1), above);
+            layer.vertexCount += countDifferences (below.inside.data (), above.inside.data (), layerSize);
+            for (size_t y = 0; y + 1 < sizeY; y++)
+                if (caseRow (below, above, y, cases.data ()))
+                    forEachSurfaceCell (cases.data (), sizeX - 1, [&] (size_t, unsigned int c) { layer.triangleCount += table.triangleCount[c]; });
+        }
+    }
+
+    // Sums the counts up, false if there are too many vertices for 32-bit indices
+    bool prefix (GeometrySize & size) {
+        size = { 0, 0 };
+        for (LayerCounts & layer : layers) {
+            layer.firstVertex = size.vertexCount;
+            layer.firstTriangle = size.indexCount / 3;
+            size.vertexCount += layer.vertexCount;
+            size.indexCount += 3 * layer.triangleCount;
+        }
+        return size.vertexCount <= std::numeric_limits<unsigned int>::max ();
+    }
+
+    // Writes the vertices and the triangles of the layers [first, last) into their slices of the geometry
+    void fill (size_t first, size_t last) {
+        LayerWindow window (grid);
+        ClassifiedLayer below (sizeX, sizeY), above (sizeX, sizeY);
+        std::vector<unsigned char> cases (sizeX - 1);
+        std::vector<unsigned int> ids[5]; // Vertices on the x and y edges of layer z, of layer z + 1, and on the z edges
+        for (std::vector<unsigned int> & layerIds : ids)
+            layerIds.resize (layerSize);
+        for (size_t z = first; z < last; z++) {
+            const LayerCounts & layer = layers[z];
+            if (z == first)
+                classifyLayer (window.get (z), below);
+            else
+                std::swap (below, above);
+            size_t v = numberLayer (below.inside.data (), z, layer.firstVertex, ids[0].data (), ids[1].data (), &window);
+            if (z + 1 == sizeZ)
+                continue;
+            classifyLayer (window.get (z + 1), above);
+            forEachDifference (below.inside.data (), above.inside.data (), layerSize, [&] (size_t p) {
+                ids[4][p] = static_cast<unsigned int> (v);
+                writeVertex (v++, p % sizeX, p / sizeX, z, 2, window);
+            });
+            numberLayer (above.inside.data (), z + 1, layers[z + 1].firstVertex, ids[2].data (), ids[3].data (), nullptr);
+
+            const unsigned int * edgeVertices[5] = { ids[0].data (), ids[1].data (), ids[2].data (), ids[3].data (), ids[4].data () };
+            unsigned int * index = geometry.triangleIndices.data () + 3 * layer.firstTriangle;
+            for (size_t y = 0; y + 1 < sizeY; y++) {
+                if (!caseRow (below, above, y, cases.data ()))
+                    continue;
+                forEachSurfaceCell (cases.data (), sizeX - 1, [&] (size_t x, unsigned int c) {
+                    size_t p = y * sizeX + x;
+                    for (size_t k = 0; k < 3 * size_t (table.triangleCount[c]); k++) {
+                        unsigned int e = table.edges[c][k];
+                        *index++ = edgeVertices[edgeIds[e]][p + edgeOffsets[e]];
+                    }
+                });
+            }
+        }
+    }
+
+private:
+    // Inside flags of a layer, and the state of each of its rows: 0 or 1 when all of its samples
+    // are, mixed otherwise. A row of cells between four equal rows that are not mixed is skipped.
+    struct ClassifiedLayer {
+        static constexpr unsigned char mixed = 2;
+
+        ClassifiedLayer (size_t sizeX, size_t sizeY) : inside (sizeX * sizeY), rows (sizeY) {}
+
+        std::vector<unsigned char> inside;
+        std::vector<unsigned char> rows;
+        size_t xCrossings = 0; // Edges along x the surface crosses
+    };
+
+    void classifyLayer (const float * values, ClassifiedLayer & layer) const {
+        classify (values, layerSize, isoValue, layer.inside.data ());
+        layer.xCrossings = 0;
+        for (size_t y = 0; y < sizeY; y++) {
+            const unsigned char * row = &layer.inside[y * sizeX];
+            size_t crossings = countDifferences (row, row + 1, sizeX - 1);
+            layer.rows[y] = crossings ? ClassifiedLayer::mixed : row[0];
+            layer.xCrossings += crossings;
+        }
+    }
+
+    // Cases of the row y of cells between two layers, false if they are all empty or all full
+    bool caseRow (const ClassifiedLayer & below, const ClassifiedLayer & above, size_t y, unsigned char * cases) const {
+        unsigned char state = below.rows[y];
+        if (state != ClassifiedLayer::mixed && below.rows[y + 1] == state && above.rows[y] == state && above.rows[y + 1] == state)
+            return false;
+        const unsigned char * rows[4] = { &below.inside[y * sizeX], &below.inside[(y + 1) * sizeX], &above.inside[y * sizeX], &above.inside[(y + 1) * sizeX] };
+        cellCases (rows, sizeX - 1, cases);
+        return true;
+    }
+    // Numbers the vertices on the x and y edges of layer z from first, and writes them when window
+    // is given. Returns the next vertex.
+    size_t numberLayer (const unsigned char * inside, size_t z, size_t first, unsigned int * xIds, unsigned int * yIds, LayerWindow * window) const {
+        size_t v = first;
+        for (size_t y = 0; y < sizeY; y++) {
+            const unsigned char * row = inside + y * sizeX;
+            forEachDifference (row, row + 1, sizeX - 1, [&] (size_t x) {
+                xIds[y * sizeX + x] = static_cast<unsigned int> (v);
+                if (window)
+                    writeVertex (v, x, y, z, 0, *window);
+                v++;
+            });
+            if (y + 1 == sizeY)
+                break;
+            forEachDifference (row, row + sizeX, sizeX, [&] (size_t x) {
+                yIds[y * sizeX + x] = static_cast<unsigned int> (v);
+                if (window)
+                    writeVertex (v, x, y, z, 1, *window);
+                v++;
+            });
+        }
+        return v;
+    }
+
+    // Central differences, one-sided on the sides of the grid
+    glm::vec3 gradient (size_t x, size_t y, size_t z, LayerWindow & window) const {
+        size_t x0 = x > 0 ? x - 1 : x, x1 = std::min (x + 1, sizeX - 1);
+        size_t y0 = y > 0 ? y - 1 : y, y1 = std::min (y + 1, sizeY - 1);
+        size_t z0 = z > 0 ? z - 1 : z, z1 = std::min (z + 1, sizeZ - 1);
+        const float * layer = window.get (z);
+        return glm::vec3 ((layer[y * sizeX + x1] - layer[y * sizeX + x0]) / (float (x1 - x0) * grid.spacing.x),
+                          (layer[y1 * sizeX + x] - layer[y0 * sizeX + x]) / (float (y1 - y0) * grid.spacing.y),
+                          (window.get (z1)[y * sizeX + x] - window.get (z0)[y * sizeX + x]) / (float (z1 - z0) * grid.spacing.z));
+    }
+
+    // Vertex v, where the field crosses the iso value on the edge from sample (x, y, z) along axis
+    void writeVertex (size_t v, size_t x, size_t y, size_t z, unsigned int axis, LayerWindow & window) const {
+        glm::vec3 a (x, y, z), b = a;
+        b[axis] += 1.f;
+        float valueA = window.get (z)[y * sizeX + x];
+        float valueB = window.get (size_t (b.z))[size_t (b.y) * sizeX + size_t (b.x)];
+        // The two samples are on either side of the iso value. One on it, or a rounding error away,
+        // would give t = 0 or 1, and a vertex on the sample for each edge meeting there: t is kept a
+        // thousandth of the edge off its ends instead, so that those vertices stay apart.
+        float t = glm::clamp ((isoValue - valueA) / (valueB - valueA), edgeMargin, 1.f - edgeMargin);
+        glm::vec3 position = grid.origin + grid.spacing * glm::mix (a, b, t);
+        glm::vec3 normal = glm::mix (gradient (x, y, z, window), gradient (size_t (b.x), size_t (b.y), size_t (b.z), window), t);
+        float length = glm::length (normal);
+        normal = length > 0.f ? normal / length : glm::vec3 (0.f, 0.f, 1.f);
+        for (int c = 0; c < 3; c++) {
+            geometry.vertexPositions[3*v + c] = position[c];
+            geometry.vertexNormals[3*v + c] = normal[c];
+            geometry.vertexColors[3*v + c] = 1.f;
+        }
+    }
+
+    const VolumeGrid & grid;
+    float isoValue;
+    Geometry & geometry;
+    const MarchingCubesTable & table;
+    size_t sizeX, sizeY, sizeZ, layerSize;
+    std::vector<LayerCounts> layers;
+    unsigned int edgeIds[12]; // Of each edge of a cell, the ids array holding its vertex
+    size_t edgeOffsets[12]; // And its sample, relative to the first one of the cell
+};
+
+std::shared_ptr<Geometry> Isosurface::extract (const VolumeGrid & grid, float isoValue) {
+    if (grid.sizeX < 2 || grid.sizeY < 2 || grid.sizeZ < 2) {
+        std::cerr << "ERROR: isosurface of a " << grid.sizeX << " x " << grid.sizeY << " x " << grid.sizeZ
+                  << " grid, at least 2 samples are needed along each axis" << std::endl;
+        return nullptr;
+    }
+    if (!grid.values && !grid.sampleLayer) {
+        std::cerr << "ERROR: isosurface of a grid with neither values nor a layer function" << std::endl;
+        return nullptr;
+    }
+
+    std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> ();
+    IsosurfaceBuilder builder (grid, isoValue, *geometry);
+    ThreadPool::instance ().parallelFor (0, grid.sizeZ, [&] (size_t first, size_t last) { builder.count (first, last); });
+    GeometrySize size;
+    if (!builder.prefix (size)) {
+        std::cerr << "ERROR: isosurface of " << size.vertexCount << " vertices, too many for 32-bit indices" << std::endl;
+        return nullptr;
+    }
+    geometry->allocate (size);
+    ThreadPool::instance ().parallelFor (0, grid.sizeZ, [&] (size_t first, size_t last) { builder.fill (first, last); });
+    geometry->computeBounds ();
+    return geometry;
+}
@@ -0,0 +1,42 @@
+#ifndef _ISOSURFACE_H
+#define _ISOSURFACE_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include "Geometry.hpp"
+
+// Scalar field sampled at sizeX x sizeY x sizeZ points of a regular grid, point (x, y, z) being at
+// origin + (x, y, z) * spacing. Either values holds every sample, x varying fastest, then y, or
+// sampleLayer writes the sizeX * sizeY samples of layer z on demand: for a field given as a
+// function, or too large to be stored. It may be called more than once per layer, and from
+// several threads at once.
+struct VolumeGrid {
+	size_t sizeX = 0;
+	size_t sizeY = 0;
+	size_t sizeZ = 0;
+	glm::vec3 origin = glm::vec3 (0.f);
+	glm::vec3 spacing = glm::vec3 (1.f);
+	const float * values = nullptr;
+	std::function<void (size_t z, float * layer)> sampleLayer;
+};
+
+// Marching cubes. The samples below the iso value are inside, as for a signed distance, and the
+// triangles face away from them. Each vertex lies on an edge of the grid and is shared by the
+// cells around that edge, so the mesh is closed wherever the surface does not leave the grid.
+// Ambiguous cell faces always separate their inside corners, the same way from both cells.
+//
+// The layers of the grid are processed in parallel, twice: a first pass classifies the samples
+// (four at a time with SSE2) and counts the edge vertices and triangles of every layer, and the
+// second writes each layer into its slice of buffers allocated at their exact size.
+class Isosurface {
+public:
+	// Positions, normals (from the gradient of the field) and a constant color. nullptr, after
+	// printing why, if the grid has less than 2 samples along an axis, no samples, or more vertices
+	// than 32-bit indices can address. A surface missing the grid gives an empty geometry.
+	static std::shared_ptr<Geometry> extract (const VolumeGrid & grid, float isoValue);
+};
+
+#endif //_ISOSURFACE_H
@@ -27,6 +27,7 @@
 
 #include "Camera.hpp"
 #include "Mesh.hpp"
+#include "InstancedMesh.hpp"
 #include "Transform.hpp"
 
 #define SOLUTION
@@ -163,7 +164,7 @@ void initCamera () {
 	camera.setAspectRatio (static_cast<float>(width) / static_cast<float>(height));
 }
 
-void init (vector<std::shared_ptr<Mesh>> meshGroup) {
+void init (vector<std::shared_ptr<Mesh>> meshGroup, vector<std::shared_ptr<InstancedMesh>> instancedGroup) {
 	initGLFW ();
 	initOpenGL ();
 	initGPUProgram ();
@@ -173,9 +174,13 @@ void init (vector<std::shared_ptr<Mesh>> meshGroup) {
 	for(mesh = meshGroup.begin(); mesh != meshGroup.end(); ++mesh) {
 		(*mesh)->init();
 	}
+
+	for (auto & instancedMesh : instancedGroup) {
+		instancedMesh->init();
+	}
 }
 
-void render (vector<std::shared_ptr<Mesh>> meshGroup) {
+void render (vector<std::shared_ptr<Mesh>> meshGroup, vector<std::shared_ptr<InstancedMesh>> instancedGroup) {
     glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Erase the color and z buffers.
 	glUseProgram (program); // Activate the program to be used for upcoming primitive
 
@@ -183,6 +188,7 @@ void render (vector<std::shared_ptr<Mesh>> meshGroup) {
     glUniformMatrix4fv (glGetUniformLocation (program, "projectionMat"), 1, GL_FALSE, glm::value_ptr (projectionMatrix)); // Pass it to the GPU program
     
 	glm::mat4 viewMatrix = camera.computeViewMatrix();
+	glUniform1i (glGetUniformLocation (program, "instanced"), GL_FALSE);
     vector<std::shared_ptr<Mesh>>::iterator mesh;
 	for( mesh = meshGroup.begin(); mesh != meshGroup.end(); ++mesh ) {
 		glm::mat4 modelMatrix = (*mesh)->computeTransformationMatrix();
@@ -192,11 +198,20 @@ void render (vector<std::shared_ptr<Mesh>> meshGroup) {
 		glm::mat4 normalMatrix = glm::transpose(glm::inverse(viewMatrix * modelMatrix));
 		glUniformMatrix4fv (glGetUniformLocation (program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
 		
-		(*mesh)->render();
+		(*mesh)->render(viewMatrix, projectionMatrix);
+	}
+
+	// Instanced meshes only need the view: model matrices are read per instance on the GPU
+	glm::mat4 normalViewMatrix = glm::transpose(glm::inverse(viewMatrix));
+	glUniform1i (glGetUniformLocation (program, "instanced"), GL_TRUE);
+	glUniformMatrix4fv (glGetUniformLocation (program, "viewMat"), 1, GL_FALSE, glm::value_ptr (viewMatrix));
+	glUniformMatrix4fv (glGetUniformLocation (program, "normalViewMat"), 1, GL_FALSE, glm::value_ptr (normalViewMatrix));
+	for (auto & instancedMesh : instancedGroup) {
+		instancedMesh->render();
 	}
 }
 
-void clear (vector<std::shared_ptr<Mesh>> meshGroup) {
+void clear (vector<std::shared_ptr<Mesh>> meshGroup, vector<std::shared_ptr<InstancedMesh>> instancedGroup) {
 	glDeleteProgram (program);
 	glfwDestroyWindow (window);
 
@@ -205,6 +220,10 @@ void clear (vector<std::shared_ptr<Mesh>> meshGroup) {
 		(*mesh)->clear();
 	}
 
+	for (auto & instancedMesh : instancedGroup) {
+		instancedMesh->clear();
+	}
+
 	glfwTerminate ();
 }
 
@@ -217,35 +236,41 @@ void update (float currentTime) {
 }
 
 int main (int argc, char ** argv) {
-	std::shared_ptr<Mesh> mesh1 = Mesh::genSphere(80);
-	std::shared_ptr<Mesh> mesh2 = Mesh::genSphere(80);
-	std::shared_ptr<Mesh> mesh3 = Mesh::genSphere(80);
-	std::shared_ptr<Mesh> mesh4 = Mesh::genSphere(80);
-	std::shared_ptr<Mesh> mesh5 = Mesh::genSphere(80);
-	std::shared_ptr<Mesh> mesh6 = Mesh::genSphere(80);
-
-	mesh1->set_translation_vector(glm::vec3(3.0, 1.5, 0.0));
-	mesh2->set_translation_vector(glm::vec3(0.0, 1.5, 0.0));
-	mesh3->set_translation_vector(glm::vec3(-3.0, 1.5, 0.0));
-	mesh4->set_translation_vector(glm::vec3(-1.5, 0.0, 0.0));
-	mesh5->set_translation_vector(glm::vec3(1.5, 0.0, 0.0));
-	mesh6->set_translation_vector(glm::vec3(0.0, -1.5, 0.0));
-
-	vector<std::shared_ptr<Mesh>> meshList = {
-		mesh1, mesh2, mesh3, mesh4, mesh5, mesh6
+	// The six spheres share one geometry and are drawn with a single instanced call. It is built in
+	// the background and streamed coarsest level first, so that the first frame waits for neither.
+	std::shared_ptr<Geometry> sphereGeometry = std::make_shared<Geometry>();
+	sphereGeometry->streamBudget = size_t(4) << 20; // Bytes per frame
+	sphereGeometry->buildAsync([] () {
+		std::shared_ptr<Mesh> sphere = Mesh::genSphere(80, 1.0f, 4);
+		sphere->compact();
+		sphere->optimizeVertexCache();
+		sphere->getGeometry()->layout = VertexLayout::compact();
+		return sphere->getGeometry();
+	});
+	std::shared_ptr<InstancedMesh> spheres = std::make_shared<InstancedMesh>(sphereGeometry);
+	spheres->addInstance(Transform(glm::vec3(3.0, 1.5, 0.0), 0.0f, 0.0f, 0.0f, 1.0f));
+	spheres->addInstance(Transform(glm::vec3(0.0, 1.5, 0.0), 0.0f, 0.0f, 0.0f, 1.0f));
+	spheres->addInstance(Transform(glm::vec3(-3.0, 1.5, 0.0), 0.0f, 0.0f, 0.0f, 1.0f));
+	spheres->addInstance(Transform(glm::vec3(-1.5, 0.0, 0.0), 0.0f, 0.0f, 0.0f, 1.0f));
+	spheres->addInstance(Transform(glm::vec3(1.5, 0.0, 0.0), 0.0f, 0.0f, 0.0f, 1.0f));
+	spheres->addInstance(Transform(glm::vec3(0.0, -1.5, 0.0), 0.0f, 0.0f, 0.0f, 1.0f));
+
+	vector<std::shared_ptr<Mesh>> meshList;
+	vector<std::shared_ptr<InstancedMesh>> instancedList = {
+		spheres
 	};
 
 	camera.set_translation_vector(glm::vec3(0.0, 0.0, -10.0));
 
-	init(meshList);
+	init(meshList, instancedList);
 
 	while (!glfwWindowShouldClose(window)) {
 		update (static_cast<float> (glfwGetTime()));
-		render(meshList);
+		render(meshList, instancedList);
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
-	clear(meshList);
+	clear(meshList, instancedList);
 
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+
+#include "MappedFile.hpp"
+
+std::shared_ptr<const void> MappedFile::map (const std::string & filename, size_t & size, bool sequential) {
+#ifdef _WIN32
+    DWORD access = sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+    HANDLE file = CreateFileA (filename.c_str (), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, access, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = GetFileSizeEx (file, &fileSize) && fileSize.QuadPart > 0 ? CreateFileMappingA (file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    const void * data = mapping ? MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (mapping)
+        CloseHandle (mapping); // The view keeps the mapping alive
+    CloseHandle (file);
+    if (!data)
+        return nullptr;
+    size = static_cast<size_t> (fileSize.QuadPart);
+    return std::shared_ptr<const void> (data, [] (const void * p) { UnmapViewOfFile (p); });
+#else
+    int file = open (filename.c_str (), O_RDONLY);
+    if (file < 0)
+        return nullptr;
+    struct stat status;
+    void * data = fstat (file, &status) == 0 && status.st_size > 0 ? mmap (nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+    close (file); // The mapping keeps the file open
+    if (data == MAP_FAILED)
+        return nullptr;
+    size_t mappedSize = status.st_size;
+    size = mappedSize;
+    if (sequential) {
+        madvise (data, mappedSize, MADV_SEQUENTIAL); // Read ahead: the loaders walk the file in order
+        madvise (data, mappedSize, MADV_WILLNEED);
+    } else {
+        madvise (data, mappedSize, MADV_RANDOM); // No read-ahead around the pages touched
+    }
+    return std::shared_ptr<const void> (data, [mappedSize] (const void * p) { munmap (const_cast<void *> (p), mappedSize); });
+#endif
+}
+
+void MappedFile::prefetch (const void * data, size_t size) {
+    if (size == 0)
+        return;
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+    WIN32_MEMORY_RANGE_ENTRY range = { const_cast<void *> (data), size };
+    PrefetchVirtualMemory (GetCurrentProcess (), 1, &range, 0);
+#endif
+#else
+    // madvise takes page-aligned ranges
+    uintptr_t page = static_cast<uintptr_t> (sysconf (_SC_PAGESIZE));
+    uintptr_t first = reinterpret_cast<uintptr_t> (data) / page * page;
+    uintptr_t end = reinterpret_cast<uintptr_t> (data) + size;
+    madvise (reinterpret_cast<void *> (first), end - first, MADV_WILLNEED);
+#endif
+}
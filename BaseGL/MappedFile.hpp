@@ -0,0 +1,22 @@
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Read-only mapping of a whole file, shared by the loaders. Pages are read on first access,
+// with read-ahead advised, so parsing or uploading straight from the mapping costs the disk
+// reads and no copy.
+class MappedFile {
+public:
+	// Returns the mapping, released with its last reference, and sets size; nullptr if the file
+	// is missing or empty. A file read in order is read ahead as a whole; a file read at random
+	// (sequential false) only as prefetch asks.
+	static std::shared_ptr<const void> map (const std::string & filename, size_t & size, bool sequential = true);
+
+	// Starts reading the pages of a range of a mapping in the background, without waiting
+	static void prefetch (const void * data, size_t size);
+};
+
+#endif //_MAPPED_FILE_H
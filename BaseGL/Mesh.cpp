@@ -1,319 +1,612 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
+#include <algorithm>
+#include <iostream>
+#include <limits>
 
 #include "Mesh.hpp"
+#include "GeometryCache.hpp"
+#include "GeometryFile.hpp"
+#include "GltfLoader.hpp"
+#include "ObjLoader.hpp"
+#include "PlyLoader.hpp"
+#include "StaticPrimitives.hpp"
+#include "StlLoader.hpp"
+#include "ThreadPool.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "MeshSubdivider.hpp"
+#include "MeshNormals.hpp"
+
+// Levels of detail: a level of resolution R is meant for meshes spanning at most R / lodScreenDetail
+// of the viewport height, where its edges stay around a hundredth of that height. A coarser level is
+// only taken once the mesh is lodHysteresis smaller than its limit, so that a mesh lingering around a
+// limit does not switch back and forth.
+static const float lodScreenDetail = 256.f;
+static const float lodHysteresis = 0.15f;
+static const size_t minLevelResolution = 4;
+
+// A simplified level with error e (relative to the size of the mesh) is meant for meshes spanning at
+// most lodScreenError / e of the viewport height: about half a pixel of error on a 1024 pixel viewport
+static const float lodScreenError = 1.f / 2048.f;
+
+// Generates the levels of a shape one after the other in the same arrays, each with its own vertices,
+// from size (resolution) and fill (resolution, view). A single level is generated exactly as before.
+void Mesh::buildLevels (Geometry & geometry, size_t resolution, size_t levelCount,
+                        const std::function<GeometrySize (size_t)> & size, const std::function<void (size_t, const GeometryView &)> & fill) {
+    size_t resolutions[64];
+    size_t count = 0;
+    for (size_t r = resolution; count < std::min<size_t> (levelCount, 64) && (count == 0 || r >= minLevelResolution); r /= 2)
+        resolutions[count++] = r;
+
+    GeometrySize total = { 0, 0 };
+    for (size_t l = 0; l < count; l++) {
+        total.vertexCount += size (resolutions[l]).vertexCount;
+        total.indexCount += size (resolutions[l]).indexCount;
+    }
+    geometry.allocate (total);
+    if (count == 1) {
+        fill (resolution, geometry.view ());
+        return;
+    }
 
-void Mesh::init () {
-    initGPUGeometry ();
+    GeometryView view = geometry.view ();
+    size_t firstVertex = 0, firstIndex = 0;
+    for (size_t l = 0; l < count; l++) {
+        GeometrySize levelSize = size (resolutions[l]);
+        fill (resolutions[l], GeometryView { view.positions + 3*firstVertex, view.colors + 3*firstVertex, view.normals + 3*firstVertex, view.indices + firstIndex });
+        for (size_t i = firstIndex; i < firstIndex + levelSize.indexCount; i++)
+            view.indices[i] += firstVertex;
+        float maxScreenSize = l == 0 ? std::numeric_limits<float>::max () : resolutions[l] / lodScreenDetail;
+        geometry.levels.push_back ({ static_cast<unsigned int> (firstIndex), static_cast<unsigned int> (levelSize.indexCount), maxScreenSize });
+        firstVertex += levelSize.vertexCount;
+        firstIndex += levelSize.indexCount;
+    }
+    geometry.computeBounds ();
 }
 
-void Mesh::render () {
-    glBindVertexArray (vao); // Activate the VAO storing geometry data
-    glDrawElements (GL_TRIANGLES, triangleIndices.size (), GL_UNSIGNED_INT, 0); // Call for rendering: stream the current GPU geometry through the current GPU program
+// Applies an index pass to each level on its own, so that reordering or removing triangles never
+// moves them from one level to another
+template<typename Pass>
+static void forEachLevel (Geometry & geometry, const Pass & pass) {
+    if (geometry.levels.empty ()) {
+        pass (geometry.triangleIndices);
+        return;
+    }
+    std::vector<unsigned int> merged, levelIndices;
+    merged.reserve (geometry.triangleIndices.size ());
+    for (GeometryLevel & level : geometry.levels) {
+        auto first = geometry.triangleIndices.begin () + level.firstIndex;
+        levelIndices.assign (first, first + level.indexCount);
+        pass (levelIndices);
+        level.firstIndex = static_cast<unsigned int> (merged.size ());
+        level.indexCount = static_cast<unsigned int> (levelIndices.size ());
+        merged.insert (merged.end (), levelIndices.begin (), levelIndices.end ());
+    }
+    geometry.triangleIndices.swap (merged);
 }
 
-void Mesh::clear () {
-    glDeleteVertexArrays (1, &vao);
-    glDeleteBuffers (1, &posVbo);
-    glDeleteBuffers (1, &colVbo);
-    glDeleteBuffers (1, &ibo);
-}
-
-void Mesh::initGPUGeometry () {
-    glCreateBuffers (1, &posVbo); // Generate a GPU buffer to store the positions of the vertices
-    size_t vertexBufferSize = sizeof (float) * vertexPositions.size (); // Gather the size of the buffer from the CPU-side vector
-    glNamedBufferStorage (posVbo, vertexBufferSize, NULL, GL_DYNAMIC_STORAGE_BIT); // Creta a data store on the GPU
-    glNamedBufferSubData (posVbo, 0, vertexBufferSize, vertexPositions.data ()); // Fill the data store from a CPU array
-
-    glCreateBuffers (1, &colVbo); // Generate a GPU buffer to store the colors of the vertices
-    size_t vertexColorsBufferSize = sizeof (float) * vertexColors.size (); // Gather the size of the buffer from the CPU-side vector
-    glNamedBufferStorage (colVbo, vertexColorsBufferSize, NULL, GL_DYNAMIC_STORAGE_BIT); // Creta a data store on the GPU
-    glNamedBufferSubData (colVbo, 0, vertexColorsBufferSize, vertexColors.data ()); // Fill the data store from a CPU array
-
-    glCreateBuffers (1, &ibo); // Same for the index buffer, that stores the list of indices of the triangles forming the mesh
-    size_t indexBufferSize = sizeof (unsigned int) * triangleIndices.size ();
-    glNamedBufferStorage (ibo, indexBufferSize, NULL, GL_DYNAMIC_STORAGE_BIT);
-    glNamedBufferSubData (ibo, 0, indexBufferSize, triangleIndices.data ());
-
-    glCreateVertexArrays (1, &vao); // Create a single hangle that joins together attributes (vertex positions, normals) and connectivity (triangles indices)
-    glBindVertexArray (vao);
-
-    glEnableVertexAttribArray (0);
-    glBindBuffer (GL_ARRAY_BUFFER, posVbo);
-    glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof (GLfloat), 0);
-
-    glEnableVertexAttribArray (1);
-    glBindBuffer (GL_ARRAY_BUFFER, colVbo);
-    glVertexAttribPointer (1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof (GLfloat), 0);
-
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glBindVertexArray (0); // Desactive the VAO just created. Will be activated at rendering time.
-}
-
-std::shared_ptr<Mesh> Mesh::genSphere (size_t resolution) {
-    std::shared_ptr<Mesh> sphere = std::make_shared<Mesh>();
-
-    int N = resolution;
-    float R = 1.0;
-    float theta, fi;
-    float x, y, z;
-    const float pi = 3.14159;
-
-    for (int j = 0; j < N+1; j++) {
-        for (int i = 0; i < N+1; i++) {
-            theta = i*2*pi/N;
-            fi = j*pi/N-pi/2;
-
-            x = R*cosf(theta)*cosf(fi);
-            y = R*sinf(theta)*cosf(fi);
-            z = R*cosf(fi);
-
-            sphere->vertexPositions.push_back(x);
-            sphere->vertexPositions.push_back(y);
-            sphere->vertexPositions.push_back(z);
-            sphere->vertexColors.push_back(1.f);
-            sphere->vertexColors.push_back(0.f);
-            sphere->vertexColors.push_back((j%3 == 1) ? 1.f : 0.f);
-        }
-    }
+Mesh::Mesh (std::shared_ptr<Geometry> geometry) : geometry (geometry) {}
 
-    for (int t = 0; t < (N*N-1); t++) {
-        sphere->triangleIndices.push_back(t);
-        sphere->triangleIndices.push_back(t+1);
-        sphere->triangleIndices.push_back(t+N);
-        sphere->triangleIndices.push_back(t+1);
-        sphere->triangleIndices.push_back(t+1+N);
-        sphere->triangleIndices.push_back(t+N);
-    }
+std::shared_ptr<Geometry> Mesh::getGeometry () const {
+    return geometry;
+}
 
-    return sphere;
-}
-
-std::shared_ptr<Mesh> Mesh::genCone (size_t resolution) {
-    std::shared_ptr<Mesh> cone = std::make_shared<Mesh>();
-
-    int N = resolution;
-    float theta, radius;
-    const float pi = 3.14159;
-
-    float x = 0, y = 0, z = 1;
-    cone->vertexPositions.push_back(x);
-    cone->vertexPositions.push_back(y);
-    cone->vertexPositions.push_back(z);
-    cone->vertexColors.push_back(1.f);
-    cone->vertexColors.push_back(1.f);
-    cone->vertexColors.push_back(0.f);
-
-    x = 0, y = 0, z = -1;
-    cone->vertexPositions.push_back(x);
-    cone->vertexPositions.push_back(y);
-    cone->vertexPositions.push_back(z);
-    cone->vertexColors.push_back(1.f);
-    cone->vertexColors.push_back(1.f);
-    cone->vertexColors.push_back(0.f);
-
-    for (int i = 0; i < N; i++) {
-        theta = i*2*pi/N;
-        x = cos(theta);
-        y = sin(theta);
-        z = -1;
-
-        cone->vertexPositions.push_back(x);
-        cone->vertexPositions.push_back(y);
-        cone->vertexPositions.push_back(z);
-        cone->vertexColors.push_back(1.f);
-        cone->vertexColors.push_back(1.f);
-        cone->vertexColors.push_back(0.f);
-    }
+bool Mesh::save (const std::string & filename, bool compressed) const {
+    return GeometryFile::save (*geometry, filename, compressed);
+}
 
+std::shared_ptr<Mesh> Mesh::load (const std::string & filename) {
+    std::shared_ptr<Geometry> geometry = GeometryFile::load (filename);
+    return geometry ? std::make_shared<Mesh> (geometry) : nullptr;
+}
 
-    for (int t = 2; t < N+1; t++) {
-        cone->triangleIndices.push_back(0);
-        cone->triangleIndices.push_back(t);
-        cone->triangleIndices.push_back(t+1);
-    }
-    cone->triangleIndices.push_back(0);
-    cone->triangleIndices.push_back(N+1);
-    cone->triangleIndices.push_back(2);
+std::shared_ptr<Mesh> Mesh::loadOBJ (const std::string & filename) {
+    std::shared_ptr<Geometry> geometry = ObjLoader::load (filename);
+    return geometry ? std::make_shared<Mesh> (geometry) : nullptr;
+}
 
+std::shared_ptr<Mesh> Mesh::loadPLY (const std::string & filename, bool directUpload) {
+    std::shared_ptr<Geometry> geometry = PlyLoader::load (filename, directUpload);
+    return geometry ? std::make_shared<Mesh> (geometry) : nullptr;
+}
 
-    for (int t = 2; t < N+1; t++) {
-        cone->triangleIndices.push_back(1);
-        cone->triangleIndices.push_back(t);
-        cone->triangleIndices.push_back(t+1);
-    }
-    cone->triangleIndices.push_back(1);
-    cone->triangleIndices.push_back(N+1);
-    cone->triangleIndices.push_back(2);
-
-    return cone;
-}
-
-std::shared_ptr<Mesh> Mesh::genCylinder (size_t resolution) {
-    std::shared_ptr<Mesh> cylinder = std::make_shared<Mesh>();
-
-    int N = resolution;
-    float theta, radius;
-    const float pi = 3.14159;
-
-    float x = 0, y = 0, z = 1;
-    cylinder->vertexPositions.push_back(x);
-    cylinder->vertexPositions.push_back(y);
-    cylinder->vertexPositions.push_back(z);
-    cylinder->vertexColors.push_back(1.f);
-    cylinder->vertexColors.push_back(0.f);
-    cylinder->vertexColors.push_back(1.f);
-
-    x = 0, y = 0, z = -1;
-    cylinder->vertexPositions.push_back(x);
-    cylinder->vertexPositions.push_back(y);
-    cylinder->vertexPositions.push_back(z);
-    cylinder->vertexColors.push_back(1.f);
-    cylinder->vertexColors.push_back(1.f);
-    cylinder->vertexColors.push_back(0.f);
-
-    for (int i = 0; i < N; i++) {
-        theta = i*2*pi/N;
-        x = cos(theta);
-        y = sin(theta);
-        z = 1;
-
-        cylinder->vertexPositions.push_back(x);
-        cylinder->vertexPositions.push_back(y);
-        cylinder->vertexPositions.push_back(z);
-        cylinder->vertexColors.push_back(1.f);
-        cylinder->vertexColors.push_back(0.f);
-        cylinder->vertexColors.push_back(0.f);
+std::shared_ptr<Mesh> Mesh::loadSTL (const std::string & filename) {
+    std::shared_ptr<Geometry> geometry = StlLoader::load (filename);
+    return geometry ? std::make_shared<Mesh> (geometry) : nullptr;
+}
+
+std::shared_ptr<Mesh> Mesh::fromVolume (const VolumeGrid & grid, float isoValue) {
+    std::shared_ptr<Geometry> geometry = Isosurface::extract (grid, isoValue);
+    return geometry ? std::make_shared<Mesh> (geometry) : nullptr;
+}
+
+std::vector<std::shared_ptr<Mesh>> Mesh::loadGLB (const std::string & filename) {
+    return GltfLoader::load (filename);
+}
+
+// In place when no one else holds the geometry, taking it out of the cache, on a copy otherwise,
+// with its packed data decoded
+bool Mesh::detachGeometry () {
+    if (geometry->views.indexBuffer) {
+        std::cerr << "ERROR: The CPU passes do not apply to a geometry read in place from buffer views (glTF)" << std::endl;
+        return false;
     }
+    if (!GeometryCache::release (geometry))
+        geometry = geometry->copy ();
+    geometry->unpack ();
+    return true;
+}
+
+void Mesh::optimizeVertexCache () {
+    if (!detachGeometry ())
+        return;
+    std::vector<unsigned int> & indices = geometry->triangleIndices;
+    size_t vertexCount = geometry->vertexCount ();
 
-    for (int i = 0; i < N; i++) {
-        theta = i*2*pi/N;
-        x = cos(theta);
-        y = sin(theta);
-        z = -1;
-
-        cylinder->vertexPositions.push_back(x);
-        cylinder->vertexPositions.push_back(y);
-        cylinder->vertexPositions.push_back(z);
-        cylinder->vertexColors.push_back(0.f);
-        cylinder->vertexColors.push_back(1.f);
-        cylinder->vertexColors.push_back(1.f);
+    MeshOptimizer::VertexCacheStatistics before = MeshOptimizer::analyzeVertexCache (indices, vertexCount);
+    forEachLevel (*geometry, [=] (std::vector<unsigned int> & levelIndices) { MeshOptimizer::optimizeVertexCache (levelIndices, vertexCount); });
+    MeshOptimizer::VertexCacheStatistics after = MeshOptimizer::analyzeVertexCache (indices, vertexCount);
+    geometry->meshlets.clear (); // Their triangles were reordered
+    MeshOptimizer::optimizeVertexFetch (*geometry);
+
+    std::cout << "Vertex cache: ACMR " << before.acmr << " -> " << after.acmr
+              << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+void Mesh::compact (float tolerance) {
+    if (!detachGeometry ())
+        return;
+    size_t vertexCountBefore = geometry->vertexCount ();
+    size_t triangleCountBefore = geometry->triangleIndices.size () / 3;
+    size_t bytesBefore = geometry->gpuVertexBytes () + geometry->triangleIndices.size () * sizeof (unsigned int); // In the layout it will be uploaded with
+
+    MeshOptimizer::remapIndices (geometry->triangleIndices, MeshOptimizer::weldVertices (*geometry, tolerance));
+    forEachLevel (*geometry, MeshOptimizer::removeDegenerateTriangles);
+    geometry->meshlets.clear (); // Their index ranges no longer hold
+    MeshOptimizer::optimizeVertexFetch (*geometry);
+
+    size_t bytesAfter = geometry->gpuVertexBytes () + geometry->triangleIndices.size () * sizeof (unsigned int);
+    std::cout << "Compaction: " << vertexCountBefore << " -> " << geometry->vertexCount () << " vertices, "
+              << triangleCountBefore << " -> " << geometry->triangleIndices.size () / 3 << " triangles, "
+              << bytesBefore - bytesAfter << " bytes saved (" << 100.0 * (bytesBefore - bytesAfter) / std::max<size_t> (bytesBefore, 1) << "%)" << std::endl;
+}
+
+// Copy of the indices of the finest level
+static std::vector<unsigned int> finestIndices (const Geometry & geometry) {
+    GeometryLevel finest = geometry.level (0);
+    auto first = geometry.triangleIndices.begin () + finest.firstIndex;
+    return std::vector<unsigned int> (first, first + finest.indexCount);
+}
+
+void Mesh::simplify (size_t targetTriangleCount, float targetError) {
+    if (!detachGeometry ())
+        return;
+    std::vector<unsigned int> indices = finestIndices (*geometry);
+    size_t triangleCountBefore = indices.size () / 3;
+    float error = MeshSimplifier::simplify (*geometry, indices, 3 * targetTriangleCount, targetError);
+
+    geometry->triangleIndices.swap (indices);
+    geometry->levels.clear ();
+    geometry->meshlets.clear ();
+    MeshOptimizer::optimizeVertexFetch (*geometry);
+    std::cout << "Simplification: " << triangleCountBefore << " -> " << geometry->triangleIndices.size () / 3
+              << " triangles, error " << error << std::endl;
+}
+
+void Mesh::simplifyLevels (size_t levelCount) {
+    if (!detachGeometry ())
+        return;
+    std::vector<unsigned int> indices = finestIndices (*geometry);
+    std::vector<GeometryLevel> levels = { { 0, static_cast<unsigned int> (indices.size ()), std::numeric_limits<float>::max () } };
+    std::vector<unsigned int> allIndices = indices;
+    float error = 0.f;
+
+    while (levels.size () < levelCount) {
+        size_t indexCountBefore = indices.size ();
+        error += MeshSimplifier::simplify (*geometry, indices, indices.size () / 6 * 3, std::numeric_limits<float>::max ()); // Errors of successive passes add up at most
+        if (4 * indices.size () > 3 * indexCountBefore)
+            break; // Too little left to collapse to be worth a level
+        float maxScreenSize = error > 0.f ? lodScreenError / error : std::numeric_limits<float>::max ();
+        levels.push_back ({ static_cast<unsigned int> (allIndices.size ()), static_cast<unsigned int> (indices.size ()), maxScreenSize });
+        allIndices.insert (allIndices.end (), indices.begin (), indices.end ());
     }
 
+    geometry->triangleIndices.swap (allIndices);
+    geometry->levels = levels.size () > 1 ? levels : std::vector<GeometryLevel> ();
+    geometry->meshlets.clear ();
+    MeshOptimizer::optimizeVertexFetch (*geometry);
+    geometry->computeBounds ();
+    for (size_t l = 0; l < levels.size (); l++)
+        std::cout << "Level " << l << ": " << levels[l].indexCount / 3 << " triangles" << std::endl;
+}
+
+void Mesh::subdivide (size_t levelCount) {
+    if (!detachGeometry ())
+        return;
+    size_t triangleCountBefore = geometry->level (0).indexCount / 3;
+    geometry->triangleIndices = finestIndices (*geometry);
+    geometry->levels.clear ();
+    geometry->meshlets.clear ();
+    MeshOptimizer::removeDegenerateTriangles (geometry->triangleIndices); // Welded STL files have some
+    for (size_t l = 0; l < levelCount; l++)
+        if (!MeshSubdivider::subdivide (*geometry))
+            break;
+    geometry->computeBounds ();
+    std::cout << "Subdivision: " << triangleCountBefore << " -> " << geometry->triangleIndices.size () / 3
+              << " triangles, " << geometry->vertexCount () << " vertices" << std::endl;
+}
+
+void Mesh::computeNormals () {
+    if (!detachGeometry ())
+        return;
+    if (geometry->layout.normal == VertexLayout::NormalNone) // Packed without normals, uploaded with the new ones
+        geometry->layout.normal = VertexLayout::NormalFloat3;
+    MeshNormals::compute (*geometry);
+}
 
-    for (int t = 2; t < N+1; t++) {
-        cylinder->triangleIndices.push_back(0);
-        cylinder->triangleIndices.push_back(t);
-        cylinder->triangleIndices.push_back(t+1);
+void Mesh::buildMeshlets (size_t maxVertices, size_t maxTriangles) {
+    if (!detachGeometry ())
+        return;
+    geometry->meshlets = MeshletBuilder::build (*geometry, maxVertices, maxTriangles);
+}
+
+void Mesh::init () {
+    geometry->initGPUGeometry ();
+}
+
+void Mesh::render () {
+    if (geometry->stream ())
+        geometry->render ();
+}
+
+void Mesh::render (const glm::mat4 & viewMatrix, const glm::mat4 & projectionMatrix) {
+    if (!geometry->stream ())
+        return;
+    glm::mat4 modelViewMatrix = viewMatrix * computeTransformationMatrix ();
+    level = std::max (selectLevel (modelViewMatrix, projectionMatrix), geometry->firstStreamedLevel ()); // No finer than what is on the GPU
+    if (geometry->meshlets.empty ()) {
+        geometry->renderLevel (level);
+        return;
     }
-        cylinder->triangleIndices.push_back(0);
-        cylinder->triangleIndices.push_back(N+1);
-        cylinder->triangleIndices.push_back(2);
-
-    for (int t = N+2; t < 2*N+1; t++) {
-        cylinder->triangleIndices.push_back(1);
-        cylinder->triangleIndices.push_back(t);
-        cylinder->triangleIndices.push_back(t+1);
+
+    GeometryLevel range = geometry->level (level);
+    unsigned int levelEnd = range.firstIndex + range.indexCount;
+    auto meshlet = std::lower_bound (geometry->meshlets.begin (), geometry->meshlets.end (), range.firstIndex,
+                                     [] (const Meshlet & m, unsigned int index) { return m.firstIndex < index; });
+    MeshletCuller culler (modelViewMatrix, projectionMatrix);
+    drawCounts.clear ();
+    drawOffsets.clear ();
+    unsigned int rangeEnd = ~0u;
+    for (; meshlet != geometry->meshlets.end () && meshlet->firstIndex < levelEnd; ++meshlet) {
+        if (!culler.isVisible (*meshlet))
+            continue;
+        if (meshlet->firstIndex == rangeEnd) {
+            drawCounts.back () += meshlet->indexCount; // Contiguous with the previous visible meshlet: extend its range
+        } else {
+            drawCounts.push_back (meshlet->indexCount);
+            drawOffsets.push_back (reinterpret_cast<const void *> (sizeof (unsigned int) * meshlet->firstIndex));
+        }
+        rangeEnd = meshlet->firstIndex + meshlet->indexCount;
     }
-    cylinder->triangleIndices.push_back(1);
-    cylinder->triangleIndices.push_back(2*N+1);
-    cylinder->triangleIndices.push_back(N+2);
+    if (!drawCounts.empty ())
+        geometry->renderRanges (drawCounts.data (), drawOffsets.data (), drawCounts.size ());
+}
 
+size_t Mesh::getLevel () const {
+    return level;
+}
 
-    for (int t = 2; t < N+1; t++) {
-        cylinder->triangleIndices.push_back(t);
-        cylinder->triangleIndices.push_back(t+1);
-        cylinder->triangleIndices.push_back(t+N);
+// Projected diameter of the bounding sphere over the viewport height, compared with the limits of
+// the levels around the current one: a few multiplications per mesh and frame
+size_t Mesh::selectLevel (const glm::mat4 & modelViewMatrix, const glm::mat4 & projectionMatrix) const {
+    const std::vector<GeometryLevel> & levels = geometry->levels;
+    if (levels.size () < 2)
+        return 0;
+
+    glm::vec3 center = glm::vec3 (modelViewMatrix * glm::vec4 (geometry->boundsCenter, 1.f));
+    float scale2 = std::max (std::max (glm::dot (glm::vec3 (modelViewMatrix[0]), glm::vec3 (modelViewMatrix[0])),
+                                       glm::dot (glm::vec3 (modelViewMatrix[1]), glm::vec3 (modelViewMatrix[1]))),
+                             glm::dot (glm::vec3 (modelViewMatrix[2]), glm::vec3 (modelViewMatrix[2])));
+    float radius = std::sqrt (scale2) * geometry->boundsRadius;
+    float depth = -center.z;
+    if (depth <= radius)
+        return 0; // The camera is inside the bounding sphere
+    float screenSize = radius * projectionMatrix[1][1] / depth;
+
+    size_t selected = std::min (level, levels.size () - 1);
+    while (selected > 0 && screenSize > levels[selected].maxScreenSize)
+        selected--;
+    while (selected + 1 < levels.size () && screenSize < (1.f - lodHysteresis) * levels[selected + 1].maxScreenSize)
+        selected++;
+    return selected;
+}
 
-        cylinder->triangleIndices.push_back(t+1);
-        cylinder->triangleIndices.push_back(t+N+1);
-        cylinder->triangleIndices.push_back(t+N);
-    }
+void Mesh::clear () {
+    geometry->clear ();
+}
 
-    cylinder->triangleIndices.push_back(2+N-1);
-    cylinder->triangleIndices.push_back(2);
-    cylinder->triangleIndices.push_back(2+N-1+N);
+std::shared_ptr<Mesh> Mesh::genSphere (size_t resolution, float radius, size_t levelCount) {
+    return std::make_shared<Mesh> (GeometryCache::get ({GeometryCache::Sphere, resolution, radius, 0.f, levelCount},
+        [=] (Geometry & g) { buildLevels (g, resolution, levelCount, sphereSize, [=] (size_t r, const GeometryView & view) { fillSphere (r, radius, view); }); }));
+}
 
-    cylinder->triangleIndices.push_back(2);
-    cylinder->triangleIndices.push_back(2+N);
-    cylinder->triangleIndices.push_back(2+N-1+N);
+std::shared_ptr<Mesh> Mesh::genCone (size_t resolution, size_t levelCount) {
+    return std::make_shared<Mesh> (GeometryCache::get ({GeometryCache::Cone, resolution, 0.f, 0.f, levelCount},
+        [=] (Geometry & g) {
+            if (levelCount > 1 || !StaticPrimitives::cone (resolution, g))
+                buildLevels (g, resolution, levelCount, coneSize, fillCone);
+        }));
+}
 
-    return cylinder;
+std::shared_ptr<Mesh> Mesh::genCylinder (size_t resolution, size_t levelCount) {
+    return std::make_shared<Mesh> (GeometryCache::get ({GeometryCache::Cylinder, resolution, 0.f, 0.f, levelCount},
+        [=] (Geometry & g) {
+            if (levelCount > 1 || !StaticPrimitives::cylinder (resolution, g))
+                buildLevels (g, resolution, levelCount, cylinderSize, fillCylinder);
+        }));
 }
 
 std::shared_ptr<Mesh> Mesh::genCube (size_t resolution) {
-    std::shared_ptr<Mesh> cube = std::make_shared<Mesh>();
-
-    cube->vertexPositions = {
-         1.f,  1.f,  1.f,
-        -1.f,  1.f,  1.f,
-        -1.f, -1.f,  1.f,
-         1.f, -1.f,  1.f,
-         1.f,  1.f, -1.f,
-        -1.f,  1.f, -1.f,
-        -1.f, -1.f, -1.f,
-         1.f, -1.f, -1.f
-    };
+    return std::make_shared<Mesh> (GeometryCache::get ({GeometryCache::Cube, 0, 0.f, 0.f}, // The cube ignores its resolution
+        StaticPrimitives::cube));
+}
 
-    cube->vertexColors = { 
-        1.f, 1.f, 1.f,
-        0.f, 1.f, 1.f,
-        0.f, 0.f, 1.f,
-        1.f, 0.f, 1.f,
-        1.f, 1.f, 0.f,
-        0.f, 1.f, 0.f,
-        1.f, 1.f, 1.f,
-        1.f, 0.f, 0.f
-    };
+std::shared_ptr<Mesh> Mesh::genTorus (size_t resolution, float minorRadius, size_t levelCount) {
+    return std::make_shared<Mesh> (GeometryCache::get ({GeometryCache::Torus, resolution, minorRadius, 0.f, levelCount},
+        [=] (Geometry & g) { buildLevels (g, resolution, levelCount, torusSize, [=] (size_t r, const GeometryView & view) { fillTorus (r, minorRadius, view); }); }));
+}
 
-    cube->triangleIndices = {
-        0, 1, 2,   0, 2, 3,
-        0, 5, 4,   0, 1, 5,
-        3, 4, 7,   3, 0, 4,
-        2, 7, 6,   2, 3, 7,
-        4, 5, 7,   5, 6, 7,
-        1, 6, 5,   1, 2, 6,
-    };
+// Levels of an icosphere: a frequency (cuts per edge of the icosahedron) of n puts about 6n edges
+// around a great circle, as many as a UV sphere of resolution 6n
+static const size_t icosphereResolutionPerFrequency = 6;
+static const size_t parallelIcosphereTriangles = size_t (1) << 22; // From this count on, the faces are split across the thread pool
+
+std::shared_ptr<Mesh> Mesh::genIcosphere (size_t subdivisions, float radius, size_t levelCount) {
+    return std::make_shared<Mesh> (GeometryCache::get ({GeometryCache::Icosphere, subdivisions, radius, 0.f, levelCount},
+        [=] (Geometry & g) {
+            buildLevels (g, icosphereResolutionPerFrequency << subdivisions, levelCount,
+                         [] (size_t r) { return icosphereFrequencySize (r / icosphereResolutionPerFrequency); },
+                         [=] (size_t r, const GeometryView & view) { fillIcosphereFrequency (r / icosphereResolutionPerFrequency, radius, view); });
+        }));
+}
+
+/*
+ * Exact sizes of the generated shapes
+ */
+
+GeometrySize Mesh::sphereSize (size_t N) {
+    return ParametricGrid::size<SphereSurface> (N, N);
+}
+
+GeometrySize Mesh::coneSize (size_t N) {
+    return ParametricGrid::size<ConeSurface> (N, 3); // Base center, base ring twice and tip
+}
+
+GeometrySize Mesh::cylinderSize (size_t N) {
+    return ParametricGrid::size<CylinderSurface> (N, 5); // Two centers and two rings, each twice
+}
+
+GeometrySize Mesh::cubeSize () {
+    return { 8, 36 };
+}
+
+GeometrySize Mesh::torusSize (size_t N) {
+    return ParametricGrid::size<TorusSurface> (N, N);
+}
+
+GeometrySize Mesh::icosphereSize (size_t subdivisions) {
+    return icosphereFrequencySize (size_t (1) << subdivisions);
+}
+
+// 12 corners, n-1 vertices inside each of the 30 edges and (n-1)(n-2)/2 inside each of the 20 faces; n^2 triangles per face
+GeometrySize Mesh::icosphereFrequencySize (size_t n) {
+    return { 10*n*n + 2, 60*n*n };
+}
+
+/*
+ * Generators: each writes exactly the number of elements given by its size function
+ */
 
-    return cube;
+void Mesh::fillSphere (size_t resolution, float radius, const GeometryView & sphere) {
+    SphereSurface surface;
+    surface.radius = radius;
+    ParametricGrid::fill (surface, resolution, resolution, sphere);
 }
 
-std::shared_ptr<Mesh> Mesh::genTorus (size_t resolution) {
-    std::shared_ptr<Mesh> torus = std::make_shared<Mesh>();
+void Mesh::fillCone (size_t resolution, const GeometryView & cone) {
+    ParametricGrid::fill (ConeSurface (), resolution, 3, cone);
+}
 
-    int N = resolution;
-    float a = 0.2;
-    float b = 1.0 - a;
-    float theta, fi;
-    float x, y, z;
-    const float pi = 3.14159;
+void Mesh::fillCylinder (size_t resolution, const GeometryView & cylinder) {
+    ParametricGrid::fill (CylinderSurface (), resolution, 5, cylinder);
+}
 
-    for (int j = 0; j < N; j++) {
-        for (int i = 0; i < N; i++) {
-            theta = i*2*pi/N;
-            fi = j*2*pi/N;
+void Mesh::fillCube (const GeometryView & cube) {
+    StaticPrimitives::fillCube (cube);
+}
 
-            x = (b + a*cos(fi))*cos(theta);
-            y = (b + a*cos(fi))*sin(theta);
-            z = a*sin(fi);
+void Mesh::fillTorus (size_t resolution, float minorRadius, const GeometryView & torus) {
+    TorusSurface surface;
+    surface.minorRadius = minorRadius;
+    ParametricGrid::fill (surface, resolution, resolution, torus);
+}
 
-            torus->vertexPositions.push_back(x);
-            torus->vertexPositions.push_back(y);
-            torus->vertexPositions.push_back(z);
-            torus->vertexColors.push_back(0.f);
-            torus->vertexColors.push_back(1.f);
-            torus->vertexColors.push_back(0.f);
+/*
+ * Icosphere
+ */
+
+// Regular icosahedron, its faces counterclockwise seen from outside
+static const float icosahedronCorners[12][3] = {
+    { -1.f,  1.618034f, 0.f }, {  1.f,  1.618034f, 0.f }, { -1.f, -1.618034f, 0.f }, {  1.f, -1.618034f, 0.f },
+    { 0.f, -1.f,  1.618034f }, { 0.f,  1.f,  1.618034f }, { 0.f, -1.f, -1.618034f }, { 0.f,  1.f, -1.618034f },
+    {  1.618034f, 0.f, -1.f }, {  1.618034f, 0.f,  1.f }, { -1.618034f, 0.f, -1.f }, { -1.618034f, 0.f,  1.f }
+};
+
+static const unsigned int icosahedronFaces[20][3] = {
+    { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+    { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+    { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+    { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+};
+
+// The 30 edges of the icosahedron, lowest corner first. The vertices inside an edge belong to it
+// rather than to the two faces along it, so that they are generated and numbered once: this fixed
+// table stands for the edge-midpoint map of a recursive subdivision, and needs no allocation.
+struct IcosahedronEdges {
+    unsigned int corners[30][2];
+
+    IcosahedronEdges () {
+        size_t count = 0;
+        for (const unsigned int * face : icosahedronFaces) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int a = std::min (face[k], face[(k+1) % 3]), b = std::max (face[k], face[(k+1) % 3]);
+                if (find (a, b, count) == count) {
+                    corners[count][0] = a;
+                    corners[count][1] = b;
+                    count++;
+                }
+            }
         }
     }
 
-    for (int t = 0; t < (N-1)*(N-1); t++) {
-        torus->triangleIndices.push_back(t);
-        torus->triangleIndices.push_back(t+1);
-        torus->triangleIndices.push_back(t+N);
-        torus->triangleIndices.push_back(t+1);
-        torus->triangleIndices.push_back(t+1+N);
-        torus->triangleIndices.push_back(t+N);
+    size_t find (unsigned int a, unsigned int b, size_t count = 30) const {
+        size_t e = 0;
+        while (e < count && !(corners[e][0] == std::min (a, b) && corners[e][1] == std::max (a, b)))
+            e++;
+        return e;
     }
+};
+
+static const IcosahedronEdges & icosahedronEdges () {
+    static const IcosahedronEdges edges;
+    return edges;
+}
+
+static glm::vec3 icosahedronCorner (unsigned int c) {
+    return glm::normalize (glm::vec3 (icosahedronCorners[c][0], icosahedronCorners[c][1], icosahedronCorners[c][2]));
+}
+
+// Point at t along the great circle from a to b, both unit vectors
+static glm::vec3 slerp (const glm::vec3 & a, const glm::vec3 & b, float t) {
+    float angle = std::acos (glm::clamp (glm::dot (a, b), -1.f, 1.f));
+    if (angle < 1e-6f)
+        return a;
+    return (std::sin ((1.f - t) * angle) * a + std::sin (t * angle) * b) / std::sin (angle);
+}
 
-    return torus;
-}
\ No newline at end of file
+// Index of the vertex t steps from corner a along the edge to corner b, at frequency n
+static unsigned int icosphereEdgeVertex (unsigned int a, unsigned int b, size_t t, size_t n) {
+    const IcosahedronEdges & edges = icosahedronEdges ();
+    size_t e = edges.find (a, b);
+    size_t step = edges.corners[e][0] == a ? t : n - t;
+    return 12 + e*(n-1) + step - 1;
+}
+
+// Row k of face f, the points at i + j = k from its first corner, j going from the edge toward the
+// second corner (j = 0) to the edge toward the third (j = k). Inside the row the vertices are
+// consecutive, so the triangles need no lookup per index.
+struct IcosphereRow {
+    size_t length; // Last j
+    unsigned int first; // Vertices at j = 0 and j = length
+    unsigned int last;
+    unsigned int inner; // Vertex at j = 1
+    int step; // From one inner vertex to the next
+
+    unsigned int at (size_t j) const {
+        return j == 0 ? first : (j == length ? last : inner + step * int (j - 1));
+    }
+};
+
+static IcosphereRow icosphereRow (size_t f, size_t k, size_t n) {
+    const unsigned int * face = icosahedronFaces[f];
+    IcosphereRow row = { k, face[0], face[0], 0, 1 };
+    if (k == n) { // On the edge opposite the first corner
+        row.first = face[1];
+        row.last = face[2];
+        row.inner = icosphereEdgeVertex (face[1], face[2], 1, n);
+        row.step = face[1] < face[2] ? 1 : -1; // Edges are numbered from their lowest corner
+    } else if (k > 0) {
+        row.first = icosphereEdgeVertex (face[0], face[1], k, n);
+        row.last = icosphereEdgeVertex (face[0], face[2], k, n);
+        row.inner = 12 + 30*(n-1) + f*(n-1)*(n-2)/2 + (k-1)*(k-2)/2; // Rows before hold k-1 points each
+    }
+    return row;
+}
+
+// Vertex v at the unit vector p, which is also its normal. Same colors as the UV sphere,
+// 0.5 - 0.5 cos (6 latitude), written as a polynomial of cos^2 (latitude) = 1 - z^2.
+static void writeIcosphereVertex (const glm::vec3 & p, float radius, const GeometryView & out, size_t v) {
+    float w = 1.f - p.z * p.z;
+    for (int c = 0; c < 3; c++) {
+        out.positions[3*v + c] = radius * p[c];
+        out.normals[3*v + c] = p[c];
+    }
+    out.colors[3*v] = 1.f;
+    out.colors[3*v + 1] = 0.f;
+    out.colors[3*v + 2] = 0.5f - 0.5f * (((32.f * w - 48.f) * w + 18.f) * w - 1.f);
+}
+
+void Mesh::fillIcosphere (size_t subdivisions, float radius, const GeometryView & icosphere) {
+    fillIcosphereFrequency (size_t (1) << subdivisions, radius, icosphere);
+}
+
+// Each face is cut into a triangular grid of n steps per side, bent onto the sphere along great
+// circles: the rows follow the two edges from the first corner, and each row is a great circle
+// arc from one edge to the other. This spreads the area more evenly than projecting a flat grid.
+void Mesh::fillIcosphereFrequency (size_t n, float radius, const GeometryView & icosphere) {
+    const IcosahedronEdges & edges = icosahedronEdges ();
+    for (unsigned int c = 0; c < 12; c++)
+        writeIcosphereVertex (icosahedronCorner (c), radius, icosphere, c);
+    for (size_t e = 0; e < 30; e++) {
+        glm::vec3 a = icosahedronCorner (edges.corners[e][0]), b = icosahedronCorner (edges.corners[e][1]);
+        for (size_t t = 1; t < n; t++) {
+            size_t v = 12 + e*(n-1) + t-1;
+            writeIcosphereVertex (slerp (a, b, float (t) / n), radius, icosphere, v);
+        }
+    }
+
+    // The faces write disjoint slices, their inner vertices and their triangles
+    auto faces = [&] (size_t first, size_t last) {
+        for (size_t f = first; f < last; f++) {
+            const unsigned int * face = icosahedronFaces[f];
+            glm::vec3 a = icosahedronCorner (face[0]), b = icosahedronCorner (face[1]), c = icosahedronCorner (face[2]);
+            for (size_t k = 2; k < n; k++) { // Row k = i + j, an arc from the a-b edge to the a-c edge
+                glm::vec3 start = slerp (a, b, float (k) / n), end = slerp (a, c, float (k) / n);
+                // Equal steps of the arc, by rotating (cos, sin) rather than evaluating them at each point
+                float step = std::acos (glm::clamp (glm::dot (start, end), -1.f, 1.f)) / k;
+                glm::vec3 normal = glm::normalize (end - glm::dot (start, end) * start); // Unit, orthogonal to start, in the plane of the arc
+                float stepCos = std::cos (step), stepSin = std::sin (step);
+                float cosAngle = stepCos, sinAngle = stepSin;
+                size_t v = icosphereRow (f, k, n).inner;
+                for (size_t j = 1; j < k; j++, v++) {
+                    writeIcosphereVertex (cosAngle * start + sinAngle * normal, radius, icosphere, v);
+                    float nextCos = cosAngle * stepCos - sinAngle * stepSin;
+                    sinAngle = sinAngle * stepCos + cosAngle * stepSin;
+                    cosAngle = nextCos;
+                }
+            }
+
+            unsigned int * index = icosphere.indices + 3*n*n*f;
+            IcosphereRow next = icosphereRow (f, 0, n);
+            for (size_t k = 0; k < n; k++) {
+                IcosphereRow row = next;
+                next = icosphereRow (f, k + 1, n);
+                for (size_t j = 0; j <= k; j++) {
+                    *index++ = row.at (j); // Pointing away from the first corner
+                    *index++ = next.at (j);
+                    *index++ = next.at (j + 1);
+                    if (j < k) { // Pointing toward it
+                        *index++ = row.at (j);
+                        *index++ = next.at (j + 1);
+                        *index++ = row.at (j + 1);
+                    }
+                }
+            }
+        }
+    };
+    if (icosphereFrequencySize (n).indexCount >= 3*parallelIcosphereTriangles)
+        ThreadPool::instance ().parallelFor (0, 20, faces);
+    else
+        faces (0, 20);
+}
@@ -4,36 +4,175 @@
 #define _USE_MATH_DEFINES
 
 #include <glad/glad.h>
+#include <functional>
 #include <vector>
 #include <memory>
+#include <limits>
+#include <string>
 
 #include "Transform.hpp"
+#include "Geometry.hpp"
+#include "ParametricSurface.hpp"
+#include "Isosurface.hpp"
 
+// A Mesh is a lightweight instance: its own Transform, plus a Geometry that is
+// shared with every other Mesh generated with the same shape and parameters.
 class Mesh : public Transform {
 public:
 
-	static std::shared_ptr<Mesh> genSphere (size_t resolution = 16);
-	static std::shared_ptr<Mesh> genCone (size_t resolution = 16);
-	static std::shared_ptr<Mesh> genCylinder (size_t resolution = 16);
+	Mesh (std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> ());
+
+	// With levelCount > 1, the geometry also holds coarser copies of the shape, halving the resolution
+	// each time (down to 4), and render (view, projection) picks one from the projected size of the mesh.
+	// The cube, and single-level cones and cylinders of resolution 4, 8, 16 or 32, come from tables built
+	// at compile time (see StaticPrimitives.hpp), as packed data: the CPU passes below unpack it first.
+	static std::shared_ptr<Mesh> genSphere (size_t resolution = 16, float radius = 1.f, size_t levelCount = 1);
+	static std::shared_ptr<Mesh> genCone (size_t resolution = 16, size_t levelCount = 1);
+	static std::shared_ptr<Mesh> genCylinder (size_t resolution = 16, size_t levelCount = 1);
 	static std::shared_ptr<Mesh> genCube (size_t resolution = 16);
-	static std::shared_ptr<Mesh> genTorus (size_t resolution = 16);
+	static std::shared_ptr<Mesh> genTorus (size_t resolution = 16, float minorRadius = 0.2f, size_t levelCount = 1);
+
+	// Sphere made of the 20 faces of an icosahedron, each cut into 4^subdivisions triangles of nearly
+	// equal area: none of the slivers a UV sphere crowds at its poles. Its levels halve the frequency
+	// (2^subdivisions cuts per edge), and are selected like those of a UV sphere of 6 times that resolution.
+	static std::shared_ptr<Mesh> genIcosphere (size_t subdivisions = 3, float radius = 1.f, size_t levelCount = 1);
+
+	// Any surface given as a functor type (see ParametricSurface.hpp), on a grid of resolution x resolution
+	// cells, with levels as above. The functor is compiled into the grid generator the shapes above share.
+	// Not cached: every call builds its own geometry.
+	template<typename Surface>
+	static std::shared_ptr<Mesh> genParametric (const Surface & surface, size_t resolution = 16, size_t levelCount = 1);
+
+	// Surface where a scalar field sampled on a grid crosses isoValue, by marching cubes (see
+	// Isosurface.hpp), with normals from the gradient of the field. nullptr on failure.
+	static std::shared_ptr<Mesh> fromVolume (const VolumeGrid & grid, float isoValue = 0.f);
+
+	// Same for a field given as a functor float (const glm::vec3 &), a signed distance for instance,
+	// sampled at the corners of resolution^3 cells filling the box from minCorner to maxCorner
+	template<typename Field>
+	static std::shared_ptr<Mesh> fromVolume (const Field & field, const glm::vec3 & minCorner, const glm::vec3 & maxCorner,
+	                                         size_t resolution, float isoValue = 0.f);
+
+	// Exact vertex and index counts of each shape, so that callers can provide the storage
+	static GeometrySize sphereSize (size_t resolution);
+	static GeometrySize coneSize (size_t resolution);
+	static GeometrySize cylinderSize (size_t resolution);
+	static GeometrySize cubeSize ();
+	static GeometrySize torusSize (size_t resolution);
+	static GeometrySize icosphereSize (size_t subdivisions);
+
+	// Allocation-free generators, writing into caller-provided arrays sized by the functions above
+	static void fillSphere (size_t resolution, float radius, const GeometryView & out);
+	static void fillCone (size_t resolution, const GeometryView & out);
+	static void fillCylinder (size_t resolution, const GeometryView & out);
+	static void fillCube (const GeometryView & out);
+	static void fillTorus (size_t resolution, float minorRadius, const GeometryView & out);
+	static void fillIcosphere (size_t subdivisions, float radius, const GeometryView & out);
+
+	std::shared_ptr<Geometry> getGeometry () const;
+
+	// Writes the geometry to a binary cache file (see GeometryFile.hpp), and maps one back. A loaded
+	// geometry is uploaded straight from the file; the CPU passes below decode it into CPU streams first.
+	// A compressed file is decoded at load time, see MeshCodec.hpp.
+	bool save (const std::string & filename, bool compressed = false) const;
+	static std::shared_ptr<Mesh> load (const std::string & filename); // nullptr on failure
+
+	// Reads a Wavefront OBJ file in parallel (see ObjLoader.hpp). nullptr on failure.
+	static std::shared_ptr<Mesh> loadOBJ (const std::string & filename);
+
+	// Maps a binary PLY or STL file (see PlyLoader.hpp and StlLoader.hpp). nullptr on failure.
+	// With directUpload, PLY vertices already in a GPU layout are uploaded as they are.
+	static std::shared_ptr<Mesh> loadPLY (const std::string & filename, bool directUpload = true);
+	static std::shared_ptr<Mesh> loadSTL (const std::string & filename);
+
+	// Maps a binary glTF file (see GltfLoader.hpp): one Mesh per primitive of each node, placed by the
+	// node transforms, reading the buffer views of the file in place. Empty on failure.
+	static std::vector<std::shared_ptr<Mesh>> loadGLB (const std::string & filename);
+
+	// The CPU passes below rewrite the geometry of this mesh alone: one shared with other meshes is
+	// copied first, and one from the GeometryCache leaves the cache, so that later gen* calls build
+	// an unchanged one. Packed data is decoded into the CPU streams first (see Geometry::unpack); a
+	// geometry read from buffer views (loadGLB) is refused with an error. They must be called before init.
+
+	// Reorders the triangles of the geometry for the post-transform vertex cache, then the vertices
+	// in first-use order, and prints the average cache miss ratio (ACMR) and transformed vertex
+	// ratio (ATVR) before and after. Clears the meshlets.
+	void optimizeVertexCache ();
+
+	// Welds the vertices whose attributes agree within tolerance, removes degenerate and repeated
+	// triangles and stores the vertices in first-use order. Clears the meshlets, and prints the memory saved.
+	void compact (float tolerance = 1e-6f);
+
+	// Decimates the finest level of the geometry with quadric edge collapses, until it has at most
+	// targetTriangleCount triangles or the next collapse would move the surface by more than targetError
+	// (relative to the size of the mesh). Vertices are kept, not moved, so colors carry over. Replaces
+	// the levels and meshlets, and prints the triangle counts and the error reached.
+	void simplify (size_t targetTriangleCount, float targetError = std::numeric_limits<float>::max ());
+
+	// Rebuilds the levels of detail from the finest level: each new level halves the triangle count
+	// of the previous one, and is meant for screen sizes where its error stays below half a pixel.
+	void simplifyLevels (size_t levelCount);
+
+	// Refines the finest level of the geometry with levelCount passes of Loop subdivision (see
+	// MeshSubdivider.hpp), each splitting every triangle in four, so that a coarse control mesh can
+	// be shipped and refined on load. Replaces the levels and meshlets, and prints the triangle counts.
+	void subdivide (size_t levelCount = 1);
+
+	// Replaces the normals of the geometry with smooth ones, area-weighted over the triangles around
+	// each vertex (see MeshNormals.hpp). The loaders call it on files without normals, and the
+	// generators write exact ones.
+	void computeNormals ();
+
+	// Splits the geometry into meshlets, so that render (view, projection) can skip the clusters
+	// outside the frustum or facing away from the camera. To be called after optimizeVertexCache
+	// and compact, which clear the meshlets.
+	void buildMeshlets (size_t maxVertices = 64, size_t maxTriangles = 124);
 
     void init();
 	void render();
-	void clear();
+	void render(const glm::mat4 & viewMatrix, const glm::mat4 & projectionMatrix); // Selects the level of detail and culls meshlets first, if any
+	void clear(); // Matches an init: the GPU buffers of a shared geometry go with the last mesh clearing them
+
+	size_t getLevel () const; // Level of detail drawn by the last render (view, projection)
 
 private:
 
-	void initGPUGeometry();
+	static GeometrySize icosphereFrequencySize (size_t frequency);
+	static void fillIcosphereFrequency (size_t frequency, float radius, const GeometryView & out);
+	static void buildLevels (Geometry & geometry, size_t resolution, size_t levelCount,
+	                         const std::function<GeometrySize (size_t)> & size, const std::function<void (size_t, const GeometryView &)> & fill);
+	size_t selectLevel (const glm::mat4 & modelViewMatrix, const glm::mat4 & projectionMatrix) const;
+	bool detachGeometry (); // Gives the mesh a geometry no one else sees, in CPU streams, before a CPU pass. False if there can be none.
 
-	std::vector<float> vertexPositions;
-	std::vector<float> vertexColors;
-	std::vector<unsigned int> triangleIndices;
+	std::shared_ptr<Geometry> geometry;
+	size_t level = 0;
 
-	GLuint posVbo; 
-	GLuint colVbo; 
-	GLuint ibo;
-	GLuint vao;
+	std::vector<GLsizei> drawCounts; // Index ranges of the visible meshlets, reused from frame to frame
+	std::vector<const void *> drawOffsets;
 };
 
-#endif //_MESH_H
\ No newline at end of file
+template<typename Surface>
+std::shared_ptr<Mesh> Mesh::genParametric (const Surface & surface, size_t resolution, size_t levelCount) {
+	std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> ();
+	buildLevels (*geometry, resolution, levelCount,
+	             [] (size_t r) { return ParametricGrid::size<Surface> (r, r); },
+	             [&] (size_t r, const GeometryView & view) { ParametricGrid::fill (surface, r, r, view); });
+	return std::make_shared<Mesh> (geometry);
+}
+
+template<typename Field>
+std::shared_ptr<Mesh> Mesh::fromVolume (const Field & field, const glm::vec3 & minCorner, const glm::vec3 & maxCorner,
+                                        size_t resolution, float isoValue) {
+	VolumeGrid grid;
+	grid.sizeX = grid.sizeY = grid.sizeZ = resolution + 1;
+	grid.origin = minCorner;
+	grid.spacing = (maxCorner - minCorner) / float (resolution);
+	grid.sampleLayer = [&field, &grid] (size_t z, float * layer) {
+		for (size_t y = 0; y < grid.sizeY; y++)
+			for (size_t x = 0; x < grid.sizeX; x++)
+				*layer++ = field (grid.origin + grid.spacing * glm::vec3 (x, y, z));
+	};
+	return fromVolume (grid, isoValue);
+}
+
+#endif //_MESH_H
@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "MeshCodec.hpp"
+#include "ThreadPool.hpp"
+
+/* Both streams: a chunk count, the offsets of the chunks and of the end (from the start of the
+   stream), then the chunks */
+
+static const size_t chunkVertices = 8192; // Multiple of groupVertices
+static const size_t groupVertices = 16;
+static const size_t maxStride = 256;
+static const size_t chunkTriangles = 16384;
+static const unsigned char laneBits[4] = { 0, 2, 4, 8 }; // Header code of a lane in a group -> bits per value
+
+static const unsigned int edgeNone = 15; // High nibble of a triangle code: no recent edge, three explicit indices
+static const unsigned int thirdNext = 0; // Low nibble: the third vertex is the next new one,
+static const unsigned int thirdRecent = 1; // one of the 12 recent third vertices (1..12),
+static const unsigned int thirdAfterFirst = 13; // follows the first vertex of the edge,
+static const unsigned int thirdAfterSecond = 14; // follows the second one,
+static const unsigned int thirdExplicit = 15; // or is coded explicitly, relative to the first one
+
+static void putWord (std::vector<unsigned char> & out, size_t at, uint32_t word) {
+    std::memcpy (&out[at], &word, sizeof (word));
+}
+
+static uint32_t getWord (const unsigned char * at) {
+    uint32_t word;
+    std::memcpy (&word, at, sizeof (word));
+    return word;
+}
+
+// Concatenates the chunks behind their offset table; empty if the offsets overflow
+static std::vector<unsigned char> joinChunks (const std::vector<std::vector<unsigned char>> & chunks) {
+    size_t tableBytes = sizeof (uint32_t) * (chunks.size () + 2);
+    size_t size = tableBytes;
+    for (const std::vector<unsigned char> & chunk : chunks)
+        size += chunk.size ();
+    if (size > UINT32_MAX)
+        return std::vector<unsigned char> ();
+    std::vector<unsigned char> out (size);
+    putWord (out, 0, static_cast<uint32_t> (chunks.size ()));
+    size_t offset = tableBytes;
+    for (size_t c = 0; c < chunks.size (); c++) {
+        putWord (out, sizeof (uint32_t) * (c + 1), static_cast<uint32_t> (offset));
+        std::memcpy (out.data () + offset, chunks[c].data (), chunks[c].size ());
+        offset += chunks[c].size ();
+    }
+    putWord (out, sizeof (uint32_t) * (chunks.size () + 1), static_cast<uint32_t> (offset));
+    return out;
+}
+
+// Checks the offset table of a stream of chunkCount chunks
+static bool validChunks (const unsigned char * data, size_t size, size_t chunkCount) {
+    size_t tableBytes = sizeof (uint32_t) * (chunkCount + 2);
+    if (size < tableBytes || getWord (data) != chunkCount)
+        return false;
+    for (size_t c = 0; c <= chunkCount; c++) {
+        uint32_t offset = getWord (data + sizeof (uint32_t) * (c + 1));
+        uint32_t previous = c == 0 ? uint32_t (tableBytes) : getWord (data + sizeof (uint32_t) * c);
+        if (offset < previous || offset > size)
+            return false;
+    }
+    return true;
+}
+
+// Decodes the chunks in parallel; decodeChunk (c, begin, end) returns false on malformed data
+template <typename DecodeChunk>
+static bool decodeChunks (const unsigned char * data, size_t chunkCount, const DecodeChunk & decodeChunk) {
+    std::atomic<bool> valid (true);
+    ThreadPool::instance ().parallelFor (0, chunkCount, [&] (size_t first, size_t last) {
+        for (size_t c = first; c < last && valid.load (std::memory_order_relaxed); c++) {
+            const unsigned char * begin = data + getWord (data + sizeof (uint32_t) * (c + 1));
+            const unsigned char * end = data + getWord (data + sizeof (uint32_t) * (c + 2));
+            if (!decodeChunk (c, begin, end))
+                valid = false;
+        }
+    });
+    return valid;
+}
+
+/* Vertices: per group of 16 vertices, the 2-bit codes of the lanes, then the bit-packed values of
+   each lane, a value of 2 or 4 bits being stored from the low bits of the bytes up */
+
+static unsigned char zigzag (unsigned char delta) {
+    return static_cast<unsigned char> ((delta << 1) ^ (static_cast<signed char> (delta) >> 7));
+}
+
+static void encodeGroup (const unsigned char * vertices, size_t count, size_t stride, unsigned char * last, std::vector<unsigned char> & out) {
+    size_t headerAt = out.size ();
+    out.resize (headerAt + (stride + 3) / 4, 0);
+    for (size_t k = 0; k < stride; k++) {
+        unsigned char values[groupVertices];
+        unsigned char previous = last[k], largest = 0;
+        for (size_t i = 0; i < groupVertices; i++) {
+            unsigned char value = vertices[std::min (i, count - 1) * stride + k]; // The last vertex is repeated to fill the group
+            values[i] = zigzag (static_cast<unsigned char> (value - previous));
+            largest = std::max (largest, values[i]);
+            previous = value;
+        }
+        last[k] = previous;
+        unsigned int code = largest == 0 ? 0 : largest < 4 ? 1 : largest < 16 ? 2 : 3;
+        out[headerAt + k / 4] |= static_cast<unsigned char> (code << (2 * (k % 4)));
+        unsigned int bits = laneBits[code];
+        for (size_t i = 0; i < groupVertices && bits > 0; i += 8 / bits) {
+            unsigned char packed = 0;
+            for (size_t j = 0; j < 8 / bits; j++)
+                packed |= static_cast<unsigned char> (values[i + j] << (j * bits));
+            out.push_back (packed);
+        }
+    }
+}
+
+std::vector<unsigned char> MeshCodec::encodeVertices (const void * vertices, size_t count, size_t stride) {
+    if (stride == 0 || stride % 4 != 0 || stride > maxStride)
+        return std::vector<unsigned char> ();
+    const unsigned char * bytes = static_cast<const unsigned char *> (vertices);
+    std::vector<std::vector<unsigned char>> chunks ((count + chunkVertices - 1) / chunkVertices);
+    ThreadPool::instance ().parallelFor (0, chunks.size (), [&] (size_t first, size_t last) {
+        for (size_t c = first; c < last; c++) {
+            unsigned char previous[maxStride] = {};
+            size_t end = std::min (count, (c + 1) * chunkVertices);
+            for (size_t v = c * chunkVertices; v < end; v += groupVertices)
+                encodeGroup (bytes + v * stride, std::min (groupVertices, end - v), stride, previous, chunks[c]);
+        }
+    });
+    return joinChunks (chunks);
+}
+
+#if defined(__SSE2__)
+// The 16 values of a lane: unpacked, unzigzagged, and summed from the last value of the previous group
+static __m128i decodeLane (const unsigned char * & data, unsigned int code, __m128i previous) {
+    __m128i last = _mm_shufflehi_epi16 (_mm_unpackhi_epi8 (previous, previous), _MM_SHUFFLE (3, 3, 3, 3));
+    last = _mm_unpackhi_epi64 (last, last); // The 16th value, broadcast
+    __m128i values;
+    if (code == 3) {
+        values = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (data));
+        data += 16;
+    } else if (code == 2) {
+        __m128i packed = _mm_loadl_epi64 (reinterpret_cast<const __m128i *> (data));
+        __m128i nibble = _mm_set1_epi8 (0x0F);
+        values = _mm_unpacklo_epi8 (_mm_and_si128 (packed, nibble), _mm_and_si128 (_mm_srli_epi16 (packed, 4), nibble));
+        data += 8;
+    } else if (code == 1) {
+        uint32_t word = getWord (data);
+        __m128i packed = _mm_cvtsi32_si128 (static_cast<int> (word));
+        __m128i pair = _mm_set1_epi8 (0x03);
+        __m128i v0 = _mm_and_si128 (packed, pair), v1 = _mm_and_si128 (_mm_srli_epi16 (packed, 2), pair);
+        __m128i v2 = _mm_and_si128 (_mm_srli_epi16 (packed, 4), pair), v3 = _mm_and_si128 (_mm_srli_epi16 (packed, 6), pair);
+        values = _mm_unpacklo_epi16 (_mm_unpacklo_epi8 (v0, v1), _mm_unpacklo_epi8 (v2, v3));
+        data += 4;
+    } else {
+        return last; // The lane did not change
+    }
+    __m128i sign = _mm_sub_epi8 (_mm_setzero_si128 (), _mm_and_si128 (values, _mm_set1_epi8 (1)));
+    values = _mm_xor_si128 (_mm_and_si128 (_mm_srli_epi16 (values, 1), _mm_set1_epi8 (0x7F)), sign);
+    values = _mm_add_epi8 (values, _mm_slli_si128 (values, 1));
+    values = _mm_add_epi8 (values, _mm_slli_si128 (values, 2));
+    values = _mm_add_epi8 (values, _mm_slli_si128 (values, 4));
+    values = _mm_add_epi8 (values, _mm_slli_si128 (values, 8));
+    return _mm_add_epi8 (values, last);
+}
+#endif
+
+// Decodes a group of count vertices into out; lanes holds the 16 values of each lane of the
+// previous group. Returns false if the group runs past end.
+static bool decodeGroup (const unsigned char * & data, const unsigned char * end, size_t stride, size_t count,
+                         unsigned char (* lanes)[groupVertices], unsigned char * out) {
+    size_t quadCount = stride / 4, groupBytes = quadCount; // One header byte per four lanes
+    if (size_t (end - data) < quadCount)
+        return false;
+    const unsigned char * header = data;
+    for (size_t q = 0; q < quadCount; q++) {
+        for (int j = 0; j < 4; j++)
+            groupBytes += 2 * laneBits[(header[q] >> (2 * j)) & 3];
+    }
+    if (size_t (end - data) < groupBytes)
+        return false;
+    data += quadCount;
+#if defined(__SSE2__)
+    // Four lanes at a time, transposed into one 4-byte word per vertex: words[q][r] holds the lanes
+    // 4q .. 4q + 3 of the vertices 4r .. 4r + 3. The quads are padded to a multiple of four.
+    __m128i words[maxStride / 4][4];
+    for (size_t q = 0; q < quadCount; q++) {
+        __m128i lane[4];
+        for (size_t j = 0; j < 4; j++) {
+            __m128i previous = _mm_load_si128 (reinterpret_cast<const __m128i *> (lanes[4 * q + j]));
+            lane[j] = decodeLane (data, (header[q] >> (2 * j)) & 3, previous);
+            _mm_store_si128 (reinterpret_cast<__m128i *> (lanes[4 * q + j]), lane[j]);
+        }
+        __m128i low01 = _mm_unpacklo_epi8 (lane[0], lane[1]), high01 = _mm_unpackhi_epi8 (lane[0], lane[1]);
+        __m128i low23 = _mm_unpacklo_epi8 (lane[2], lane[3]), high23 = _mm_unpackhi_epi8 (lane[2], lane[3]);
+        words[q][0] = _mm_unpacklo_epi16 (low01, low23);
+        words[q][1] = _mm_unpackhi_epi16 (low01, low23);
+        words[q][2] = _mm_unpacklo_epi16 (high01, high23);
+        words[q][3] = _mm_unpackhi_epi16 (high01, high23);
+    }
+    for (size_t q = quadCount; q % 4 != 0; q++)
+        words[q][0] = words[q][1] = words[q][2] = words[q][3] = _mm_setzero_si128 ();
+
+    // A 4x4 transpose of the words of four quads gives 16 bytes of four records. The bytes of the
+    // last block past the end of a record land on the next records, written over afterwards: only
+    // the last records of the group need to be stored word by word.
+    size_t blockCount = (quadCount + 3) / 4;
+    for (size_t r = 0; r < 4 && 4 * r < count; r++) {
+        __m128i records[maxStride / 16][4];
+        for (size_t b = 0; b < blockCount; b++) {
+            const __m128i (* w)[4] = words + 4 * b;
+            __m128i low01 = _mm_unpacklo_epi32 (w[0][r], w[1][r]), low23 = _mm_unpacklo_epi32 (w[2][r], w[3][r]);
+            __m128i high01 = _mm_unpackhi_epi32 (w[0][r], w[1][r]), high23 = _mm_unpackhi_epi32 (w[2][r], w[3][r]);
+            records[b][0] = _mm_unpacklo_epi64 (low01, low23);
+            records[b][1] = _mm_unpackhi_epi64 (low01, low23);
+            records[b][2] = _mm_unpacklo_epi64 (high01, high23);
+            records[b][3] = _mm_unpackhi_epi64 (high01, high23);
+        }
+        for (size_t j = 0; j < 4 && 4 * r + j < count; j++) {
+            size_t i = 4 * r + j;
+            for (size_t b = 0; b < blockCount; b++) {
+                size_t k = 16 * b;
+                if (i * stride + k + 16 <= count * stride) {
+                    _mm_storeu_si128 (reinterpret_cast<__m128i *> (out + i * stride + k), records[b][j]);
+                } else {
+                    __m128i record = records[b][j];
+                    for (; k < stride; k += 4) {
+                        int word = _mm_cvtsi128_si32 (record);
+                        std::memcpy (out + i * stride + k, &word, sizeof (word));
+                        record = _mm_srli_si128 (record, 4);
+                    }
+                }
+            }
+        }
+    }
+#else
+    for (size_t k = 0; k < stride; k++) {
+        unsigned int bits = laneBits[(header[k / 4] >> (2 * (k % 4))) & 3];
+        unsigned char value = lanes[k][groupVertices - 1];
+        for (size_t i = 0; i < groupVertices; i++) {
+            unsigned char delta = 0;
+            if (bits > 0)
+                delta = (data[i * bits / 8] >> (i * bits % 8)) & ((1u << bits) - 1);
+            value = static_cast<unsigned char> (value + ((delta >> 1) ^ -(delta & 1)));
+            lanes[k][i] = value;
+        }
+        data += 2 * bits;
+        for (size_t i = 0; i < count; i++)
+            out[i * stride + k] = lanes[k][i];
+    }
+#endif
+    return true;
+}
+
+bool MeshCodec::decodeVertices (void * out, size_t count, size_t stride, const unsigned char * data, size_t size) {
+    size_t chunkCount = (count + chunkVertices - 1) / chunkVertices;
+    if (stride == 0 || stride % 4 != 0 || stride > maxStride || !validChunks (data, size, chunkCount))
+        return false;
+    unsigned char * bytes = static_cast<unsigned char *> (out);
+    return decodeChunks (data, chunkCount, [&] (size_t c, const unsigned char * begin, const unsigned char * end) {
+        alignas (16) unsigned char lanes[maxStride][groupVertices] = {};
+        size_t last = std::min (count, (c + 1) * chunkVertices);
+        for (size_t v = c * chunkVertices; v < last; v += groupVertices) {
+            if (!decodeGroup (begin, end, stride, std::min (groupVertices, last - v), lanes, bytes + v * stride))
+                return false;
+        }
+        return true;
+    });
+}
+
+/* Indices: one code byte per triangle, the edge in its high nibble and the third vertex in its low
+   one, followed by the varints the code calls for */
+
+// Recent edges, reversed as the next triangles would use them, and recent third vertices
+struct IndexHistory {
+    uint32_t edges[16][2];
+    uint32_t vertices[16];
+    size_t edgeHead = 0, vertexHead = 0;
+    uint32_t next = 0; // Largest index so far, plus one
+
+    IndexHistory (uint32_t next) : next (next) {
+        std::memset (edges, 0xFF, sizeof (edges));
+        std::memset (vertices, 0xFF, sizeof (vertices));
+    }
+
+    const uint32_t * edge (size_t age) const { return edges[(edgeHead - 1 - age) & 15]; }
+    uint32_t vertex (size_t age) const { return vertices[(vertexHead - 1 - age) & 15]; }
+
+    void pushEdge (uint32_t a, uint32_t b) {
+        edges[edgeHead & 15][0] = a;
+        edges[edgeHead & 15][1] = b;
+        edgeHead++;
+    }
+
+    void pushVertex (uint32_t v) {
+        vertices[vertexHead++ & 15] = v;
+        next = std::max (next, v + 1);
+    }
+
+    void pushTriangle (uint32_t a, uint32_t b, uint32_t c) {
+        pushEdge (b, a);
+        pushEdge (c, b);
+        pushEdge (a, c);
+    }
+};
+
+static void putVarint (std::vector<unsigned char> & out, int64_t delta) {
+    uint64_t value = delta < 0 ? (uint64_t (-(delta + 1)) << 1) | 1 : uint64_t (delta) << 1;
+    for (; value >= 0x80; value >>= 7)
+        out.push_back (static_cast<unsigned char> (value | 0x80));
+    out.push_back (static_cast<unsigned char> (value));
+}
+
+static bool getVarint (const unsigned char * & data, const unsigned char * end, uint32_t base, uint32_t & value) {
+    uint64_t zigzag = 0;
+    for (int shift = 0; ; shift += 7) {
+        if (data == end || shift > 35)
+            return false;
+        unsigned char byte = *data++;
+        zigzag |= uint64_t (byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+    int64_t delta = (zigzag & 1) ? -int64_t (zigzag >> 1) - 1 : int64_t (zigzag >> 1);
+    value = static_cast<uint32_t> (base + delta);
+    return true;
+}
+
+static void encodeTriangle (const unsigned int * t, IndexHistory & history, uint32_t & last, std::vector<unsigned char> & out) {
+    for (int rotation = 0; rotation < 3; rotation++) {
+        uint32_t a = t[rotation], b = t[(rotation + 1) % 3], c = t[(rotation + 2) % 3];
+        size_t age = 0;
+        while (age < edgeNone && (history.edge (age)[0] != a || history.edge (age)[1] != b))
+            age++;
+        if (age == edgeNone)
+            continue;
+        unsigned int third = thirdExplicit;
+        if (c == history.next)
+            third = thirdNext;
+        else if (c == a + 1)
+            third = thirdAfterFirst;
+        else if (c == b + 1)
+            third = thirdAfterSecond;
+        else {
+            for (size_t v = 0; v < thirdAfterFirst - thirdRecent; v++) {
+                if (history.vertex (v) == c) {
+                    third = thirdRecent + static_cast<unsigned int> (v);
+                    break;
+                }
+            }
+        }
+        out.push_back (static_cast<unsigned char> ((age << 4) | third));
+        if (third == thirdExplicit)
+            putVarint (out, int64_t (c) - int64_t (a));
+        history.pushTriangle (a, b, c);
+        history.pushVertex (c);
+        last = c;
+        return;
+    }
+    out.push_back (static_cast<unsigned char> (edgeNone << 4));
+    for (int k = 0; k < 3; k++) {
+        putVarint (out, int64_t (t[k]) - int64_t (last));
+        last = t[k];
+        history.pushVertex (t[k]);
+    }
+    history.pushTriangle (t[0], t[1], t[2]);
+}
+
+std::vector<unsigned char> MeshCodec::encodeIndices (const unsigned int * indices, size_t count) {
+    if (count % 3 != 0)
+        return std::vector<unsigned char> ();
+    ThreadPool & pool = ThreadPool::instance ();
+    size_t triangleCount = count / 3;
+    std::vector<std::vector<unsigned char>> chunks ((triangleCount + chunkTriangles - 1) / chunkTriangles);
+
+    // A chunk starts from the largest index of the chunks before it
+    std::vector<uint32_t> next (chunks.size () + 1, 0);
+    pool.parallelFor (0, chunks.size (), [&] (size_t first, size_t last) {
+        for (size_t c = first; c < last; c++) {
+            const unsigned int * begin = indices + 3 * c * chunkTriangles;
+            const unsigned int * end = indices + 3 * std::min (triangleCount, (c + 1) * chunkTriangles);
+            next[c + 1] = *std::max_element (begin, end) + 1;
+        }
+    });
+    for (size_t c = 0; c < chunks.size (); c++)
+        next[c + 1] = std::max (next[c + 1], next[c]);
+
+    pool.parallelFor (0, chunks.size (), [&] (size_t first, size_t last) {
+        for (size_t c = first; c < last; c++) {
+            IndexHistory history (next[c]);
+            uint32_t lastVertex = 0;
+            chunks[c].resize (sizeof (uint32_t));
+            putWord (chunks[c], 0, next[c]);
+            size_t end = std::min (triangleCount, (c + 1) * chunkTriangles);
+            for (size_t t = c * chunkTriangles; t < end; t++)
+                encodeTriangle (indices + 3 * t, history, lastVertex, chunks[c]);
+        }
+    });
+    return joinChunks (chunks);
+}
+
+bool MeshCodec::decodeIndices (unsigned int * out, size_t count, const unsigned char * data, size_t size) {
+    size_t triangleCount = count / 3, chunkCount = (triangleCount + chunkTriangles - 1) / chunkTriangles;
+    if (count % 3 != 0 || !validChunks (data, size, chunkCount))
+        return false;
+    return decodeChunks (data, chunkCount, [&] (size_t c, const unsigned char * begin, const unsigned char * end) {
+        if (size_t (end - begin) < sizeof (uint32_t))
+            return false;
+        IndexHistory history (getWord (begin));
+        begin += sizeof (uint32_t);
+        uint32_t last = 0;
+        unsigned int * t = out + 3 * c * chunkTriangles;
+        unsigned int * tEnd = out + 3 * std::min (triangleCount, (c + 1) * chunkTriangles);
+        for (; t < tEnd; t += 3) {
+            if (begin == end)
+                return false;
+            unsigned char code = *begin++;
+            unsigned int age = code >> 4, third = code & 15;
+            if (age == edgeNone) {
+                for (int k = 0; k < 3; k++) {
+                    if (!getVarint (begin, end, last, t[k]))
+                        return false;
+                    last = t[k];
+                    history.pushVertex (t[k]);
+                }
+                history.pushTriangle (t[0], t[1], t[2]);
+                continue;
+            }
+            const uint32_t * edge = history.edge (age);
+            uint32_t a = edge[0], b = edge[1], v;
+            if (third == thirdNext)
+                v = history.next;
+            else if (third == thirdAfterFirst)
+                v = a + 1;
+            else if (third == thirdAfterSecond)
+                v = b + 1;
+            else if (third == thirdExplicit) {
+                if (!getVarint (begin, end, a, v))
+                    return false;
+            } else
+                v = history.vertex (third - thirdRecent);
+            t[0] = a;
+            t[1] = b;
+            t[2] = v;
+            history.pushTriangle (a, b, v);
+            history.pushVertex (v);
+            last = v;
+        }
+        return begin == end;
+    });
+}
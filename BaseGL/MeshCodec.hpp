@@ -0,0 +1,32 @@
+#ifndef _MESH_CODEC_H
+#define _MESH_CODEC_H
+
+#include <cstddef>
+#include <vector>
+
+// Lossless compression of vertex and index buffers in their GPU format, cut into chunks that
+// decode independently, so that a buffer can be decoded on every thread of the pool at once.
+//
+// Vertices: each byte of the records is a lane; consecutive vertices are delta-encoded lane by
+// lane, zigzagged and bit-packed at 0, 2, 4 or 8 bits per value by groups of 16 vertices. This
+// suits quantized layouts (VertexLayout::compact), whose neighboring vertices differ in their low
+// bytes only; float layouts compress much less. Decoding is vectorized with SSE2.
+//
+// Indices: each triangle is coded relative to the edges of the triangles before it, as the
+// strips of the generators and the vertex cache order produce them: a triangle sharing a recent
+// edge and whose third vertex is new, recent or next to the edge takes one byte. Triangles may
+// come back rotated (same vertices, same winding, another first vertex).
+class MeshCodec {
+public:
+	// Encodes count records of stride bytes; stride must be a multiple of 4
+	static std::vector<unsigned char> encodeVertices (const void * vertices, size_t count, size_t stride);
+	// Decodes into out, which holds count * stride bytes. Returns false if the data is malformed.
+	static bool decodeVertices (void * out, size_t count, size_t stride, const unsigned char * data, size_t size);
+
+	// Encodes count indices, three per triangle
+	static std::vector<unsigned char> encodeIndices (const unsigned int * indices, size_t count);
+	// Decodes into out, which holds count indices. Returns false if the data is malformed.
+	static bool decodeIndices (unsigned int * out, size_t count, const unsigned char * data, size_t size);
+};
+
+#endif //_MESH_CODEC_H
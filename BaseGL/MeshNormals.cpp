@@ -0,0 +1,81 @@
+#include <cmath>
+#include <memory>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "MeshNormals.hpp"
+#include "MeshTopology.hpp"
+#include "ThreadPool.hpp"
+
+#if defined(__SSE2__)
+static inline __m128 loadPoint (const float * p) {
+    return _mm_setr_ps (p[0], p[1], p[2], 0.f);
+}
+
+// a x b, the lanes holding x, y, z and 0
+static inline __m128 cross (__m128 a, __m128 b) {
+    __m128 aYZX = _mm_shuffle_ps (a, a, _MM_SHUFFLE (3, 0, 2, 1));
+    __m128 bYZX = _mm_shuffle_ps (b, b, _MM_SHUFFLE (3, 0, 2, 1));
+    __m128 zxy = _mm_sub_ps (_mm_mul_ps (a, bYZX), _mm_mul_ps (aYZX, b));
+    return _mm_shuffle_ps (zxy, zxy, _MM_SHUFFLE (3, 0, 2, 1));
+}
+#endif
+
+void MeshNormals::compute (Geometry & geometry) {
+    ThreadPool & pool = ThreadPool::instance ();
+    const std::vector<unsigned int> & indices = geometry.triangleIndices;
+    const float * positions = geometry.vertexPositions.data ();
+    size_t vertexCount = geometry.vertexCount (), triangleCount = indices.size () / 3;
+    MeshTopology topology (indices, vertexCount, false);
+
+    // Area-weighted normal of each triangle, padded to four floats for the vector loads of the gather
+    std::unique_ptr<float[]> faceNormals (new float[4 * triangleCount]); // Every entry is written next
+    pool.parallelFor (0, triangleCount, [&] (size_t first, size_t last) {
+        for (size_t t = first; t < last; t++) {
+            const float * a = positions + 3 * size_t (indices[3*t]);
+            const float * b = positions + 3 * size_t (indices[3*t + 1]);
+            const float * c = positions + 3 * size_t (indices[3*t + 2]);
+#if defined(__SSE2__)
+            __m128 pa = loadPoint (a);
+            _mm_storeu_ps (&faceNormals[4*t], cross (_mm_sub_ps (loadPoint (b), pa), _mm_sub_ps (loadPoint (c), pa)));
+#else
+            float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            faceNormals[4*t] = u[1] * v[2] - u[2] * v[1];
+            faceNormals[4*t + 1] = u[2] * v[0] - u[0] * v[2];
+            faceNormals[4*t + 2] = u[0] * v[1] - u[1] * v[0];
+            faceNormals[4*t + 3] = 0.f;
+#endif
+        }
+    });
+
+    // Each vertex gathers the normals of its triangles
+    geometry.vertexNormals.resize (3 * vertexCount);
+    float * normals = geometry.vertexNormals.data ();
+    pool.parallelFor (0, vertexCount, [&] (size_t first, size_t last) {
+        for (size_t v = first; v < last; v++) {
+            MeshTopology::Row row = topology.vertexTriangles (static_cast<unsigned int> (v));
+            float * out = normals + 3*v;
+#if defined(__SSE2__)
+            __m128 sum = _mm_setzero_ps ();
+            for (unsigned int t : row)
+                sum = _mm_add_ps (sum, _mm_loadu_ps (&faceNormals[4 * size_t (t)]));
+            __m128 squares = _mm_mul_ps (sum, sum);
+            __m128 pairs = _mm_add_ps (squares, _mm_shuffle_ps (squares, squares, _MM_SHUFFLE (2, 3, 0, 1)));
+            __m128 length2 = _mm_add_ps (pairs, _mm_shuffle_ps (pairs, pairs, _MM_SHUFFLE (1, 0, 3, 2))); // In every lane
+            __m128 normal = _mm_and_ps (_mm_cmpgt_ps (length2, _mm_setzero_ps ()), _mm_div_ps (sum, _mm_sqrt_ps (length2)));
+            _mm_storel_pi (reinterpret_cast<__m64 *> (out), normal);
+            _mm_store_ss (out + 2, _mm_movehl_ps (normal, normal));
+#else
+            float sum[3] = { 0.f, 0.f, 0.f };
+            for (unsigned int t : row)
+                for (int c = 0; c < 3; c++)
+                    sum[c] += faceNormals[4 * size_t (t) + c];
+            float length = std::sqrt (sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+            for (int c = 0; c < 3; c++)
+                out[c] = length > 0.f ? sum[c] / length : 0.f;
+#endif
+        }
+    });
+}
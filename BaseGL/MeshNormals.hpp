@@ -0,0 +1,18 @@
+#ifndef _MESH_NORMALS_H
+#define _MESH_NORMALS_H
+
+#include "Geometry.hpp"
+
+// Smooth vertex normals, for meshes loaded without any: each triangle gets the cross product of two
+// of its edges, whose length is twice its area, then each vertex sums those of its triangles, read
+// from the vertex to triangle rows of MeshTopology. A vertex only ever writes its own normal, so the
+// passes run in parallel without atomics, and the sums are taken in triangle order whatever the
+// thread count. The cross products and the sums use SSE when the compiler targets it.
+class MeshNormals {
+public:
+	// Into vertexNormals, from every triangle of triangleIndices. A vertex on no triangle, or on
+	// degenerate ones only, gets a zero normal.
+	static void compute (Geometry & geometry);
+};
+
+#endif //_MESH_NORMALS_H
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "MeshOptimizer.hpp"
+
+MeshOptimizer::VertexCacheStatistics MeshOptimizer::analyzeVertexCache (const std::vector<unsigned int> & indices, size_t vertexCount, size_t cacheSize) {
+    std::vector<size_t> insertedAt (vertexCount, 0); // Miss counter value when the vertex entered the cache, 0 if never
+    std::vector<bool> referenced (vertexCount, false);
+    size_t misses = 0;
+    size_t referencedCount = 0;
+
+    for (unsigned int v : indices) {
+        // With a FIFO cache, a vertex is still resident if fewer than cacheSize misses happened since it was inserted
+        if (insertedAt[v] == 0 || misses - insertedAt[v] + 1 > cacheSize) {
+            misses++;
+            insertedAt[v] = misses;
+        }
+        if (!referenced[v]) {
+            referenced[v] = true;
+            referencedCount++;
+        }
+    }
+
+    VertexCacheStatistics statistics;
+    statistics.acmr = indices.empty () ? 0.f : float (misses) / float (indices.size () / 3);
+    statistics.atvr = referencedCount == 0 ? 0.f : float (misses) / float (referencedCount);
+    return statistics;
+}
+
+// Forsyth's scoring: recently used vertices and vertices with few remaining triangles are preferred
+static const int cacheSize = 32;
+
+static float computeVertexScore (int cachePosition, unsigned int remainingTriangles) {
+    if (remainingTriangles == 0)
+        return -1.f; // No triangle left to emit, the vertex is irrelevant
+    float score = 0.f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3)
+            score = 0.75f; // Vertices of the last triangle: fixed score, to avoid favoring its immediate neighbors too much
+        else
+            score = std::pow (1.f - float (cachePosition - 3) / float (cacheSize - 3), 1.5f);
+    }
+    return score + 2.f / std::sqrt (float (remainingTriangles)); // Valence boost, to finish off lone triangles
+}
+
+// Scores tabulated once for the common valences, as pow and sqrt dominate the cost of the pass otherwise
+static const unsigned int tabulatedValences = 16;
+
+static float vertexScore (int cachePosition, unsigned int remainingTriangles) {
+    static struct ScoreTable {
+        float score[cacheSize + 1][tabulatedValences];
+        ScoreTable () {
+            for (int p = -1; p < cacheSize; p++)
+                for (unsigned int r = 0; r < tabulatedValences; r++)
+                    score[p + 1][r] = computeVertexScore (p, r);
+        }
+    } table;
+    if (remainingTriangles < tabulatedValences)
+        return table.score[cachePosition + 1][remainingTriangles];
+    return computeVertexScore (cachePosition, remainingTriangles);
+}
+
+void MeshOptimizer::optimizeVertexCache (std::vector<unsigned int> & indices, size_t vertexCount) {
+    size_t triangleCount = indices.size () / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles of each vertex, in compressed rows: only the first remaining[v] entries are still to emit
+    std::vector<unsigned int> remaining (vertexCount, 0);
+    for (unsigned int v : indices)
+        remaining[v]++;
+    std::vector<unsigned int> firstTriangle (vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        firstTriangle[v+1] = firstTriangle[v] + remaining[v];
+    std::vector<unsigned int> vertexTriangles (indices.size ());
+    std::vector<unsigned int> fill (firstTriangle.begin (), firstTriangle.end () - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (size_t k = 0; k < 3; k++)
+            vertexTriangles[fill[indices[3*t+k]]++] = t;
+
+    std::vector<int> cachePosition (vertexCount, -1);
+    std::vector<float> score (vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore (-1, remaining[v]);
+
+    std::vector<float> triangleScore (triangleCount);
+    std::vector<bool> emitted (triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[3*t]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+
+    std::vector<unsigned int> output;
+    output.reserve (indices.size ());
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve (cacheSize + 3);
+    nextCache.reserve (cacheSize + 3);
+
+    size_t scanCursor = 0; // Fallback: next triangle in input order, used when the cache gives no candidate
+    long best = -1;
+
+    while (output.size () < indices.size ()) {
+        if (best < 0) {
+            while (emitted[scanCursor])
+                scanCursor++;
+            best = scanCursor;
+        }
+
+        // Emit the best triangle and detach it from its vertices
+        emitted[best] = true;
+        for (size_t k = 0; k < 3; k++) {
+            unsigned int v = indices[3*best+k];
+            output.push_back (v);
+            unsigned int * list = &vertexTriangles[firstTriangle[v]];
+            unsigned int * end = list + remaining[v];
+            std::iter_swap (std::find (list, end, (unsigned int)best), end - 1);
+            remaining[v]--;
+        }
+
+        // Move its vertices to the front of the LRU cache
+        nextCache.clear ();
+        for (size_t k = 0; k < 3; k++)
+            nextCache.push_back (indices[3*best+k]);
+        for (unsigned int v : cache)
+            if (v != indices[3*best] && v != indices[3*best+1] && v != indices[3*best+2])
+                nextCache.push_back (v);
+
+        // Rescore the vertices that moved or left the cache, then the triangles around them
+        for (size_t i = 0; i < nextCache.size (); i++) {
+            unsigned int v = nextCache[i];
+            cachePosition[v] = i < size_t (cacheSize) ? int (i) : -1;
+            score[v] = vertexScore (cachePosition[v], remaining[v]);
+        }
+        best = -1;
+        float bestScore = -1.f;
+        for (unsigned int v : nextCache) {
+            for (unsigned int i = 0; i < remaining[v]; i++) {
+                unsigned int t = vertexTriangles[firstTriangle[v] + i];
+                triangleScore[t] = score[indices[3*t]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        if (nextCache.size () > size_t (cacheSize))
+            nextCache.resize (cacheSize);
+        std::swap (cache, nextCache);
+    }
+
+    indices.swap (output);
+}
+
+// Whether all the attributes of vertices a and b agree within tolerance
+static bool sameVertex (const Geometry & g, unsigned int a, unsigned int b, float tolerance) {
+    for (size_t k = 0; k < 3; k++) {
+        if (std::abs (g.vertexPositions[3*a+k] - g.vertexPositions[3*b+k]) > tolerance)
+            return false;
+        if (std::abs (g.vertexColors[3*a+k] - g.vertexColors[3*b+k]) > tolerance)
+            return false;
+        if (!g.vertexNormals.empty () && std::abs (g.vertexNormals[3*a+k] - g.vertexNormals[3*b+k]) > tolerance)
+            return false;
+    }
+    return true;
+}
+
+static uint64_t cellKey (int64_t x, int64_t y, int64_t z) {
+    // 21 bits per axis are plenty for the grids welding works on; wrapping only adds false candidates
+    return (uint64_t (x) & 0x1FFFFF) | ((uint64_t (y) & 0x1FFFFF) << 21) | ((uint64_t (z) & 0x1FFFFF) << 42);
+}
+
+std::vector<unsigned int> MeshOptimizer::weldVertices (const Geometry & geometry, float tolerance) {
+    size_t vertexCount = geometry.vertexCount ();
+    float cellSize = std::max (tolerance, 1e-30f);
+
+    // Grid of representatives: each cell holds a chain of the vertices kept so far
+    std::unordered_map<uint64_t, unsigned int> firstInCell;
+    firstInCell.reserve (vertexCount);
+    std::vector<unsigned int> nextInCell (vertexCount);
+    std::vector<unsigned int> remap (vertexCount);
+    const unsigned int none = ~0u;
+
+    for (size_t v = 0; v < vertexCount; v++) {
+        const float * p = &geometry.vertexPositions[3*v];
+        int64_t cx = int64_t (std::floor (p[0] / cellSize));
+        int64_t cy = int64_t (std::floor (p[1] / cellSize));
+        int64_t cz = int64_t (std::floor (p[2] / cellSize));
+
+        // A match within tolerance lies in this cell or one of its 26 neighbors
+        unsigned int match = none;
+        for (int dz = -1; dz <= 1 && match == none; dz++)
+            for (int dy = -1; dy <= 1 && match == none; dy++)
+                for (int dx = -1; dx <= 1 && match == none; dx++) {
+                    auto cell = firstInCell.find (cellKey (cx + dx, cy + dy, cz + dz));
+                    for (unsigned int c = cell == firstInCell.end () ? none : cell->second; c != none; c = nextInCell[c])
+                        if (sameVertex (geometry, c, v, tolerance)) {
+                            match = c;
+                            break;
+                        }
+                }
+
+        if (match != none) {
+            remap[v] = match;
+        } else {
+            remap[v] = v;
+            auto inserted = firstInCell.insert (std::make_pair (cellKey (cx, cy, cz), unsigned (v)));
+            nextInCell[v] = inserted.second ? none : inserted.first->second;
+            inserted.first->second = v;
+        }
+    }
+    return remap;
+}
+
+void MeshOptimizer::remapIndices (std::vector<unsigned int> & indices, const std::vector<unsigned int> & remap) {
+    for (unsigned int & i : indices)
+        i = remap[i];
+}
+
+struct TriangleHash {
+    size_t operator() (const std::array<unsigned int, 3> & t) const {
+        return (size_t (t[0]) * 73856093u) ^ (size_t (t[1]) * 19349663u) ^ (size_t (t[2]) * 83492791u);
+    }
+};
+
+void MeshOptimizer::removeDegenerateTriangles (std::vector<unsigned int> & indices) {
+    std::unordered_set<std::array<unsigned int, 3>, TriangleHash> seen;
+    seen.reserve (indices.size () / 3);
+    size_t kept = 0;
+    for (size_t t = 0; t + 2 < indices.size (); t += 3) {
+        unsigned int a = indices[t], b = indices[t+1], c = indices[t+2];
+        if (a == b || b == c || c == a)
+            continue;
+        // Rotate the smallest index first: the key identifies the triangle and its winding
+        std::array<unsigned int, 3> key = a < b && a < c ? std::array<unsigned int, 3> {{ a, b, c }}
+                                        : b < c ? std::array<unsigned int, 3> {{ b, c, a }} : std::array<unsigned int, 3> {{ c, a, b }};
+        if (!seen.insert (key).second)
+            continue;
+        indices[kept++] = a;
+        indices[kept++] = b;
+        indices[kept++] = c;
+    }
+    indices.resize (kept);
+}
+
+// Reorders the three-component stream so that new vertex i is old vertex order[i]
+static void reorderStream (std::vector<float> & stream, const std::vector<unsigned int> & order) {
+    if (stream.empty ())
+        return;
+    std::vector<float> reordered (3 * order.size ());
+    for (size_t i = 0; i < order.size (); i++)
+        std::copy (&stream[3*order[i]], &stream[3*order[i]] + 3, &reordered[3*i]);
+    stream.swap (reordered);
+}
+
+void MeshOptimizer::optimizeVertexFetch (Geometry & geometry) {
+    const unsigned int none = ~0u;
+    std::vector<unsigned int> newIndex (geometry.vertexCount (), none);
+    std::vector<unsigned int> order; // Old index of each new vertex
+    order.reserve (geometry.vertexCount ());
+
+    // Coarsest level first: the vertices a level adds to the coarser ones then form one range, which
+    // a progressive upload (Geometry::streamBudget) sends with the level. Indices outside every level come last.
+    auto visit = [&] (unsigned int i) {
+        if (newIndex[i] == none) {
+            newIndex[i] = order.size ();
+            order.push_back (i);
+        }
+    };
+    for (size_t l = geometry.levelCount (); l-- > 0;) {
+        GeometryLevel level = geometry.level (l);
+        for (size_t k = level.firstIndex; k < level.firstIndex + level.indexCount; k++)
+            visit (geometry.triangleIndices[k]);
+    }
+    for (unsigned int & i : geometry.triangleIndices) {
+        visit (i);
+        i = newIndex[i];
+    }
+
+    reorderStream (geometry.vertexPositions, order);
+    reorderStream (geometry.vertexColors, order);
+    reorderStream (geometry.vertexNormals, order);
+}
@@ -0,0 +1,41 @@
+#ifndef _MESH_OPTIMIZER_H
+#define _MESH_OPTIMIZER_H
+
+#include <vector>
+#include <cstddef>
+
+#include "Geometry.hpp"
+
+// Index and vertex reordering passes. They work on plain triangle lists, so that they
+// apply to generated and loaded geometry alike.
+class MeshOptimizer {
+public:
+
+	// Efficiency of an index order for a simulated FIFO post-transform vertex cache
+	struct VertexCacheStatistics {
+		float acmr; // Average cache miss ratio: vertex shader invocations per triangle (0.5 is ideal for large grids, 3 is the worst)
+		float atvr; // Average transformed vertex ratio: vertex shader invocations per referenced vertex (1 is ideal)
+	};
+
+	static VertexCacheStatistics analyzeVertexCache (const std::vector<unsigned int> & indices, size_t vertexCount, size_t cacheSize = 16);
+
+	// Reorders the triangles of indices to improve post-transform cache reuse (Forsyth's linear-speed
+	// algorithm, with a simulated LRU cache of 32 entries). Triangles are kept, their vertices untouched.
+	static void optimizeVertexCache (std::vector<unsigned int> & indices, size_t vertexCount);
+
+	// Returns, for each vertex, the index of the first vertex whose attributes all lie within
+	// tolerance of its own (per component). Positions are hashed on a grid of cell size tolerance.
+	static std::vector<unsigned int> weldVertices (const Geometry & geometry, float tolerance);
+
+	// Replaces every index i by remap[i]
+	static void remapIndices (std::vector<unsigned int> & indices, const std::vector<unsigned int> & remap);
+
+	// Removes the triangles using a vertex twice, and the repeated copies of a triangle with the same winding
+	static void removeDegenerateTriangles (std::vector<unsigned int> & indices);
+
+	// Renumbers the vertices in order of first use by the index buffer, levels from the coarsest,
+	// so that the vertex fetch reads memory sequentially, and drops the unreferenced ones
+	static void optimizeVertexFetch (Geometry & geometry);
+};
+
+#endif //_MESH_OPTIMIZER_H
@@ -0,0 +1,697 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#include "MeshSimplifier.hpp"
+#include "ThreadPool.hpp"
+
+// Sum of weighted squared distances to planes: p.A.p + 2 b.p + c, with A symmetric.
+// weight is the total area of the planes, so that dividing by it gives a mean squared distance.
+// Each vertex keeps its quadric relative to its own position: the terms then stay on the scale of
+// the distances measured, which float would otherwise lose against the scale of the coordinates.
+struct Quadric {
+    float a00, a11, a22, a01, a02, a12;
+    float b0, b1, b2;
+    float c;
+    float weight;
+};
+
+static Quadric planeQuadric (const glm::vec3 & n, float d, float weight, float area) {
+    Quadric q;
+    q.a00 = weight * n.x * n.x;
+    q.a11 = weight * n.y * n.y;
+    q.a22 = weight * n.z * n.z;
+    q.a01 = weight * n.x * n.y;
+    q.a02 = weight * n.x * n.z;
+    q.a12 = weight * n.y * n.z;
+    q.b0 = weight * n.x * d;
+    q.b1 = weight * n.y * d;
+    q.b2 = weight * n.z * d;
+    q.c = weight * d * d;
+    q.weight = area;
+    return q;
+}
+
+static void addQuadric (Quadric & q, const Quadric & r) {
+    q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+    q.a01 += r.a01; q.a02 += r.a02; q.a12 += r.a12;
+    q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+    q.c += r.c;
+    q.weight += r.weight;
+}
+
+// Adds r, relative to an origin at offset from the origin of q
+static void addShiftedQuadric (Quadric & q, const Quadric & r, const glm::vec3 & offset) {
+    glm::vec3 b (r.b0, r.b1, r.b2);
+    glm::vec3 ad (r.a00 * offset.x + r.a01 * offset.y + r.a02 * offset.z,
+                  r.a01 * offset.x + r.a11 * offset.y + r.a12 * offset.z,
+                  r.a02 * offset.x + r.a12 * offset.y + r.a22 * offset.z);
+    Quadric shifted = r;
+    shifted.b0 += ad.x;
+    shifted.b1 += ad.y;
+    shifted.b2 += ad.z;
+    shifted.c += glm::dot (offset, ad) + 2.f * glm::dot (b, offset);
+    addQuadric (q, shifted);
+}
+
+static float evaluateQuadric (const Quadric & q, const glm::vec3 & p) {
+    float e = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z
+            + 2.f * (q.a01 * p.x * p.y + q.a02 * p.x * p.z + q.a12 * p.y * p.z)
+            + 2.f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+    return std::max (e, 0.f); // Rounding can make the sum slightly negative
+}
+
+// Border edges are held by planes orthogonal to their triangle, weighted up so that the outline wears last
+static const float borderWeight = 10.f;
+
+// A collapse must not turn any remaining triangle by more than about 75 degrees
+static const float minNormalCosine = 0.25f;
+
+static const unsigned int none = ~0u;
+
+// Meshes of twice as many triangles or more are simplified in blocks of about that many first, in
+// parallel, then as a whole. The blocks stop at blockShare times their share of the target, so that
+// the pass over the whole mesh still spends the last collapses where they cost least.
+static const size_t blockTriangles = size_t (1) << 18;
+static const size_t blockShare = 4;
+
+// Positions are normalized to the unit box of the whole geometry, so that the float quadrics keep
+// their precision and the errors of the blocks compare
+struct UnitBox {
+    glm::vec3 lo;
+    float extent;
+};
+
+static UnitBox unitBox (const float * p, size_t vertexCount) {
+    glm::vec3 lo (std::numeric_limits<float>::max ()), hi (-std::numeric_limits<float>::max ());
+    for (size_t v = 0; v < vertexCount; v++) {
+        lo = glm::min (lo, glm::vec3 (p[3*v], p[3*v+1], p[3*v+2]));
+        hi = glm::max (hi, glm::vec3 (p[3*v], p[3*v+1], p[3*v+2]));
+    }
+    return { lo, std::max (std::max (hi.x - lo.x, hi.y - lo.y), std::max (hi.z - lo.z, 1e-30f)) };
+}
+
+// The first vertex with the same position as each vertex, through an open-addressing hash of the exact positions
+static void canonicalVertices (const float * p, size_t vertexCount, std::vector<unsigned int> & canonical) {
+    size_t tableSize = 1;
+    while (tableSize < 2 * vertexCount)
+        tableSize *= 2;
+    std::vector<unsigned int> table (tableSize, none);
+    canonical.resize (vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        uint32_t bits[3];
+        std::memcpy (bits, &p[3*v], sizeof (bits));
+        uint32_t hash = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        hash = (hash ^ (hash >> 16)) * 0x85EBCA6Bu; // Mix the high bits down: the low mantissa bits are often all zero
+        size_t slot = (hash ^ (hash >> 13)) & (tableSize - 1);
+        while (table[slot] != none && std::memcmp (&p[3*table[slot]], &p[3*v], sizeof (bits)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+        if (table[slot] == none)
+            table[slot] = v;
+        canonical[v] = table[slot];
+    }
+}
+
+// State of one simplification. Vertices are identified by the first vertex with the same position
+// (their canonical vertex), so that attribute seams do not split the surface; the index buffer keeps
+// the original vertices. Triangles around each canonical vertex are stored in compressed rows, and the
+// rows of the vertices collapsed into a vertex are chained to its own. Rows are rebuilt from the
+// remaining triangles whenever a quarter of them are gone, to keep the chains short.
+class Simplifier {
+public:
+    // Vertices flagged in pinned (may be null) neither move nor take the vertices collapsed onto them.
+    // A vertex whose quadric in initial (may be null) has a weight starts from it instead of its triangles.
+    Simplifier (const float * vertexPositions, size_t vertexCount, const UnitBox & box, std::vector<unsigned int> & indices,
+                const unsigned char * pinned = nullptr, const Quadric * initial = nullptr);
+
+    float run (size_t targetIndexCount, float targetError);
+
+    // Calls visit (vertex, quadric) on the canonical vertices left, pinned ones aside
+    template<typename Visit>
+    void forEachQuadric (const Visit & visit) const {
+        for (size_t v = 0; v < kind.size (); v++)
+            if (kind[v] != Removed && (pinned.empty () || !pinned[v]))
+                visit (unsigned (v), quadrics[v]);
+    }
+
+private:
+    enum Kind : unsigned char { Interior, Border, Locked, Removed };
+
+    struct Neighbor {
+        unsigned int canonical;
+        unsigned int vertex; // Original vertex, as written in the triangle
+        bool operator< (const Neighbor & other) const { return canonical < other.canonical; }
+    };
+
+    struct Candidate {
+        float cost;
+        unsigned int vertex;
+        bool operator< (const Candidate & other) const { return cost < other.cost; }
+    };
+
+    struct HeapEntry {
+        float cost;
+        unsigned int vertex;
+    };
+
+    // Per-thread scratch space of evaluate
+    struct Scratch {
+        std::vector<Neighbor> neighbors;
+        std::vector<unsigned int> triangles;
+        std::vector<Candidate> candidates;
+    };
+
+    template<typename Visit>
+    void forEachTriangle (unsigned int v, const Visit & visit) const {
+        for (unsigned int x = v; x != none; x = chainNext[x])
+            for (unsigned int i = firstTriangle[x]; i < firstTriangle[x+1]; i++)
+                if (!dead[vertexTriangles[i]])
+                    visit (vertexTriangles[i]);
+    }
+
+    unsigned int canonicalCorner (unsigned int t, unsigned int k) const { return canonical[indices[3*t+k]]; }
+    unsigned int cornerOf (unsigned int t, unsigned int v) const;
+    void gatherNeighbors (unsigned int v, std::vector<Neighbor> & neighbors, std::vector<unsigned int> & triangles) const;
+
+    void buildRows ();
+    void classify (unsigned int v, Scratch & scratch);
+    void evaluate (unsigned int v, Scratch & scratch);
+    bool flips (unsigned int u, unsigned int v, const glm::vec3 & target, const std::vector<unsigned int> & triangles) const;
+    bool collapse (unsigned int u);
+
+    void heapUpdate (unsigned int v);
+    void heapPlace (size_t i, const HeapEntry & entry);
+    void heapSiftUp (size_t i);
+    void heapSiftDown (size_t i);
+    void heapRemove (unsigned int v);
+
+    std::vector<unsigned int> & indices;
+    size_t liveTriangles = 0;
+    size_t rowTriangles = 0; // Live triangles when the rows were last built
+
+    std::vector<glm::vec3> positions; // Normalized to the unit box, so that the float quadrics keep their precision
+    std::vector<unsigned int> canonical;
+    std::vector<unsigned char> pinned; // Empty if none are
+    const Quadric * initial;
+    std::vector<unsigned char> dead;
+
+    std::vector<unsigned int> firstTriangle;
+    std::vector<unsigned int> vertexTriangles;
+    std::vector<unsigned int> chainNext, chainTail;
+
+    std::vector<Quadric> quadrics;
+    std::vector<Kind> kind;
+    std::vector<float> cost; // Cost of the best collapse of each vertex, infinite when none is allowed
+    std::vector<unsigned int> target; // Original vertex to move it onto
+    std::vector<unsigned char> stale; // Neighborhood changed since the evaluation: re-evaluated when it reaches the top of the heap
+
+    std::vector<HeapEntry> heap; // Binary min-heap of the vertices on cost
+    std::vector<unsigned int> heapPosition;
+
+    std::vector<unsigned int> mark; // Neighbor marks of the link condition
+    unsigned int markStamp = 0;
+    Scratch scratch;
+    std::vector<Neighbor> updated; // Neighbors to re-evaluate after a collapse
+    std::vector<unsigned int> updatedTriangles;
+};
+
+Simplifier::Simplifier (const float * p, size_t vertexCount, const UnitBox & box, std::vector<unsigned int> & indices,
+                        const unsigned char * pinnedVertices, const Quadric * initial) : indices (indices), initial (initial) {
+    positions.resize (vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        positions[v] = (glm::vec3 (p[3*v], p[3*v+1], p[3*v+2]) - box.lo) / box.extent;
+    canonicalVertices (p, vertexCount, canonical);
+    if (pinnedVertices)
+        pinned.assign (pinnedVertices, pinnedVertices + vertexCount);
+
+    // Triangles that are already degenerate take no part
+    size_t triangleCount = indices.size () / 3;
+    dead.assign (triangleCount, 0);
+    for (size_t t = 0; t < triangleCount; t++) {
+        unsigned int a = canonicalCorner (t, 0), b = canonicalCorner (t, 1), c = canonicalCorner (t, 2);
+        dead[t] = a == b || b == c || c == a;
+        liveTriangles += !dead[t];
+    }
+    buildRows ();
+
+    quadrics.resize (vertexCount);
+    kind.assign (vertexCount, Removed);
+    cost.assign (vertexCount, std::numeric_limits<float>::infinity ());
+    target.assign (vertexCount, none);
+    heapPosition.assign (vertexCount, none);
+    stale.assign (vertexCount, 0);
+    mark.assign (vertexCount, 0);
+
+    // Quadrics and kinds, then the best collapse of every vertex: each vertex only writes its own entries
+    ThreadPool::instance ().parallelFor (0, vertexCount, [&] (size_t first, size_t last) {
+        Scratch local;
+        for (size_t v = first; v < last; v++)
+            if (canonical[v] == v && firstTriangle[v] != firstTriangle[v+1])
+                classify (v, local);
+    });
+    ThreadPool::instance ().parallelFor (0, vertexCount, [&] (size_t first, size_t last) {
+        Scratch local;
+        for (size_t v = first; v < last; v++)
+            if (kind[v] == Interior || kind[v] == Border)
+                evaluate (v, local);
+    });
+
+    for (size_t v = 0; v < vertexCount; v++)
+        if (cost[v] < std::numeric_limits<float>::infinity ()) {
+            heapPosition[v] = heap.size ();
+            heap.push_back ({ cost[v], unsigned (v) });
+        }
+    for (size_t i = heap.size () / 2; i-- > 0;)
+        heapSiftDown (i);
+}
+
+void Simplifier::buildRows () {
+    // Drop the dead triangles first, so that the rows only hold live ones
+    size_t kept = 0;
+    for (size_t t = 0; t < dead.size (); t++)
+        if (!dead[t]) {
+            for (unsigned int k = 0; k < 3; k++)
+                indices[3*kept+k] = indices[3*t+k];
+            kept++;
+        }
+    indices.resize (3 * kept);
+    dead.assign (kept, 0);
+
+    size_t vertexCount = canonical.size ();
+    firstTriangle.assign (vertexCount + 1, 0);
+    for (size_t t = 0; t < dead.size (); t++)
+        if (!dead[t])
+            for (unsigned int k = 0; k < 3; k++)
+                firstTriangle[canonicalCorner (t, k) + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        firstTriangle[v+1] += firstTriangle[v];
+    vertexTriangles.resize (firstTriangle[vertexCount]);
+    std::vector<unsigned int> fill (firstTriangle.begin (), firstTriangle.end () - 1);
+    for (size_t t = 0; t < dead.size (); t++)
+        if (!dead[t])
+            for (unsigned int k = 0; k < 3; k++)
+                vertexTriangles[fill[canonicalCorner (t, k)]++] = t;
+
+    chainNext.assign (vertexCount, none);
+    chainTail.resize (vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        chainTail[v] = v;
+    rowTriangles = liveTriangles;
+}
+
+unsigned int Simplifier::cornerOf (unsigned int t, unsigned int v) const {
+    return canonicalCorner (t, 0) == v ? 0 : (canonicalCorner (t, 1) == v ? 1 : 2);
+}
+
+// The triangles around v, and their two other corners sorted by canonical vertex: a neighbor appears
+// once per triangle holding the edge to it
+void Simplifier::gatherNeighbors (unsigned int v, std::vector<Neighbor> & neighbors, std::vector<unsigned int> & triangles) const {
+    neighbors.clear ();
+    triangles.clear ();
+    forEachTriangle (v, [&] (unsigned int t) {
+        triangles.push_back (t);
+        unsigned int k = cornerOf (t, v);
+        unsigned int b = indices[3*t + (k+1)%3], c = indices[3*t + (k+2)%3];
+        neighbors.push_back ({ canonical[b], b });
+        neighbors.push_back ({ canonical[c], c });
+    });
+    std::sort (neighbors.begin (), neighbors.end ());
+}
+
+void Simplifier::classify (unsigned int v, Scratch & scratch) {
+    // The planes of a vertex carried over from a block pass are in its initial quadric already, and
+    // the border planes of a pinned one would hold the cut between the blocks
+    bool carried = initial && initial[v].weight >= 0.f;
+    bool isPinned = !pinned.empty () && pinned[v];
+    Quadric q = carried ? initial[v] : Quadric {};
+    unsigned int copy = none;
+    bool seam = false;
+    forEachTriangle (v, [&] (unsigned int t) {
+        unsigned int k = cornerOf (t, v);
+        if (copy == none)
+            copy = indices[3*t+k];
+        seam = seam || indices[3*t+k] != copy;
+        glm::vec3 a = positions[canonicalCorner (t, 0)], b = positions[canonicalCorner (t, 1)], c = positions[canonicalCorner (t, 2)];
+        glm::vec3 n = glm::cross (b - a, c - a);
+        float length = glm::length (n);
+        if (length > 0.f && !carried)
+            addQuadric (q, planeQuadric (n / length, glm::dot (n / length, positions[v] - a), 0.5f * length, 0.5f * length));
+    });
+
+    // Edges held by one triangle are borders, by more than two non-manifold
+    gatherNeighbors (v, scratch.neighbors, scratch.triangles);
+    const std::vector<Neighbor> & neighbors = scratch.neighbors;
+    bool border = false, nonManifold = false;
+    for (size_t i = 0; i < neighbors.size ();) {
+        size_t j = i;
+        while (j < neighbors.size () && neighbors[j].canonical == neighbors[i].canonical)
+            j++;
+        if (j - i > 2)
+            nonManifold = true;
+        if (j - i == 1) {
+            border = true;
+            unsigned int w = neighbors[i].canonical;
+            forEachTriangle (v, [&] (unsigned int t) {
+                if (carried || isPinned)
+                    return; // The triangle holding the border edge gives the plane orientation
+                if (canonicalCorner (t, 0) != w && canonicalCorner (t, 1) != w && canonicalCorner (t, 2) != w)
+                    return;
+                glm::vec3 a = positions[canonicalCorner (t, 0)], b = positions[canonicalCorner (t, 1)], c = positions[canonicalCorner (t, 2)];
+                glm::vec3 edge = positions[w] - positions[v];
+                glm::vec3 m = glm::cross (edge, glm::cross (b - a, c - a));
+                float length = glm::length (m);
+                if (length > 0.f)
+                    addQuadric (q, planeQuadric (m / length, 0.f, borderWeight * glm::dot (edge, edge), 0.f));
+            });
+        }
+        i = j;
+    }
+    quadrics[v] = q;
+    kind[v] = (seam || nonManifold || isPinned) ? Locked : (border ? Border : Interior);
+}
+
+// Whether moving u onto the position target turns one of its triangles that survive the collapse onto v
+bool Simplifier::flips (unsigned int u, unsigned int v, const glm::vec3 & target, const std::vector<unsigned int> & triangles) const {
+    for (unsigned int t : triangles) {
+        unsigned int k = cornerOf (t, u);
+        unsigned int b = canonicalCorner (t, (k+1)%3), c = canonicalCorner (t, (k+2)%3);
+        if (b == v || c == v)
+            continue;
+        glm::vec3 before = glm::cross (positions[b] - positions[u], positions[c] - positions[u]);
+        glm::vec3 after = glm::cross (positions[b] - target, positions[c] - target);
+        float d = glm::dot (before, after);
+        if (d <= 0.f || d * d <= minNormalCosine * minNormalCosine * glm::dot (before, before) * glm::dot (after, after))
+            return true;
+    }
+    return false;
+}
+
+void Simplifier::evaluate (unsigned int u, Scratch & scratch) {
+    cost[u] = std::numeric_limits<float>::infinity ();
+    target[u] = none;
+    if (kind[u] != Interior && kind[u] != Border)
+        return;
+
+    // Candidates: neighbors across an edge of the right kind, all written with the same original vertex
+    gatherNeighbors (u, scratch.neighbors, scratch.triangles);
+    const std::vector<Neighbor> & neighbors = scratch.neighbors;
+    scratch.candidates.clear ();
+    for (size_t i = 0; i < neighbors.size ();) {
+        size_t j = i;
+        bool sameVertex = true;
+        while (j < neighbors.size () && neighbors[j].canonical == neighbors[i].canonical) {
+            sameVertex = sameVertex && neighbors[j].vertex == neighbors[i].vertex;
+            j++;
+        }
+        size_t edgeTriangles = j - i;
+        unsigned int v = neighbors[i].canonical;
+        if (sameVertex && edgeTriangles == (kind[u] == Border ? 1u : 2u) && (pinned.empty () || !pinned[v])) {
+            float weight = std::max (quadrics[u].weight + quadrics[v].weight, 1e-30f);
+            float c = (evaluateQuadric (quadrics[u], positions[v] - positions[u]) + evaluateQuadric (quadrics[v], glm::vec3 (0.f))) / weight;
+            scratch.candidates.push_back ({ c, neighbors[i].vertex });
+        }
+        i = j;
+    }
+
+    // Cheapest first, the flip test only runs until one passes
+    std::sort (scratch.candidates.begin (), scratch.candidates.end ());
+    for (const Candidate & candidate : scratch.candidates)
+        if (!flips (u, canonical[candidate.vertex], positions[candidate.vertex], scratch.triangles)) {
+            cost[u] = candidate.cost;
+            target[u] = candidate.vertex;
+            return;
+        }
+}
+
+bool Simplifier::collapse (unsigned int u) {
+    unsigned int copy = target[u];
+    unsigned int v = canonical[copy];
+    if (kind[v] == Removed) { // Stale target, which the updates should never leave behind
+        evaluate (u, scratch);
+        heapUpdate (u);
+        return false;
+    }
+
+    // Link condition: u and v must share no neighbor beyond the corners opposite their edge,
+    // otherwise the collapse would pinch the surface
+    markStamp++;
+    size_t edgeTriangles = 0;
+    forEachTriangle (u, [&] (unsigned int t) {
+        for (unsigned int k = 0; k < 3; k++)
+            mark[canonicalCorner (t, k)] = markStamp;
+        edgeTriangles += canonicalCorner (t, 0) == v || canonicalCorner (t, 1) == v || canonicalCorner (t, 2) == v;
+    });
+    gatherNeighbors (v, scratch.neighbors, scratch.triangles);
+    size_t shared = 0;
+    for (size_t i = 0; i < scratch.neighbors.size (); i++)
+        if (scratch.neighbors[i].canonical != u && mark[scratch.neighbors[i].canonical] == markStamp
+            && (i == 0 || scratch.neighbors[i].canonical != scratch.neighbors[i-1].canonical))
+            shared++;
+    if (shared != edgeTriangles) {
+        cost[u] = std::numeric_limits<float>::infinity (); // Reconsidered when its neighborhood changes
+        heapRemove (u);
+        return false;
+    }
+
+    forEachTriangle (u, [&] (unsigned int t) {
+        unsigned int k = cornerOf (t, u);
+        if (canonicalCorner (t, 0) == v || canonicalCorner (t, 1) == v || canonicalCorner (t, 2) == v) {
+            dead[t] = 1;
+            liveTriangles--;
+        } else {
+            indices[3*t+k] = copy;
+        }
+    });
+    // The rewritten triangles now hold v, so the chain of u joins the chain of v
+    chainNext[chainTail[v]] = u;
+    chainTail[v] = chainTail[u];
+    addShiftedQuadric (quadrics[v], quadrics[u], positions[v] - positions[u]);
+    kind[u] = Removed;
+    heapRemove (u);
+
+    // Every cost involving v changed. v is re-evaluated now, its neighbors once they reach the top of
+    // the heap: most of them never do before the target is met. Neighbors without a valid collapse are
+    // not in the heap, and are re-evaluated now in case the change gave them one.
+    evaluate (v, scratch);
+    heapUpdate (v);
+    gatherNeighbors (v, updated, updatedTriangles);
+    for (size_t i = 0; i < updated.size (); i++) {
+        unsigned int w = updated[i].canonical;
+        if (i > 0 && w == updated[i-1].canonical)
+            continue;
+        if (heapPosition[w] != none) {
+            stale[w] = 1;
+        } else {
+            evaluate (w, scratch);
+            heapUpdate (w);
+        }
+    }
+    return true;
+}
+
+float Simplifier::run (size_t targetIndexCount, float targetError) {
+    float maxCost = targetError < std::sqrt (std::numeric_limits<float>::max ()) ? targetError * targetError : std::numeric_limits<float>::max ();
+    float reached = 0.f;
+    while (3 * liveTriangles > targetIndexCount && !heap.empty ()) {
+        unsigned int u = heap[0].vertex;
+        if (stale[u]) {
+            stale[u] = 0;
+            evaluate (u, scratch);
+            heapUpdate (u);
+            continue;
+        }
+        float c = cost[u];
+        if (c > maxCost)
+            break;
+        if (collapse (u))
+            reached = std::max (reached, c);
+        if (4 * liveTriangles < 3 * rowTriangles)
+            buildRows ();
+    }
+
+    size_t kept = 0;
+    for (size_t t = 0; t < dead.size (); t++)
+        if (!dead[t])
+            for (unsigned int k = 0; k < 3; k++)
+                indices[kept++] = indices[3*t+k];
+    indices.resize (kept);
+    return std::sqrt (reached);
+}
+
+/*
+ * Collapse queue: a binary heap of vertices indexed by heapPosition, so that costs can be updated in place.
+ * Entries carry a copy of the cost, so that sifting does not chase the vertex arrays.
+ */
+
+void Simplifier::heapPlace (size_t i, const HeapEntry & entry) {
+    heap[i] = entry;
+    heapPosition[entry.vertex] = i;
+}
+
+void Simplifier::heapSiftUp (size_t i) {
+    HeapEntry entry = heap[i];
+    while (i > 0 && heap[(i-1)/2].cost > entry.cost) {
+        heapPlace (i, heap[(i-1)/2]);
+        i = (i-1)/2;
+    }
+    heapPlace (i, entry);
+}
+
+void Simplifier::heapSiftDown (size_t i) {
+    HeapEntry entry = heap[i];
+    for (;;) {
+        size_t child = 2*i + 1;
+        if (child >= heap.size ())
+            break;
+        if (child + 1 < heap.size () && heap[child+1].cost < heap[child].cost)
+            child++;
+        if (heap[child].cost >= entry.cost)
+            break;
+        heapPlace (i, heap[child]);
+        i = child;
+    }
+    heapPlace (i, entry);
+}
+
+void Simplifier::heapRemove (unsigned int v) {
+    size_t i = heapPosition[v];
+    if (i == none)
+        return;
+    heapPosition[v] = none;
+    HeapEntry last = heap.back ();
+    heap.pop_back ();
+    if (last.vertex == v)
+        return;
+    heapPlace (i, last);
+    heapSiftUp (i);
+    heapSiftDown (heapPosition[last.vertex]);
+}
+
+void Simplifier::heapUpdate (unsigned int v) {
+    if (cost[v] == std::numeric_limits<float>::infinity ()) {
+        heapRemove (v);
+    } else if (heapPosition[v] == none) {
+        heap.push_back ({ cost[v], v });
+        heapPosition[v] = heap.size () - 1;
+        heapSiftUp (heap.size () - 1);
+    } else {
+        heap[heapPosition[v]].cost = cost[v];
+        heapSiftUp (heapPosition[v]);
+        heapSiftDown (heapPosition[v]);
+    }
+}
+
+// Splits the triangles into blocks by a grid over their centroids and simplifies the blocks in parallel,
+// each towards its share of the target. Vertices whose position is used by several blocks are pinned,
+// so that the blocks still join: the pass over the whole mesh that follows takes care of them, starting
+// from the quadrics the blocks leave in carried (by canonical vertex). Returns the largest error of the blocks.
+static float simplifyBlocks (const float * p, size_t vertexCount, const UnitBox & box, std::vector<unsigned int> & indices,
+                             size_t targetIndexCount, float targetError, std::vector<Quadric> & carried) {
+    size_t triangleCount = indices.size () / 3;
+    size_t cellsPerAxis = static_cast<size_t> (std::ceil (std::cbrt (double (triangleCount) / blockTriangles)));
+    size_t cellCount = cellsPerAxis * cellsPerAxis * cellsPerAxis;
+    std::vector<unsigned int> cellOf (triangleCount);
+    ThreadPool::instance ().parallelFor (0, triangleCount, [&] (size_t first, size_t last) {
+        for (size_t t = first; t < last; t++) {
+            glm::vec3 centroid (0.f);
+            for (unsigned int k = 0; k < 3; k++)
+                centroid += glm::vec3 (p[3*indices[3*t+k]], p[3*indices[3*t+k]+1], p[3*indices[3*t+k]+2]);
+            glm::vec3 cell = glm::clamp ((centroid / 3.f - box.lo) / box.extent * float (cellsPerAxis), glm::vec3 (0.f), glm::vec3 (float (cellsPerAxis - 1)));
+            cellOf[t] = static_cast<unsigned int> ((size_t (cell.z) * cellsPerAxis + size_t (cell.y)) * cellsPerAxis + size_t (cell.x));
+        }
+    });
+
+    // Triangles sorted by cell, and the cell owning each position, or shared
+    std::vector<size_t> firstTriangle (cellCount + 1, 0);
+    for (size_t t = 0; t < triangleCount; t++)
+        firstTriangle[cellOf[t] + 1]++;
+    for (size_t c = 0; c < cellCount; c++)
+        firstTriangle[c+1] += firstTriangle[c];
+    std::vector<unsigned int> order (triangleCount);
+    std::vector<size_t> fill (firstTriangle.begin (), firstTriangle.end () - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        order[fill[cellOf[t]]++] = static_cast<unsigned int> (t);
+    std::vector<unsigned int> canonical;
+    canonicalVertices (p, vertexCount, canonical);
+    const unsigned int shared = none - 1;
+    std::vector<unsigned int> owner (vertexCount, none);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (unsigned int k = 0; k < 3; k++) {
+            unsigned int & o = owner[canonical[indices[3*t+k]]];
+            o = (o == none || o == cellOf[t]) ? cellOf[t] : shared;
+        }
+
+    // Each block on its own vertices: those of a single block are numbered in localIndex, which no
+    // other block writes, the shared ones in a map of the block
+    std::vector<std::vector<unsigned int>> results (cellCount);
+    std::vector<float> errors (cellCount, 0.f);
+    std::vector<unsigned int> localIndex (vertexCount);
+    Quadric noQuadric = {};
+    noQuadric.weight = -1.f;
+    carried.assign (vertexCount, noQuadric);
+    ThreadPool::instance ().parallelFor (0, cellCount, [&] (size_t firstCell, size_t lastCell) {
+        for (size_t c = firstCell; c < lastCell; c++) {
+            size_t blockTriangleCount = firstTriangle[c+1] - firstTriangle[c];
+            if (blockTriangleCount == 0)
+                continue;
+            std::vector<unsigned int> globalIndex, blockIndices (3 * blockTriangleCount);
+            std::vector<float> blockPositions;
+            std::vector<unsigned char> blockPinned;
+            std::unordered_map<unsigned int, unsigned int> sharedIndex;
+            for (size_t i = 0; i < blockTriangleCount; i++)
+                for (unsigned int k = 0; k < 3; k++) {
+                    unsigned int v = indices[3*order[firstTriangle[c] + i] + k];
+                    bool isShared = owner[canonical[v]] == shared;
+                    unsigned int local = none;
+                    if (isShared) {
+                        std::unordered_map<unsigned int, unsigned int>::const_iterator it = sharedIndex.find (v);
+                        if (it != sharedIndex.end ())
+                            local = it->second;
+                    } else if (localIndex[v] < globalIndex.size () && globalIndex[localIndex[v]] == v) {
+                        local = localIndex[v];
+                    }
+                    if (local == none) {
+                        local = static_cast<unsigned int> (globalIndex.size ());
+                        (isShared ? sharedIndex[v] : localIndex[v]) = local;
+                        globalIndex.push_back (v);
+                        blockPositions.insert (blockPositions.end (), p + 3*v, p + 3*v + 3);
+                        blockPinned.push_back (isShared);
+                    }
+                    blockIndices[3*i+k] = local;
+                }
+            size_t blockTarget = 3 * static_cast<size_t> (double (blockShare * targetIndexCount / 3) * blockTriangleCount / triangleCount);
+            Simplifier simplifier (blockPositions.data (), globalIndex.size (), box, blockIndices, blockPinned.data ());
+            errors[c] = simplifier.run (blockTarget, targetError);
+            simplifier.forEachQuadric ([&] (unsigned int v, const Quadric & q) { carried[canonical[globalIndex[v]]] = q; });
+            for (unsigned int & i : blockIndices)
+                i = globalIndex[i];
+            results[c].swap (blockIndices);
+        }
+    });
+
+    indices.clear ();
+    for (const std::vector<unsigned int> & result : results)
+        indices.insert (indices.end (), result.begin (), result.end ());
+    return *std::max_element (errors.begin (), errors.end ());
+}
+
+float MeshSimplifier::simplify (const Geometry & geometry, std::vector<unsigned int> & indices, size_t targetIndexCount, float targetError) {
+    if (indices.size () <= targetIndexCount)
+        return 0.f;
+    const float * p = geometry.vertexPositions.data ();
+    size_t vertexCount = geometry.vertexCount ();
+    UnitBox box = unitBox (p, vertexCount);
+    float error = 0.f;
+    std::vector<Quadric> carried;
+    if (indices.size () / 3 >= 2 * blockTriangles) {
+        error = simplifyBlocks (p, vertexCount, box, indices, targetIndexCount, targetError, carried);
+        if (indices.size () <= targetIndexCount)
+            return error;
+    }
+    // The errors of the two passes add up at most
+    Simplifier simplifier (p, vertexCount, box, indices, nullptr, carried.empty () ? nullptr : carried.data ());
+    return error + simplifier.run (targetIndexCount, targetError - error);
+}
@@ -0,0 +1,23 @@
+#ifndef _MESH_SIMPLIFIER_H
+#define _MESH_SIMPLIFIER_H
+
+#include <vector>
+#include <cstddef>
+
+#include "Geometry.hpp"
+
+// Quadric error edge collapse (Garland and Heckbert), restricted to moving a vertex onto one of its
+// neighbors: no vertex is created, so every attribute stream stays valid and the index lists of
+// several levels of detail can share one vertex buffer.
+class MeshSimplifier {
+public:
+	// Collapses edges of the triangles of indices, cheapest first, until at most targetIndexCount
+	// indices remain or the next collapse would move the surface by more than targetError.
+	// Errors are distances relative to the largest extent of the geometry. Vertices on attribute
+	// seams and non-manifold edges stay in place, border vertices only slide along the border.
+	// Large meshes are first simplified in spatial blocks on the thread pool, then as a whole.
+	// Returns the largest error of the collapses made, the sum of both passes' for large meshes.
+	static float simplify (const Geometry & geometry, std::vector<unsigned int> & indices, size_t targetIndexCount, float targetError);
+};
+
+#endif //_MESH_SIMPLIFIER_H
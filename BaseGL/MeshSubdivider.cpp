@@ -0,0 +1,140 @@
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "MeshSubdivider.hpp"
+#include "MeshTopology.hpp"
+#include "ThreadPool.hpp"
+
+static const unsigned int none = MeshTopology::none;
+
+// Weight of each neighbor of an interior vertex of the given degree (Loop)
+static float loopWeight (size_t degree) {
+    float c = 0.375f + 0.25f * std::cos (glm::two_pi<float> () / degree);
+    return (0.625f - c * c) / degree;
+}
+
+// The attribute streams, all weighted the same way
+struct SubdividedStreams {
+    const float * in[3];
+    float * out[3];
+    size_t count = 0;
+
+    void add (const std::vector<float> & source, std::vector<float> & destination, size_t vertexCount) {
+        if (source.empty ())
+            return;
+        destination.resize (3 * vertexCount);
+        in[count] = source.data ();
+        out[count] = destination.data ();
+        count++;
+    }
+};
+
+bool MeshSubdivider::subdivide (Geometry & geometry) {
+    ThreadPool & pool = ThreadPool::instance ();
+    const std::vector<unsigned int> & indices = geometry.triangleIndices;
+    size_t vertexCount = geometry.vertexCount (), triangleCount = indices.size () / 3;
+    MeshTopology topology (indices, vertexCount);
+    size_t edgeCount = topology.edgeCount ();
+    if (vertexCount + edgeCount > none) {
+        std::cerr << "ERROR: subdivision into " << vertexCount + edgeCount << " vertices, too many for 32-bit indices" << std::endl;
+        return false;
+    }
+
+    size_t newVertexCount = vertexCount + edgeCount;
+    std::vector<float> positions, colors, normals;
+    SubdividedStreams streams;
+    streams.add (geometry.vertexPositions, positions, newVertexCount);
+    streams.add (geometry.vertexColors, colors, newVertexCount);
+    streams.add (geometry.vertexNormals, normals, newVertexCount);
+
+    // The old vertices, smoothed over their neighbors unless they are on a crease
+    pool.parallelFor (0, vertexCount, [&] (size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            MeshTopology::Row row = topology.vertexNeighbors (unsigned (v));
+            bool crease = row.size () == 0;
+            for (size_t i = 0; i < row.size () && !crease; i++)
+                crease = !topology.isManifold (topology.neighborEdge (unsigned (v), i));
+            float weight = crease ? 0.f : loopWeight (row.size ());
+            for (size_t s = 0; s < streams.count; s++) {
+                glm::vec3 sum (0.f);
+                for (size_t i = 0; i < row.size () && !crease; i++) {
+                    const float * n = streams.in[s] + 3 * size_t (row[i]);
+                    sum += glm::vec3 (n[0], n[1], n[2]);
+                }
+                const float * p = streams.in[s] + 3*v;
+                glm::vec3 result = (1.f - weight * row.size ()) * glm::vec3 (p[0], p[1], p[2]) + weight * sum;
+                for (int c = 0; c < 3; c++)
+                    streams.out[s][3*v + c] = result[c];
+            }
+        }
+    });
+
+    // The new vertices, 3/8 of each end and 1/8 of each opposite corner, or midpoints on creases
+    pool.parallelFor (0, edgeCount, [&] (size_t begin, size_t end) {
+        for (size_t e = begin; e < end; e++) {
+            unsigned int a = topology.edgeVertex (unsigned (e), 0), b = topology.edgeVertex (unsigned (e), 1);
+            bool crease = !topology.isManifold (unsigned (e));
+            unsigned int opposite[2];
+            for (unsigned int k = 0; k < 2 && !crease; k++) {
+                const unsigned int * corner = &indices[3 * size_t (topology.edgeTriangle (unsigned (e), k))];
+                opposite[k] = corner[0] != a && corner[0] != b ? corner[0] : (corner[1] != a && corner[1] != b ? corner[1] : corner[2]);
+            }
+            for (size_t s = 0; s < streams.count; s++) {
+                const float * pa = streams.in[s] + 3 * size_t (a), * pb = streams.in[s] + 3 * size_t (b);
+                float * out = streams.out[s] + 3 * (vertexCount + e);
+                if (crease) {
+                    for (int c = 0; c < 3; c++)
+                        out[c] = 0.5f * (pa[c] + pb[c]);
+                } else {
+                    const float * c0 = streams.in[s] + 3 * size_t (opposite[0]), * c1 = streams.in[s] + 3 * size_t (opposite[1]);
+                    for (int c = 0; c < 3; c++)
+                        out[c] = 0.375f * (pa[c] + pb[c]) + 0.125f * (c0[c] + c1[c]);
+                }
+            }
+        }
+    });
+    if (!normals.empty ()) {
+        pool.parallelFor (0, newVertexCount, [&] (size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++) {
+                glm::vec3 n (normals[3*v], normals[3*v+1], normals[3*v+2]);
+                float length = glm::length (n);
+                if (length > 0.f)
+                    for (int c = 0; c < 3; c++)
+                        normals[3*v + c] /= length;
+            }
+        });
+    }
+
+    // Four triangles in place of each one, the middle one joining the new vertices. A degenerate
+    // triangle has no edge between its repeated corners: it stays whole, the rest of its slots
+    // marked none and dropped afterwards.
+    std::vector<unsigned int> newIndices (12 * triangleCount);
+    std::atomic<bool> unsplit (false);
+    pool.parallelFor (0, triangleCount, [&] (size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            unsigned int a = indices[3*t], b = indices[3*t + 1], c = indices[3*t + 2];
+            unsigned int eab = topology.triangleEdge (t, 0), ebc = topology.triangleEdge (t, 1), eca = topology.triangleEdge (t, 2);
+            if (eab == none || ebc == none || eca == none) {
+                unsigned int whole[12] = { a, b, c, none, none, none, none, none, none, none, none, none };
+                std::copy (whole, whole + 12, newIndices.begin () + 12*t);
+                unsplit = true;
+                continue;
+            }
+            unsigned int ab = unsigned (vertexCount) + eab, bc = unsigned (vertexCount) + ebc, ca = unsigned (vertexCount) + eca;
+            unsigned int split[12] = { a, ab, ca, ab, b, bc, ca, bc, c, ab, bc, ca };
+            std::copy (split, split + 12, newIndices.begin () + 12*t);
+        }
+    });
+    if (unsplit)
+        newIndices.erase (std::remove (newIndices.begin (), newIndices.end (), none), newIndices.end ());
+
+    geometry.vertexPositions.swap (positions);
+    geometry.vertexColors.swap (colors);
+    geometry.vertexNormals.swap (normals);
+    geometry.triangleIndices.swap (newIndices);
+    return true;
+}
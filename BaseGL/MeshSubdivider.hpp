@@ -0,0 +1,25 @@
+#ifndef _MESH_SUBDIVIDER_H
+#define _MESH_SUBDIVIDER_H
+
+#include "Geometry.hpp"
+
+// Loop subdivision: each triangle is split in four through a new vertex on each of its edges, and
+// the vertices move toward a smooth limit surface. Every pass runs in parallel over the vertices,
+// the edges or the triangles, reading the neighbors of a vertex from the adjacency in compressed
+// rows (MeshTopology) rather than walking half-edges.
+//
+// An edge is smooth when exactly two triangles share it, in opposite directions. Any other edge (a
+// border, a seam between two copies of the same vertex, a non-manifold or inconsistently oriented
+// edge) is a crease refined linearly: its new vertex is its midpoint, and its vertices stay in
+// place, so that copies of a vertex on both sides of a seam never move apart. Welding identical
+// vertices first (Mesh::compact) leaves the seams between different attributes only. A degenerate
+// triangle, with a repeated corner, is kept unsplit.
+class MeshSubdivider {
+public:
+	// One level, on every triangle of triangleIndices. The new vertices follow the old ones, their
+	// colors and normals (if any) weighted as the positions. Returns false, after printing why, if
+	// the result would need more than 32-bit indices; the geometry is then unchanged.
+	static bool subdivide (Geometry & geometry);
+};
+
+#endif //_MESH_SUBDIVIDER_H
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "MeshTopology.hpp"
+#include "ThreadPool.hpp"
+
+const unsigned int MeshTopology::none;
+
+// Other end of an edge at a vertex, found in one of its triangles, packed to sort as an integer:
+// the vertex, then 0 when the triangle goes from the vertex to it or 1 the other way, then the
+// triangle, which fits in 31 bits
+typedef uint64_t NeighborCorner;
+
+static NeighborCorner neighborCorner (unsigned int vertex, unsigned int incoming, unsigned int triangle) {
+    return uint64_t (vertex) << 32 | uint64_t (incoming) << 31 | triangle;
+}
+
+static unsigned int cornerVertex (NeighborCorner corner) { return static_cast<unsigned int> (corner >> 32); }
+static unsigned int cornerIncoming (NeighborCorner corner) { return (corner >> 31) & 1; }
+static unsigned int cornerTriangle (NeighborCorner corner) { return corner & 0x7fffffff; }
+
+// The corners following and preceding v in each of its triangles, sorted
+static void gatherNeighbors (const std::vector<unsigned int> & indices, unsigned int v, const unsigned int * first, const unsigned int * last,
+                             std::vector<NeighborCorner> & corners) {
+    corners.clear ();
+    for (const unsigned int * t = first; t < last; t++) {
+        const unsigned int * corner = &indices[3 * size_t (*t)];
+        unsigned int k = corner[0] == v ? 0 : (corner[1] == v ? 1 : 2);
+        unsigned int next = corner[(k+1) % 3], previous = corner[(k+2) % 3];
+        if (next != v)
+            corners.push_back (neighborCorner (next, 0, *t));
+        if (previous != v)
+            corners.push_back (neighborCorner (previous, 1, *t));
+    }
+    std::sort (corners.begin (), corners.end ());
+}
+
+MeshTopology::MeshTopology (const std::vector<unsigned int> & indices, size_t vertexCount, bool edges) {
+    ThreadPool & pool = ThreadPool::instance ();
+    size_t triangleCount = indices.size () / 3;
+
+    // Count and scatter the triangles into the rows of their corners, then sort the rows
+    std::vector<std::atomic<unsigned int>> cursors (vertexCount);
+    pool.parallelFor (0, triangleCount, [&] (size_t first, size_t last) {
+        for (size_t i = 3 * first; i < 3 * last; i++)
+            cursors[indices[i]].fetch_add (1, std::memory_order_relaxed);
+    });
+    triangleFirst.resize (vertexCount + 1);
+    triangleFirst[0] = 0;
+    for (size_t v = 0; v < vertexCount; v++) {
+        triangleFirst[v+1] = triangleFirst[v] + cursors[v].load (std::memory_order_relaxed);
+        cursors[v].store (0, std::memory_order_relaxed);
+    }
+    triangles.resize (triangleFirst[vertexCount]);
+    pool.parallelFor (0, triangleCount, [&] (size_t first, size_t last) {
+        for (size_t t = first; t < last; t++) {
+            for (unsigned int k = 0; k < 3; k++) {
+                unsigned int v = indices[3*t + k];
+                triangles[triangleFirst[v] + cursors[v].fetch_add (1, std::memory_order_relaxed)] = static_cast<unsigned int> (t);
+            }
+        }
+    });
+    if (!edges) {
+        pool.parallelFor (0, vertexCount, [&] (size_t first, size_t last) {
+            for (size_t v = first; v < last; v++)
+                std::sort (triangles.data () + triangleFirst[v], triangles.data () + triangleFirst[v+1]);
+        });
+        return;
+    }
+
+    // Neighbors gathered by each vertex from its own triangles: counted, then written once the
+    // offsets are known. The edges to the higher neighbors are numbered in the row.
+    std::vector<unsigned int> neighborCount (vertexCount), lowerCount (vertexCount);
+    pool.parallelFor (0, vertexCount, [&] (size_t first, size_t last) {
+        std::vector<NeighborCorner> corners;
+        for (size_t v = first; v < last; v++) {
+            unsigned int * row = triangles.data () + triangleFirst[v], * rowEnd = triangles.data () + triangleFirst[v+1];
+            std::sort (row, rowEnd);
+            gatherNeighbors (indices, unsigned (v), row, rowEnd, corners);
+            unsigned int count = 0, lower = 0;
+            for (size_t i = 0; i < corners.size (); i++) {
+                if (i > 0 && cornerVertex (corners[i]) == cornerVertex (corners[i-1]))
+                    continue;
+                count++;
+                lower += cornerVertex (corners[i]) < v;
+            }
+            neighborCount[v] = count;
+            lowerCount[v] = lower;
+        }
+    });
+    neighborFirst.resize (vertexCount + 1);
+    edgeFirst.resize (vertexCount + 1);
+    higherFirst.resize (vertexCount);
+    neighborFirst[0] = edgeFirst[0] = 0;
+    for (size_t v = 0; v < vertexCount; v++) {
+        neighborFirst[v+1] = neighborFirst[v] + neighborCount[v];
+        edgeFirst[v+1] = edgeFirst[v] + neighborCount[v] - lowerCount[v];
+        higherFirst[v] = neighborFirst[v] + lowerCount[v];
+    }
+    size_t edgeCount = edgeFirst[vertexCount];
+    neighbors.resize (neighborFirst[vertexCount]);
+    edgeVertices.resize (2 * edgeCount);
+    edgeTriangles.resize (2 * edgeCount);
+    edgeTriangleCounts.resize (edgeCount);
+    pool.parallelFor (0, vertexCount, [&] (size_t first, size_t last) {
+        std::vector<NeighborCorner> corners;
+        for (size_t v = first; v < last; v++) {
+            gatherNeighbors (indices, unsigned (v), triangles.data () + triangleFirst[v], triangles.data () + triangleFirst[v+1], corners);
+            unsigned int * neighbor = &neighbors[neighborFirst[v]];
+            size_t e = edgeFirst[v];
+            for (size_t i = 0, end; i < corners.size (); i = end) {
+                unsigned int w = cornerVertex (corners[i]);
+                end = i;
+                while (end < corners.size () && cornerVertex (corners[end]) == w)
+                    end++;
+                *neighbor++ = w;
+                if (w < v)
+                    continue;
+                // The group is sorted by direction, then by triangle
+                edgeVertices[2*e] = unsigned (v);
+                edgeVertices[2*e + 1] = w;
+                edgeTriangles[2*e] = cornerIncoming (corners[i]) == 0 ? cornerTriangle (corners[i]) : none;
+                size_t j = i;
+                while (j < end && cornerIncoming (corners[j]) == 0)
+                    j++;
+                edgeTriangles[2*e + 1] = j < end ? cornerTriangle (corners[j]) : none;
+                edgeTriangleCounts[e] = static_cast<unsigned char> (std::min<size_t> (end - i, 255));
+                e++;
+            }
+        }
+    });
+
+    triangleEdges.resize (3 * triangleCount);
+    pool.parallelFor (0, triangleCount, [&] (size_t first, size_t last) {
+        for (size_t t = first; t < last; t++)
+            for (unsigned int k = 0; k < 3; k++)
+                triangleEdges[3*t + k] = findEdge (indices[3*t + k], indices[3*t + (k+1) % 3]);
+    });
+}
+
+size_t MeshTopology::vertexCount () const {
+    return triangleFirst.size () - 1;
+}
+
+size_t MeshTopology::triangleCount () const {
+    return triangles.size () / 3;
+}
+
+size_t MeshTopology::edgeCount () const {
+    return edgeTriangleCounts.size ();
+}
+
+MeshTopology::Row MeshTopology::vertexTriangles (unsigned int v) const {
+    return { triangles.data () + triangleFirst[v], triangles.data () + triangleFirst[v+1] };
+}
+
+MeshTopology::Row MeshTopology::vertexNeighbors (unsigned int v) const {
+    return { neighbors.data () + neighborFirst[v], neighbors.data () + neighborFirst[v+1] };
+}
+
+unsigned int MeshTopology::neighborEdge (unsigned int v, size_t i) const {
+    size_t entry = neighborFirst[v] + i;
+    if (entry < higherFirst[v])
+        return findEdge (neighbors[entry], v);
+    return static_cast<unsigned int> (edgeFirst[v] + (entry - higherFirst[v]));
+}
+
+unsigned int MeshTopology::findEdge (unsigned int a, unsigned int b) const {
+    unsigned int low = std::min (a, b), high = std::max (a, b);
+    if (low == high)
+        return none;
+    for (size_t entry = higherFirst[low]; entry < neighborFirst[low + 1]; entry++)
+        if (neighbors[entry] == high)
+            return static_cast<unsigned int> (edgeFirst[low] + (entry - higherFirst[low]));
+    return none;
+}
+
+unsigned int MeshTopology::triangleEdge (size_t t, unsigned int k) const {
+    return triangleEdges[3*t + k];
+}
+
+unsigned int MeshTopology::edgeVertex (unsigned int e, unsigned int k) const {
+    return edgeVertices[2 * size_t (e) + k];
+}
+
+unsigned int MeshTopology::edgeTriangle (unsigned int e, unsigned int k) const {
+    return edgeTriangles[2 * size_t (e) + k];
+}
+
+unsigned int MeshTopology::edgeTriangleCount (unsigned int e) const {
+    return edgeTriangleCounts[e];
+}
+
+bool MeshTopology::isManifold (unsigned int e) const {
+    return edgeTriangleCounts[e] == 2 && edgeTriangles[2 * size_t (e)] != none && edgeTriangles[2 * size_t (e) + 1] != none;
+}
+
+bool MeshTopology::isBorder (unsigned int e) const {
+    return edgeTriangleCounts[e] == 1;
+}
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Meshlet.hpp"
+#include "Geometry.hpp"
+
+static glm::vec3 vertexPosition (const Geometry & g, unsigned int v) {
+    return glm::vec3 (g.vertexPositions[3*v], g.vertexPositions[3*v+1], g.vertexPositions[3*v+2]);
+}
+
+// Computes the bounding sphere and the normal cone of the triangles [firstIndex, firstIndex + indexCount)
+static Meshlet computeBounds (const Geometry & g, unsigned int firstIndex, unsigned int indexCount) {
+    const unsigned int * indices = &g.triangleIndices[firstIndex];
+    Meshlet meshlet;
+    meshlet.firstIndex = firstIndex;
+    meshlet.indexCount = indexCount;
+
+    // Sphere centered on the bounding box
+    glm::vec3 lo = vertexPosition (g, indices[0]), hi = lo;
+    for (unsigned int i = 1; i < indexCount; i++) {
+        lo = glm::min (lo, vertexPosition (g, indices[i]));
+        hi = glm::max (hi, vertexPosition (g, indices[i]));
+    }
+    meshlet.center = 0.5f * (lo + hi);
+    meshlet.radius = 0.f;
+    for (unsigned int i = 0; i < indexCount; i++)
+        meshlet.radius = std::max (meshlet.radius, glm::length (vertexPosition (g, indices[i]) - meshlet.center));
+
+    // Cone around the mean of the unit normals, with the counter-clockwise front faces of OpenGL
+    std::vector<glm::vec3> normals;
+    normals.reserve (indexCount / 3);
+    glm::vec3 sum (0.f);
+    for (unsigned int t = 0; t + 2 < indexCount; t += 3) {
+        glm::vec3 a = vertexPosition (g, indices[t]), b = vertexPosition (g, indices[t+1]), c = vertexPosition (g, indices[t+2]);
+        glm::vec3 n = glm::cross (b - a, c - a);
+        float length = glm::length (n);
+        if (length > 0.f) { // Degenerate triangles are never rasterized and do not constrain the cone
+            normals.push_back (n / length);
+            sum += n / length;
+        }
+    }
+    float sumLength = glm::length (sum);
+    meshlet.coneAxis = sumLength > 0.f ? sum / sumLength : glm::vec3 (0.f, 0.f, 1.f);
+    float minCos = 1.f;
+    for (const glm::vec3 & n : normals)
+        minCos = std::min (minCos, glm::dot (n, meshlet.coneAxis));
+    // A half-angle of 90 degrees or more leaves no direction from which the whole cluster is back-facing
+    meshlet.coneCutoff = (sumLength == 0.f || minCos <= 0.f) ? 2.f : std::sqrt (1.f - minCos * minCos);
+    return meshlet;
+}
+
+std::vector<Meshlet> MeshletBuilder::build (const Geometry & geometry, size_t maxVertices, size_t maxTriangles) {
+    const std::vector<unsigned int> & indices = geometry.triangleIndices;
+    maxVertices = std::max<size_t> (maxVertices, 3); // Room for one triangle at least
+    maxTriangles = std::max<size_t> (maxTriangles, 1);
+    std::vector<Meshlet> meshlets;
+    std::vector<unsigned int> lastMeshlet (geometry.vertexCount (), ~0u); // Last meshlet that used each vertex
+    unsigned int current = 0;
+
+    for (size_t l = 0; l < geometry.levelCount (); l++) { // Each level is split on its own, so that a meshlet never spans two
+        GeometryLevel level = geometry.level (l);
+        size_t first = level.firstIndex, end = level.firstIndex + level.indexCount, vertexCount = 0;
+        current++;
+        for (size_t t = first; t + 2 < end; t += 3) {
+            size_t newVertices = 0;
+            for (size_t k = 0; k < 3; k++)
+                if (lastMeshlet[indices[t+k]] != current)
+                    newVertices++;
+            if (t > first && (vertexCount + newVertices > maxVertices || (t - first) / 3 + 1 > maxTriangles)) {
+                meshlets.push_back (computeBounds (geometry, first, t - first));
+                current++;
+                first = t;
+                vertexCount = 0;
+            }
+            for (size_t k = 0; k < 3; k++)
+                if (lastMeshlet[indices[t+k]] != current) {
+                    lastMeshlet[indices[t+k]] = current;
+                    vertexCount++;
+                }
+        }
+        if (first < end)
+            meshlets.push_back (computeBounds (geometry, first, end - first));
+    }
+    return meshlets;
+}
+
+MeshletCuller::MeshletCuller (const glm::mat4 & modelViewMatrix, const glm::mat4 & projectionMatrix) {
+    // Planes of the clip volume pulled back to object space (Gribb and Hartmann)
+    glm::mat4 m = glm::transpose (projectionMatrix * modelViewMatrix);
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[3] + m[2];
+    planes[5] = m[3] - m[2];
+    for (glm::vec4 & plane : planes)
+        plane /= glm::length (glm::vec3 (plane));
+    eye = glm::vec3 (glm::inverse (modelViewMatrix) * glm::vec4 (0.f, 0.f, 0.f, 1.f));
+}
+
+bool MeshletCuller::isVisible (const glm::vec3 & center, float radius) const {
+    for (const glm::vec4 & plane : planes)
+        if (glm::dot (glm::vec3 (plane), center) + plane.w < -radius)
+            return false;
+    return true;
+}
+
+bool MeshletCuller::isVisible (const Meshlet & meshlet) const {
+    if (!isVisible (meshlet.center, meshlet.radius))
+        return false;
+
+    // Back-facing if, from every point of the sphere, every normal of the cone points away from the eye
+    glm::vec3 toCenter = meshlet.center - eye;
+    float distance = glm::length (toCenter);
+    if (glm::dot (toCenter, meshlet.coneAxis) > meshlet.coneCutoff * distance + meshlet.radius * (1.f + meshlet.coneCutoff))
+        return false;
+    return true;
+}
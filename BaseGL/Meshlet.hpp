@@ -0,0 +1,42 @@
+#ifndef _MESHLET_H
+#define _MESHLET_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+class Geometry;
+
+// Cluster of consecutive triangles of a Geometry's index buffer, with the bounds used to
+// skip it on the CPU when it is outside the frustum or entirely back-facing.
+struct Meshlet {
+	unsigned int firstIndex; // Offset of the first index in triangleIndices
+	unsigned int indexCount;
+	glm::vec3 center; // Bounding sphere
+	float radius;
+	glm::vec3 coneAxis; // Normal cone: every triangle normal lies within its half-angle of the axis
+	float coneCutoff; // Sine of the half-angle, or more than 1 when the cone is too wide to ever cull
+};
+
+class MeshletBuilder {
+public:
+	// Splits each level of the index buffer into runs of at most maxVertices distinct vertices and maxTriangles
+	// triangles, raised to 3 and 1 if lower. Runs follow the current triangle order, so a cache-optimized order
+	// gives compact clusters.
+	static std::vector<Meshlet> build (const Geometry & geometry, size_t maxVertices = 64, size_t maxTriangles = 124);
+};
+
+// Visibility tests of meshlets for one object and one camera, carried out in object space
+class MeshletCuller {
+public:
+	MeshletCuller (const glm::mat4 & modelViewMatrix, const glm::mat4 & projectionMatrix);
+
+	bool isVisible (const Meshlet & meshlet) const;
+	bool isVisible (const glm::vec3 & center, float radius) const; // Frustum test alone, of a bounding sphere
+
+private:
+	glm::vec4 planes[6]; // Frustum planes in object space, normalized so that they give distances
+	glm::vec3 eye; // Camera position in object space
+};
+
+#endif //_MESHLET_H
@@ -0,0 +1,459 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "ObjLoader.hpp"
+#include "MappedFile.hpp"
+#include "MeshNormals.hpp"
+#include "ThreadPool.hpp"
+
+static const size_t minChunkBytes = 1 << 20; // Below this, a chunk is not worth a job
+static const unsigned int noIndex = std::numeric_limits<unsigned int>::max ();
+
+// Slice of the file starting at the beginning of a line. The first pass fills the counts, their
+// prefix sums give the first element of the chunk in the output streams.
+struct ObjChunk {
+    const char * begin;
+    const char * end;
+    size_t lineCount = 0;
+    size_t positionCount = 0;
+    size_t texcoordCount = 0;
+    size_t normalCount = 0;
+    size_t triangleCount = 0;
+    bool colors = false; // The first position of the chunk has a color
+    size_t firstLine = 0, firstPosition = 0, firstTexcoord = 0, firstNormal = 0, firstTriangle = 0;
+    const char * error = nullptr; // Set by the second pass, which stops at the first malformed line
+    size_t errorLine = 0;
+};
+
+// Totals of the whole file, the bounds of the face indices
+struct ObjCounts {
+    size_t positionCount;
+    size_t texcoordCount;
+    size_t normalCount;
+};
+
+/*
+ * Locale-independent number parsing, on the unterminated text of the mapping
+ */
+
+static bool isBlank (char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool isDigit (char c) {
+    return static_cast<unsigned char> (c - '0') < 10;
+}
+
+static const char * skipBlanks (const char * p, const char * end) {
+    while (p < end && isBlank (*p))
+        p++;
+    return p;
+}
+
+static const char * lineEnd (const char * p, const char * end) {
+    const char * newline = static_cast<const char *> (std::memchr (p, '\n', end - p));
+    return newline ? newline : end;
+}
+
+// Start of the line after the one ending at lineEnd
+static const char * nextLine (const char * lineEnd, const char * end) {
+    return lineEnd < end ? lineEnd + 1 : end;
+}
+
+// Decimal mantissa of up to 18 digits, scaled by an exact power of ten when it is in the table:
+// the result is then correctly rounded for any mantissa below 2^53, which covers every float
+static bool parseFloat (const char *& p, const char * end, float & value) {
+    static const double powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const uint64_t maxMantissa = 100000000000000000ull; // More digits cannot change a float
+    const char * s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+    uint64_t mantissa = 0;
+    int exponent = 0, digitCount = 0;
+    for (; s < end && isDigit (*s); s++, digitCount++) {
+        if (mantissa < maxMantissa)
+            mantissa = 10 * mantissa + (*s - '0');
+        else
+            exponent++;
+    }
+    if (s < end && *s == '.') {
+        for (s++; s < end && isDigit (*s); s++, digitCount++) {
+            if (mantissa < maxMantissa) {
+                mantissa = 10 * mantissa + (*s - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digitCount == 0)
+        return false;
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char * e = s + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
+        if (e < end && isDigit (*e)) {
+            int e10 = 0;
+            for (; e < end && isDigit (*e); e++)
+                e10 = std::min (10 * e10 + (*e - '0'), 100000);
+            exponent += negativeExponent ? -e10 : e10;
+            s = e;
+        }
+    }
+    double v = static_cast<double> (mantissa);
+    if (exponent < 0)
+        v = exponent >= -22 ? v / powersOf10[-exponent] : v * std::pow (10.0, exponent);
+    else if (exponent > 0)
+        v = exponent <= 22 ? v * powersOf10[exponent] : v * std::pow (10.0, exponent);
+    value = static_cast<float> (negative ? -v : v);
+    p = s;
+    return true;
+}
+
+static bool parseInteger (const char *& p, const char * end, int64_t & value) {
+    const char * s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+    if (s == end || !isDigit (*s))
+        return false;
+    int64_t v = 0;
+    for (; s < end && isDigit (*s); s++)
+        v = std::min<int64_t> (10 * v + (*s - '0'), int64_t (1) << 40); // Saturated: anything that large is out of range anyway
+    value = negative ? -v : v;
+    p = s;
+    return true;
+}
+
+// Parses count blank-separated floats into out, returning how many were read
+static int parseFloats (const char *& p, const char * end, float * out, int count) {
+    for (int i = 0; i < count; i++) {
+        p = skipBlanks (p, end);
+        if (!parseFloat (p, end, out[i]))
+            return i;
+    }
+    return count;
+}
+
+// Parses a one-based index, negative when relative to the count of elements defined so far,
+// into a zero-based index below total. Returns false if it is missing or out of range.
+static bool parseIndex (const char *& p, const char * end, size_t definedCount, size_t total, unsigned int & index) {
+    int64_t value;
+    if (!parseInteger (p, end, value) || value == 0)
+        return false;
+    int64_t resolved = value > 0 ? value - 1 : static_cast<int64_t> (definedCount) + value;
+    if (resolved < 0 || resolved >= static_cast<int64_t> (total))
+        return false;
+    index = static_cast<unsigned int> (resolved);
+    return true;
+}
+
+/*
+ * The two passes over a chunk
+ */
+
+// Keyword of the line at p: 'v' (position), 't' (texture coordinate), 'n' (normal), 'f' (face), or 0
+static char keyword (const char *& p, const char * end) {
+    if (end - p < 2)
+        return 0;
+    if (p[0] == 'f' && isBlank (p[1])) {
+        p += 2;
+        return 'f';
+    }
+    if (p[0] != 'v')
+        return 0;
+    if (isBlank (p[1])) {
+        p += 2;
+        return 'v';
+    }
+    if ((p[1] == 't' || p[1] == 'n') && (end - p == 2 || isBlank (p[2]))) {
+        p += 2;
+        return p[-1];
+    }
+    return 0;
+}
+
+static size_t countTokens (const char * p, const char * end) {
+    size_t count = 0;
+    while ((p = skipBlanks (p, end)) < end) {
+        count++;
+        while (p < end && !isBlank (*p))
+            p++;
+    }
+    return count;
+}
+
+static void countChunk (ObjChunk & chunk) {
+    bool firstPosition = true;
+    for (const char * line = chunk.begin; line < chunk.end; chunk.lineCount++) {
+        const char * end = lineEnd (line, chunk.end);
+        const char * p = skipBlanks (line, end);
+        switch (keyword (p, end)) {
+        case 'v':
+            if (firstPosition)
+                chunk.colors = countTokens (p, end) >= 6;
+            firstPosition = false;
+            chunk.positionCount++;
+            break;
+        case 't':
+            chunk.texcoordCount++;
+            break;
+        case 'n':
+            chunk.normalCount++;
+            break;
+        case 'f': {
+            size_t cornerCount = countTokens (p, end);
+            if (cornerCount >= 3)
+                chunk.triangleCount += cornerCount - 2;
+            break;
+        }
+        }
+        line = nextLine (end, chunk.end);
+    }
+}
+
+// Parses the chunk into its slices of positions, colors, normals, triangle indices and, when
+// the file has normals, the normal index of every triangle corner
+static void parseChunk (ObjChunk & chunk, const ObjCounts & counts, bool colors, Geometry & geometry,
+                        std::vector<float> & normals, std::vector<unsigned int> & cornerNormals) {
+    float * position = geometry.vertexPositions.data () + 3 * chunk.firstPosition;
+    float * color = geometry.vertexColors.data () + 3 * chunk.firstPosition;
+    float * normal = normals.data () + 3 * chunk.firstNormal;
+    unsigned int * index = geometry.triangleIndices.data () + 3 * chunk.firstTriangle;
+    unsigned int * cornerNormal = cornerNormals.empty () ? nullptr : cornerNormals.data () + 3 * chunk.firstTriangle;
+    size_t positionCount = chunk.firstPosition, texcoordCount = chunk.firstTexcoord, normalCount = chunk.firstNormal;
+
+    size_t lineNumber = chunk.firstLine;
+    for (const char * line = chunk.begin; line < chunk.end; lineNumber++) {
+        const char * end = lineEnd (line, chunk.end);
+        const char * p = skipBlanks (line, end);
+        const char * error = nullptr;
+        switch (keyword (p, end)) {
+        case 'v': {
+            if (parseFloats (p, end, position, 3) < 3)
+                error = "malformed position";
+            if (colors) {
+                color[0] = color[1] = color[2] = 1.f; // White if this position has no color
+                parseFloats (p, end, color, 3);
+                color += 3;
+            }
+            position += 3;
+            positionCount++;
+            break;
+        }
+        case 't':
+            texcoordCount++;
+            break;
+        case 'n':
+            if (parseFloats (p, end, normal, 3) < 3)
+                error = "malformed normal";
+            normal += 3;
+            normalCount++;
+            break;
+        case 'f': {
+            // Corners v, v/vt, v//vn or v/vt/vn, fanned around the first one
+            unsigned int first[2], previous[2];
+            size_t cornerCount = 0;
+            while (!error && (p = skipBlanks (p, end)) < end) {
+                unsigned int corner[2] = { noIndex, noIndex }, texcoord;
+                if (!parseIndex (p, end, positionCount, counts.positionCount, corner[0]))
+                    error = "bad position index";
+                else if (p < end && *p == '/') {
+                    p++;
+                    if (p < end && *p != '/' && !parseIndex (p, end, texcoordCount, counts.texcoordCount, texcoord))
+                        error = "bad texture coordinate index";
+                    else if (p < end && *p == '/') {
+                        p++;
+                        if (!parseIndex (p, end, normalCount, counts.normalCount, corner[1]))
+                            error = "bad normal index";
+                    }
+                }
+                if (!error && p < end && !isBlank (*p))
+                    error = "malformed face";
+                if (error)
+                    break;
+                if (cornerCount >= 2) {
+                    index[0] = first[0];
+                    index[1] = previous[0];
+                    index[2] = corner[0];
+                    index += 3;
+                    if (cornerNormal) {
+                        cornerNormal[0] = first[1];
+                        cornerNormal[1] = previous[1];
+                        cornerNormal[2] = corner[1];
+                        cornerNormal += 3;
+                    }
+                }
+                if (cornerCount == 0)
+                    std::copy (corner, corner + 2, first);
+                std::copy (corner, corner + 2, previous);
+                cornerCount++;
+            }
+            break;
+        }
+        }
+        if (error) {
+            chunk.error = error;
+            chunk.errorLine = lineNumber + 1;
+            return;
+        }
+        line = nextLine (end, chunk.end);
+    }
+}
+
+/*
+ * Vertices: one per distinct (position, normal) pair of the corners
+ */
+
+// Without normals, the vertices are the positions. Otherwise each position becomes the vertex of the
+// first corner using it, in file order, and the corners pairing it with another normal get vertices
+// of their own, appended once per distinct pair. Nearly every corner of a scan agrees with the first
+// one, so the pairs are mostly resolved in parallel, and only the rest go through the hash map.
+static void buildVertices (Geometry & geometry, const std::vector<float> & normals, const std::vector<unsigned int> & cornerNormals) {
+    std::vector<unsigned int> & indices = geometry.triangleIndices;
+    size_t positionCount = geometry.vertexCount (), cornerCount = indices.size ();
+    ThreadPool & pool = ThreadPool::instance ();
+
+    // First corner of every position, by atomic minimum
+    std::unique_ptr<std::atomic<size_t>[]> firstCorner (new std::atomic<size_t>[positionCount]);
+    pool.parallelFor (0, positionCount, [&] (size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++)
+            firstCorner[v].store (cornerCount, std::memory_order_relaxed);
+    });
+    pool.parallelFor (0, cornerCount, [&] (size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            std::atomic<size_t> & first = firstCorner[indices[c]];
+            size_t current = first.load (std::memory_order_relaxed);
+            while (c < current && !first.compare_exchange_weak (current, c, std::memory_order_relaxed)) {}
+        }
+    });
+
+    geometry.vertexNormals.resize (3 * positionCount);
+    pool.parallelFor (0, positionCount, [&] (size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            size_t c = firstCorner[v].load (std::memory_order_relaxed);
+            unsigned int n = c < cornerCount ? cornerNormals[c] : noIndex;
+            for (int i = 0; i < 3; i++)
+                geometry.vertexNormals[3*v+i] = n != noIndex ? normals[3*n+i] : 0.f;
+        }
+    });
+
+    // Corners disagreeing with the first corner of their position, per block to keep the file order
+    size_t blockCount = 4 * pool.threadCount ();
+    std::vector<std::vector<size_t>> splitCorners (blockCount);
+    pool.parallelFor (0, blockCount, [&] (size_t firstBlock, size_t lastBlock) {
+        for (size_t b = firstBlock; b < lastBlock; b++)
+            for (size_t c = cornerCount * b / blockCount; c < cornerCount * (b + 1) / blockCount; c++)
+                if (cornerNormals[c] != cornerNormals[firstCorner[indices[c]].load (std::memory_order_relaxed)])
+                    splitCorners[b].push_back (c);
+    });
+
+    std::unordered_map<uint64_t, unsigned int> splitVertices;
+    for (const std::vector<size_t> & block : splitCorners) {
+        for (size_t c : block) {
+            unsigned int v = indices[c], n = cornerNormals[c];
+            auto inserted = splitVertices.emplace ((uint64_t (v) << 32) | n, static_cast<unsigned int> (geometry.vertexCount ()));
+            if (inserted.second) {
+                for (int i = 0; i < 3; i++) {
+                    float position = geometry.vertexPositions[3*v+i], color = geometry.vertexColors[3*v+i];
+                    geometry.vertexPositions.push_back (position);
+                    geometry.vertexColors.push_back (color);
+                    geometry.vertexNormals.push_back (n != noIndex ? normals[3*n+i] : 0.f);
+                }
+            }
+            indices[c] = inserted.first->second;
+        }
+    }
+}
+
+std::shared_ptr<Geometry> ObjLoader::load (const std::string & filename) {
+    size_t size = 0;
+    std::shared_ptr<const void> storage = MappedFile::map (filename, size);
+    if (!storage) {
+        std::cerr << "ERROR: Cannot map OBJ file " << filename << std::endl;
+        return nullptr;
+    }
+    const char * text = static_cast<const char *> (storage.get ());
+    ThreadPool & pool = ThreadPool::instance ();
+
+    // Chunks of about equal size, each moved forward to the start of a line
+    size_t chunkCount = std::max<size_t> (1, std::min (size / minChunkBytes, 16 * pool.threadCount ()));
+    std::vector<ObjChunk> chunks;
+    const char * begin = text;
+    for (size_t c = 1; c <= chunkCount && begin < text + size; c++) {
+        const char * end = text + size;
+        if (c < chunkCount)
+            end = std::max (begin, nextLine (lineEnd (text + size * c / chunkCount, end), end));
+        if (end > begin) {
+            chunks.emplace_back ();
+            chunks.back ().begin = begin;
+            chunks.back ().end = end;
+        }
+        begin = end;
+    }
+
+    pool.parallelFor (0, chunks.size (), [&] (size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+            countChunk (chunks[c]);
+    });
+    ObjChunk total = {};
+    for (ObjChunk & chunk : chunks) {
+        chunk.firstLine = total.lineCount;
+        chunk.firstPosition = total.positionCount;
+        chunk.firstTexcoord = total.texcoordCount;
+        chunk.firstNormal = total.normalCount;
+        chunk.firstTriangle = total.triangleCount;
+        total.lineCount += chunk.lineCount;
+        total.positionCount += chunk.positionCount;
+        total.texcoordCount += chunk.texcoordCount;
+        total.normalCount += chunk.normalCount;
+        total.triangleCount += chunk.triangleCount;
+    }
+    if (total.positionCount == 0 || total.triangleCount == 0) {
+        std::cerr << "ERROR: No triangles in OBJ file " << filename << std::endl;
+        return nullptr;
+    }
+    if (total.positionCount >= noIndex / 2 || 3 * total.triangleCount >= noIndex) {
+        std::cerr << "ERROR: OBJ file " << filename << " is too large for 32-bit indices" << std::endl;
+        return nullptr;
+    }
+    bool colors = std::find_if (chunks.begin (), chunks.end (), [] (const ObjChunk & chunk) { return chunk.positionCount > 0; })->colors;
+
+    std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> ();
+    geometry->allocate ({ total.positionCount, 3 * total.triangleCount });
+    std::vector<float> normals (3 * total.normalCount);
+    std::vector<unsigned int> cornerNormals (total.normalCount > 0 ? 3 * total.triangleCount : 0);
+    ObjCounts counts = { total.positionCount, total.texcoordCount, total.normalCount };
+    pool.parallelFor (0, chunks.size (), [&] (size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+            parseChunk (chunks[c], counts, colors, *geometry, normals, cornerNormals);
+    });
+    for (const ObjChunk & chunk : chunks) {
+        if (chunk.error) {
+            std::cerr << "ERROR: " << filename << ":" << chunk.errorLine << ": " << chunk.error << std::endl;
+            return nullptr;
+        }
+    }
+
+    if (!colors) {
+        pool.parallelFor (0, geometry->vertexColors.size (), [&] (size_t first, size_t last) {
+            std::fill (geometry->vertexColors.begin () + first, geometry->vertexColors.begin () + last, 1.f);
+        });
+    }
+    if (total.normalCount > 0)
+        buildVertices (*geometry, normals, cornerNormals);
+    else
+        MeshNormals::compute (*geometry);
+    geometry->computeBounds ();
+    return geometry;
+}
@@ -0,0 +1,22 @@
+#ifndef _OBJ_LOADER_H
+#define _OBJ_LOADER_H
+
+#include <memory>
+#include <string>
+
+#include "Geometry.hpp"
+
+// Wavefront OBJ reader for large files. The file is mapped and cut into chunks at line boundaries;
+// a first pass counts the elements of every chunk in parallel, so that the second one can parse
+// each chunk straight into its slice of the Geometry streams.
+// Reads the positions (with the common "v x y z r g b" color extension), the normals and the faces,
+// fanning polygons into triangles. Texture coordinates are checked but dropped, as a Geometry has
+// none; materials, groups, lines and points are ignored. A file without normals gets smooth ones
+// (see MeshNormals.hpp).
+class ObjLoader {
+public:
+	// Returns nullptr, after printing why, if the file is missing or malformed
+	static std::shared_ptr<Geometry> load (const std::string & filename);
+};
+
+#endif //_OBJ_LOADER_H
@@ -0,0 +1,284 @@
+#ifndef _PARAMETRIC_SURFACE_H
+#define _PARAMETRIC_SURFACE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include "Geometry.hpp"
+#include "RingKernel.hpp"
+#include "ThreadPool.hpp"
+
+// Surfaces generated on a grid of columns x rows cells, at u = column / columns and v = row / rows,
+// both in [0, 1]. A surface is a functor type deriving from ParametricSurface, inlined into the
+// generator, with either
+//
+//     glm::vec3 position (float u, float v) const;
+//     glm::vec3 color (float u, float v) const;
+//     glm::vec3 normal (float u, float v) const; // Optional, unit
+//
+// or, for a surface of revolution around z, written by the vectorized ring kernel (RingKernel.hpp),
+//
+//     RingShape ring (float v) const; // u goes once around the ring, counterclockwise
+//
+// Triangles face the side the cross product of d/du and d/dv points to. Without a normal member,
+// the normal is that cross product, by central differences. The ring kernel closes every ring
+// exactly; a surface closed in v, or given by position, must itself return the same vertex at 1 as at
+// 0 for its seam to be watertight.
+struct ParametricSurface {
+	// The rows at v = 0 and v = 1 collapse to one vertex, joined to the next row by a fan
+	// (the first column of the row, or the center of the ring, gives its position and color)
+	static constexpr bool poleAtStart = false;
+	static constexpr bool poleAtEnd = false;
+
+	// Triangles in each cell between the rows row and row + 1, the pole fans aside: 2, none where both
+	// rows are the same vertices with the normals of either side of a crease, or 1 where row + 1 is a
+	// tip, all its vertices at one point, each with the normal of the side at its column
+	static constexpr size_t cellTriangles (size_t /*row*/) { return 2; }
+};
+
+// Shared grid topology: every row that is not a pole has columns + 1 vertices, the last one
+// repeating the first on a closed surface, and rows are stored one after the other.
+class ParametricGrid {
+public:
+	// Exact counts; rows must be at least the number of poles
+	template<typename Surface>
+	static constexpr GeometrySize size (size_t columns, size_t rows) {
+		size_t poles = size_t (Surface::poleAtStart) + size_t (Surface::poleAtEnd);
+		return { (rows + 1 - poles) * (columns + 1) + poles,
+		         3 * columns * (poles + cellTriangles<Surface> (size_t (Surface::poleAtStart), rows - size_t (Surface::poleAtEnd))) };
+	}
+
+	// Writes exactly size<Surface> (columns, rows) elements into out, in parallel for large grids
+	template<typename Surface>
+	static void fill (const Surface & surface, size_t columns, size_t rows, const GeometryView & out) {
+		const size_t ringSize = columns + 1;
+		const size_t firstRing = Surface::poleAtStart ? 1 : 0; // Row of the first full ring
+		const size_t ringCount = rows + 1 - firstRing - (Surface::poleAtEnd ? 1 : 0);
+		const size_t cellCount = columns * rows;
+		float * positions = out.positions + 3 * firstRing;
+		float * colors = out.colors + 3 * firstRing;
+		float * normals = out.normals + 3 * firstRing;
+
+		forRows (cellCount, 0, ringCount, [&] (size_t first, size_t last) {
+			if constexpr (hasRing<Surface> (0)) {
+				emitRings (ringSize, columns, first, last, [&] (size_t k) { return surface.ring (float (k + firstRing) / rows); }, positions, colors, normals);
+			} else {
+				for (size_t k = first; k < last; k++) {
+					float v = float (k + firstRing) / rows;
+					for (size_t i = 0; i < ringSize; i++) {
+						size_t offset = 3 * (k * ringSize + i);
+						float u = float (i) / columns;
+						writeVertex (surface.position (u, v), surface.color (u, v), normalAt (surface, u, v, 0.5f / rows),
+						             positions + offset, colors + offset, normals + offset);
+					}
+				}
+			}
+		});
+		size_t vertexCount = size<Surface> (columns, rows).vertexCount;
+		if (Surface::poleAtStart)
+			writePole (surface, 0.f, 0.5f / rows, out.positions, out.colors, out.normals);
+		if (Surface::poleAtEnd) {
+			size_t last = 3 * (vertexCount - 1);
+			writePole (surface, 1.f, -0.5f / rows, out.positions + last, out.colors + last, out.normals + last);
+		}
+
+		writeIndices<Surface> (columns, rows, out.indices);
+	}
+
+	// The indices fill writes: fans around the poles, then the cells between consecutive rings
+	template<typename Surface>
+	static constexpr void writeIndices (size_t columns, size_t rows, unsigned int * index) {
+		const size_t ringSize = columns + 1;
+		const size_t firstRing = Surface::poleAtStart ? 1 : 0;
+		const size_t ringCount = rows + 1 - firstRing - (Surface::poleAtEnd ? 1 : 0);
+		const size_t vertexCount = size<Surface> (columns, rows).vertexCount;
+		const size_t lastRing = firstRing + (ringCount - 1) * ringSize;
+		for (size_t i = 0; Surface::poleAtStart && i < columns; i++) {
+			*index++ = 0;
+			*index++ = firstRing + i + 1;
+			*index++ = firstRing + i;
+		}
+		forRows (columns * rows, 0, ringCount - 1, [=] (size_t first, size_t last) {
+			writeCells<Surface> (index + 3 * columns * cellTriangles<Surface> (firstRing, firstRing + first), firstRing + first * ringSize,
+			                     firstRing + first, last - first, columns);
+		});
+		index += 3 * columns * cellTriangles<Surface> (firstRing, firstRing + ringCount - 1);
+		for (size_t i = 0; Surface::poleAtEnd && i < columns; i++) {
+			*index++ = lastRing + i;
+			*index++ = lastRing + i + 1;
+			*index++ = vertexCount - 1;
+		}
+	}
+
+private:
+	// From 2048 x 2048 cells on, the rings and the cells are split across the thread pool. Each block
+	// writes a disjoint slice of the preallocated outputs, so the result is the same as the serial run.
+	static constexpr size_t parallelCells = size_t (2048) * 2048;
+
+	template<typename Task>
+	static constexpr void forRows (size_t cellCount, size_t begin, size_t end, const Task & task) {
+		if (cellCount >= parallelCells)
+			ThreadPool::instance ().parallelFor (begin, end, task);
+		else
+			task (begin, end);
+	}
+
+	// True when Surface has a ring (v) member, picked at compile time
+	template<typename Surface>
+	static constexpr auto hasRing (int) -> decltype (std::declval<const Surface &> ().ring (0.f), bool ()) { return true; }
+	template<typename Surface>
+	static constexpr bool hasRing (...) { return false; }
+
+	// True when Surface has a normal (u, v) member
+	template<typename Surface>
+	static constexpr auto hasNormal (int) -> decltype (std::declval<const Surface &> ().normal (0.f, 0.f), bool ()) { return true; }
+	template<typename Surface>
+	static constexpr bool hasNormal (...) { return false; }
+
+	// The normal member of the surface, or the cross product of its derivatives by central differences
+	// (one-sided at the borders of the grid). Where it vanishes, at a pole for instance, the normal
+	// inward steps further along v.
+	template<typename Surface>
+	static glm::vec3 normalAt (const Surface & surface, float u, float v, float inward) {
+		if constexpr (hasNormal<Surface> (0)) {
+			return surface.normal (u, v);
+		} else {
+			const float h = 1e-3f;
+			for (int attempt = 0; attempt < 2; attempt++, v += inward) {
+				float u0 = std::max (u - h, 0.f), u1 = std::min (u + h, 1.f), v0 = std::max (v - h, 0.f), v1 = std::min (v + h, 1.f);
+				glm::vec3 n = glm::cross (surface.position (u1, v) - surface.position (u0, v), surface.position (u, v1) - surface.position (u, v0));
+				float length = glm::length (n);
+				if (length > 0.f)
+					return n / length;
+			}
+			return glm::vec3 (0.f, 0.f, 1.f);
+		}
+	}
+
+	// Triangles per column of the cells between the rows [first, last)
+	template<typename Surface>
+	static constexpr size_t cellTriangles (size_t first, size_t last) {
+		size_t count = 0;
+		for (size_t row = first; row < last; row++)
+			count += Surface::cellTriangles (row);
+		return count;
+	}
+
+	// The cells of rowCount rows of columns cells, starting at grid row row, whose first vertex is first
+	template<typename Surface>
+	static constexpr void writeCells (unsigned int * index, size_t first, size_t row, size_t rowCount, size_t columns) {
+		const size_t ringSize = columns + 1;
+		for (size_t k = 0; k < rowCount; k++, first += ringSize) {
+			size_t triangles = Surface::cellTriangles (row + k);
+			for (size_t a = first; triangles > 0 && a < first + columns; a++) {
+				*index++ = a;
+				*index++ = a + 1;
+				*index++ = a + ringSize;
+				if (triangles == 2) {
+					*index++ = a + 1;
+					*index++ = a + 1 + ringSize;
+					*index++ = a + ringSize;
+				}
+			}
+		}
+	}
+
+	static void writeVertex (const glm::vec3 & position, const glm::vec3 & color, const glm::vec3 & normal, float * positions, float * colors, float * normals) {
+		for (int c = 0; c < 3; c++) {
+			positions[c] = position[c];
+			colors[c] = color[c];
+			normals[c] = normal[c];
+		}
+	}
+
+	template<typename Surface>
+	static void writePole (const Surface & surface, float v, float inward, float * positions, float * colors, float * normals) {
+		if constexpr (hasRing<Surface> (0)) {
+			RingShape shape = surface.ring (v);
+			writeVertex (glm::vec3 (0.f, 0.f, shape.z), glm::vec3 (shape.color[0], shape.color[1], shape.color[2]),
+			             glm::vec3 (0.f, 0.f, shape.normal[1] < 0.f ? -1.f : 1.f), positions, colors, normals);
+		} else {
+			writeVertex (surface.position (0.f, v), surface.color (0.f, v), normalAt (surface, 0.f, v, inward), positions, colors, normals);
+		}
+	}
+};
+
+/*
+ * The shapes of the generators
+ */
+
+// Sphere of the given radius, from the south pole (v = 0) to the north pole, colored by latitude
+struct SphereSurface : ParametricSurface {
+	static constexpr bool poleAtStart = true;
+	static constexpr bool poleAtEnd = true;
+
+	float radius = 1.f;
+
+	RingShape ring (float v) const {
+		float latitude = glm::pi<float> () * (v - 0.5f);
+		float c = std::cos (latitude), s = std::sin (latitude);
+		return { radius * c, radius * s, { 1.f, 0.f, 0.5f + 0.5f * std::cos (6.f * glm::pi<float> () * v) }, { c, s } };
+	}
+};
+
+// Torus around z, of outer radius 1, v going once around the tube
+struct TorusSurface : ParametricSurface {
+	float minorRadius = 0.2f;
+
+	RingShape ring (float v) const {
+		float phi = glm::two_pi<float> () * (v < 1.f ? v : 0.f); // The last row is exactly the first
+		float c = std::cos (phi), s = std::sin (phi);
+		return { 1.f - minorRadius + minorRadius * c, minorRadius * s, { 0.f, 1.f, 0.f }, { c, s } };
+	}
+};
+
+// Unit cone with its apex at z = 1, in yellow: base center (v = 0), base ring (v = 1/3), the same ring
+// again for the side (v = 2/3) and the tip (v = 1). Meant for three rows. Each side of the base crease
+// keeps its own normal, (0, -1) on the base and (2, 1) / sqrt (5) on the side, the tip included.
+struct ConeSurface : ParametricSurface {
+	static constexpr bool poleAtStart = true;
+
+	static constexpr size_t cellTriangles (size_t row) { return row == 2 ? 1 : 0; }
+
+	constexpr RingShape ring (float v) const {
+		if (v < 1.f / 6.f)
+			return { 0.f, -1.f, { 1.f, 1.f, 0.f }, { 0.f, -1.f } };
+		if (v < 0.5f)
+			return { 1.f, -1.f, { 1.f, 1.f, 0.f }, { 0.f, -1.f } };
+		if (v < 5.f / 6.f)
+			return { 1.f, -1.f, { 1.f, 1.f, 0.f }, { 0.894427f, 0.447214f } };
+		return { 0.f, 1.f, { 1.f, 1.f, 0.f }, { 0.894427f, 0.447214f } };
+	}
+};
+
+// Unit cylinder between z = -1 and z = 1, closed by its caps: bottom center (v = 0, yellow), bottom
+// ring (cyan) for the cap then the side (v = 1/5 and 2/5), top ring (red) for the side then the cap
+// (v = 3/5 and 4/5) and top center (magenta). Meant for five rows. The caps face (0, -1) and (0, 1),
+// the side (1, 0), each on its own vertices.
+struct CylinderSurface : ParametricSurface {
+	static constexpr bool poleAtStart = true;
+	static constexpr bool poleAtEnd = true;
+
+	static constexpr size_t cellTriangles (size_t row) { return row == 2 ? 2 : 0; }
+
+	constexpr RingShape ring (float v) const {
+		if (v < 0.1f)
+			return { 0.f, -1.f, { 1.f, 1.f, 0.f }, { 0.f, -1.f } };
+		if (v < 0.3f)
+			return { 1.f, -1.f, { 0.f, 1.f, 1.f }, { 0.f, -1.f } };
+		if (v < 0.5f)
+			return { 1.f, -1.f, { 0.f, 1.f, 1.f }, { 1.f, 0.f } };
+		if (v < 0.7f)
+			return { 1.f, 1.f, { 1.f, 0.f, 0.f }, { 1.f, 0.f } };
+		if (v < 0.9f)
+			return { 1.f, 1.f, { 1.f, 0.f, 0.f }, { 0.f, 1.f } };
+		return { 0.f, 1.f, { 1.f, 0.f, 1.f }, { 0.f, 1.f } };
+	}
+};
+
+#endif //_PARAMETRIC_SURFACE_H
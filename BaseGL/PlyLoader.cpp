@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "PlyLoader.hpp"
+#include "MappedFile.hpp"
+#include "MeshNormals.hpp"
+#include "ThreadPool.hpp"
+
+static const size_t maxHeaderBytes = 1 << 16;
+
+enum PlyType { PlyInt8, PlyUint8, PlyInt16, PlyUint16, PlyInt32, PlyUint32, PlyFloat32, PlyFloat64, PlyInvalid };
+
+struct PlyProperty {
+    std::string name;
+    PlyType type;
+    PlyType countType = PlyInvalid; // Set for lists, whose elements are of type
+    size_t offset = 0; // In the record, for the properties before the first list
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+    size_t fixedSize = 0; // Bytes of a record, if it has no list
+    bool hasList = false;
+    const unsigned char * data = nullptr; // First record in the mapping
+};
+
+// Owner of what the packed data of a directly uploaded geometry points to
+struct PlyStorage {
+    std::shared_ptr<const void> mapping;
+    std::vector<unsigned int> indices;
+};
+
+static PlyType parseType (const std::string & name) {
+    static const char * const names[][2] = {
+        { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+        { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" }
+    };
+    for (int t = 0; t < PlyInvalid; t++)
+        if (name == names[t][0] || name == names[t][1])
+            return PlyType (t);
+    return PlyInvalid;
+}
+
+static size_t typeSize (PlyType type) {
+    static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+    return sizes[type];
+}
+
+// Largest value of an integer type, by which colors are normalized; 1 for floating point types
+static float typeRange (PlyType type) {
+    static const float ranges[] = { 127.f, 255.f, 32767.f, 65535.f, 2147483647.f, 4294967295.f, 1.f, 1.f };
+    return ranges[type];
+}
+
+template<typename T>
+static T readAs (const unsigned char * p) {
+    T value;
+    std::memcpy (&value, p, sizeof (T));
+    return value;
+}
+
+static double readScalar (const unsigned char * p, PlyType type) {
+    switch (type) {
+    case PlyInt8: return readAs<int8_t> (p);
+    case PlyUint8: return readAs<uint8_t> (p);
+    case PlyInt16: return readAs<int16_t> (p);
+    case PlyUint16: return readAs<uint16_t> (p);
+    case PlyInt32: return readAs<int32_t> (p);
+    case PlyUint32: return readAs<uint32_t> (p);
+    case PlyFloat32: return readAs<float> (p);
+    default: return readAs<double> (p);
+    }
+}
+
+// Reads the header at the start of the mapping, setting the first byte of the records
+static bool parseHeader (const char * text, size_t size, std::vector<PlyElement> & elements, size_t & dataOffset, std::string & error) {
+    static const char endHeader[] = "end_header";
+    const char * end = text + std::min (size, maxHeaderBytes);
+    const char * marker = std::search (text, end, endHeader, endHeader + sizeof (endHeader) - 1);
+    const char * newline = static_cast<const char *> (std::memchr (marker, '\n', end - marker));
+    if (size < 4 || std::memcmp (text, "ply", 3) != 0 || marker == end || !newline) {
+        error = "not a PLY file";
+        return false;
+    }
+    dataOffset = newline + 1 - text;
+
+    std::istringstream header (std::string (text, marker));
+    std::string line, keyword;
+    bool formatRead = false;
+    while (std::getline (header, line)) {
+        std::istringstream words (line);
+        if (!(words >> keyword) || keyword == "ply" || keyword == "comment" || keyword == "obj_info")
+            continue;
+        if (keyword == "format") {
+            std::string format;
+            words >> format;
+            if (format != "binary_little_endian") {
+                error = "only binary little-endian PLY is supported, not " + format;
+                return false;
+            }
+            formatRead = true;
+        } else if (keyword == "element") {
+            elements.emplace_back ();
+            if (!(words >> elements.back ().name >> elements.back ().count)) {
+                error = "malformed element";
+                return false;
+            }
+        } else if (keyword == "property") {
+            if (elements.empty ()) {
+                error = "property outside of an element";
+                return false;
+            }
+            PlyElement & element = elements.back ();
+            PlyProperty property;
+            std::string type, countType;
+            words >> type;
+            if (type == "list") {
+                words >> countType >> type;
+                property.countType = parseType (countType);
+            }
+            words >> property.name;
+            property.type = parseType (type);
+            if (property.type == PlyInvalid || (!countType.empty () && property.countType == PlyInvalid) || property.name.empty ()) {
+                error = "malformed property: " + line;
+                return false;
+            }
+            if (property.countType != PlyInvalid) {
+                element.hasList = true;
+            } else if (!element.hasList) {
+                property.offset = element.fixedSize;
+                element.fixedSize += typeSize (property.type);
+            }
+            element.properties.push_back (property);
+        }
+    }
+    if (!formatRead)
+        error = "missing format";
+    return formatRead;
+}
+
+// Walks count records with lists from data, calling list (values, type, count) on every list
+// of the property listIndex. Returns the end of the records, nullptr if they overrun end.
+template<typename List>
+static const unsigned char * walkRecords (const PlyElement & element, const unsigned char * data, const unsigned char * end, size_t listIndex, const List & list) {
+    const unsigned char * p = data;
+    for (size_t r = 0; r < element.count; r++) {
+        for (size_t i = 0; i < element.properties.size (); i++) {
+            const PlyProperty & property = element.properties[i];
+            size_t bytes = typeSize (property.type);
+            if (property.countType != PlyInvalid) {
+                if (static_cast<size_t> (end - p) < typeSize (property.countType))
+                    return nullptr;
+                double count = readScalar (p, property.countType);
+                p += typeSize (property.countType);
+                // Compared by division, so that neither the cast nor the product can overflow
+                if (!(count >= 0. && count <= static_cast<double> (static_cast<size_t> (end - p) / bytes)))
+                    return nullptr;
+                if (i == listIndex)
+                    list (p, property.type, static_cast<size_t> (count));
+                bytes *= static_cast<size_t> (count);
+            }
+            if (static_cast<size_t> (end - p) < bytes)
+                return nullptr;
+            p += bytes;
+        }
+    }
+    return p;
+}
+
+// Property of element named one of names, or nullptr
+static const PlyProperty * findProperty (const PlyElement & element, std::initializer_list<const char *> names) {
+    for (const PlyProperty & property : element.properties)
+        for (const char * name : names)
+            if (property.countType == PlyInvalid && property.name == name)
+                return &property;
+    return nullptr;
+}
+
+// Copies the float x y z at offset of count records of stride bytes into out. With SSE2, four
+// records are loaded at once and swizzled into three stores. limit bounds the 16-byte loads.
+static void gatherFloat3 (const unsigned char * records, size_t stride, size_t offset, size_t count, const unsigned char * limit, float * out) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= count && records + (i + 3) * stride + offset + 16 <= limit; i += 4) {
+        const unsigned char * r = records + i * stride + offset;
+        __m128 r0 = _mm_loadu_ps (reinterpret_cast<const float *> (r)); // x0 y0 z0 -
+        __m128 r1 = _mm_loadu_ps (reinterpret_cast<const float *> (r + stride));
+        __m128 r2 = _mm_loadu_ps (reinterpret_cast<const float *> (r + 2 * stride));
+        __m128 r3 = _mm_loadu_ps (reinterpret_cast<const float *> (r + 3 * stride));
+        __m128 t0 = _mm_shuffle_ps (r1, r0, _MM_SHUFFLE (2, 2, 0, 0)); // x1 x1 z0 z0
+        __m128 t2 = _mm_shuffle_ps (r2, r3, _MM_SHUFFLE (0, 0, 2, 2)); // z2 z2 x3 x3
+        _mm_storeu_ps (out + 3 * i, _mm_shuffle_ps (r0, t0, _MM_SHUFFLE (0, 2, 1, 0))); // x0 y0 z0 x1
+        _mm_storeu_ps (out + 3 * i + 4, _mm_shuffle_ps (r1, r2, _MM_SHUFFLE (1, 0, 2, 1))); // y1 z1 x2 y2
+        _mm_storeu_ps (out + 3 * i + 8, _mm_shuffle_ps (t2, r3, _MM_SHUFFLE (2, 1, 2, 0))); // z2 x3 y3 z3
+    }
+#endif
+    for (; i < count; i++)
+        std::memcpy (out + 3 * i, records + i * stride + offset, 3 * sizeof (float));
+}
+
+// Converts the properties x, y and z of count records into out, scaled by 1 / scale.
+// Consecutive float properties take the gathering path.
+static void convertTriple (const PlyElement & element, const PlyProperty * const * xyz, float scale, size_t first, size_t count,
+                           const unsigned char * limit, float * out) {
+    const unsigned char * records = element.data + first * element.fixedSize;
+    out += 3 * first;
+    if (xyz[0]->type == PlyFloat32 && xyz[1]->type == PlyFloat32 && xyz[2]->type == PlyFloat32
+        && xyz[1]->offset == xyz[0]->offset + 4 && xyz[2]->offset == xyz[0]->offset + 8 && scale == 1.f) {
+        gatherFloat3 (records, element.fixedSize, xyz[0]->offset, count, limit, out);
+        return;
+    }
+    float inverse = 1.f / scale;
+    for (size_t i = 0; i < count; i++)
+        for (int k = 0; k < 3; k++)
+            out[3*i+k] = static_cast<float> (readScalar (records + i * element.fixedSize + xyz[k]->offset, xyz[k]->type)) * inverse;
+}
+
+// Whether the vertex records are already interleaved float x y z, uchar red green blue alpha and
+// possibly float nx ny nz, with nothing else: the record of an interleaved VertexLayout
+static bool matchesLayout (const PlyElement & vertices, VertexLayout & layout) {
+    static const char * const names[] = { "x", "y", "z", "red", "green", "blue", "alpha", "nx", "ny", "nz" };
+    const std::vector<PlyProperty> & properties = vertices.properties;
+    if (vertices.hasList || (properties.size () != 7 && properties.size () != 10))
+        return false;
+    for (size_t i = 0; i < properties.size (); i++) {
+        PlyType expected = i >= 3 && i < 7 ? PlyUint8 : PlyFloat32;
+        if (properties[i].name != names[i] || properties[i].type != expected)
+            return false;
+    }
+    layout.position = VertexLayout::PositionFloat3;
+    layout.color = VertexLayout::ColorUnorm8;
+    layout.normal = properties.size () == 10 ? VertexLayout::NormalFloat3 : VertexLayout::NormalNone;
+    layout.interleaved = true;
+    return true;
+}
+
+// Bounding sphere of the float positions at the start of the records
+static void computeRecordBounds (Geometry & geometry, const unsigned char * records, size_t stride, size_t count) {
+    auto position = [&] (size_t v) { return readAs<glm::vec3> (records + v * stride); };
+    glm::vec3 lo = position (0), hi = lo;
+    for (size_t v = 1; v < count; v++) {
+        lo = glm::min (lo, position (v));
+        hi = glm::max (hi, position (v));
+    }
+    geometry.boundsCenter = 0.5f * (lo + hi);
+    float radius2 = 0.f;
+    for (size_t v = 0; v < count; v++) {
+        glm::vec3 d = position (v) - geometry.boundsCenter;
+        radius2 = std::max (radius2, glm::dot (d, d));
+    }
+    geometry.boundsRadius = std::sqrt (radius2);
+}
+
+// Converts the faces into triangle indices. Triangles only, the usual case, have records of a fixed
+// size and are converted in parallel; otherwise the records are walked in order and polygons fanned.
+static bool convertFaces (const PlyElement & faces, const unsigned char * end, size_t vertexCount, std::vector<unsigned int> & indices) {
+    size_t listIndex = faces.properties.size ();
+    for (size_t i = 0; i < faces.properties.size (); i++)
+        if (faces.properties[i].countType != PlyInvalid && (faces.properties[i].name == "vertex_indices" || faces.properties[i].name == "vertex_index"))
+            listIndex = i;
+    if (listIndex == faces.properties.size ())
+        return false;
+
+    // Fixed-size properties around the list when every face is a triangle
+    const PlyProperty & list = faces.properties[listIndex];
+    size_t stride = 0, listOffset = 0;
+    bool fixedTriangles = true;
+    for (size_t i = 0; i < faces.properties.size (); i++) {
+        const PlyProperty & property = faces.properties[i];
+        if (i == listIndex)
+            listOffset = stride;
+        if (i != listIndex && property.countType != PlyInvalid)
+            fixedTriangles = false;
+        stride += i == listIndex ? typeSize (property.countType) + 3 * typeSize (property.type) : typeSize (property.type);
+    }
+    fixedTriangles = fixedTriangles && faces.count <= static_cast<size_t> (end - faces.data) / stride;
+
+    std::atomic<bool> valid (true);
+    if (fixedTriangles) {
+        indices.resize (3 * faces.count);
+        size_t indexOffset = listOffset + typeSize (list.countType), indexSize = typeSize (list.type);
+        ThreadPool::instance ().parallelFor (0, faces.count, [&] (size_t first, size_t last) {
+            bool blockValid = true;
+            for (size_t f = first; f < last && blockValid; f++) {
+                const unsigned char * record = faces.data + f * stride;
+                blockValid = readScalar (record + listOffset, list.countType) == 3.;
+                for (int k = 0; k < 3 && blockValid; k++) {
+                    double v = readScalar (record + indexOffset + k * indexSize, list.type);
+                    blockValid = v >= 0. && v < vertexCount;
+                    indices[3*f+k] = static_cast<unsigned int> (v);
+                }
+            }
+            if (!blockValid)
+                valid = false;
+        });
+        if (valid)
+            return true;
+        indices.clear (); // Not only triangles, or a bad index that the walk below reports
+    }
+
+    bool indicesValid = true;
+    const unsigned char * recordsEnd = walkRecords (faces, faces.data, end, listIndex, [&] (const unsigned char * values, PlyType type, size_t count) {
+        size_t size = typeSize (type);
+        for (size_t k = 0; k < count; k++) {
+            double v = readScalar (values + k * size, type);
+            indicesValid = indicesValid && v >= 0. && v < vertexCount;
+        }
+        for (size_t k = 2; k < count && indicesValid; k++) {
+            indices.push_back (static_cast<unsigned int> (readScalar (values, type)));
+            indices.push_back (static_cast<unsigned int> (readScalar (values + (k - 1) * size, type)));
+            indices.push_back (static_cast<unsigned int> (readScalar (values + k * size, type)));
+        }
+    });
+    return recordsEnd && indicesValid;
+}
+
+std::shared_ptr<Geometry> PlyLoader::load (const std::string & filename, bool directUpload) {
+    size_t size = 0;
+    std::shared_ptr<const void> mapping = MappedFile::map (filename, size);
+    if (!mapping) {
+        std::cerr << "ERROR: Cannot map PLY file " << filename << std::endl;
+        return nullptr;
+    }
+    const unsigned char * base = static_cast<const unsigned char *> (mapping.get ());
+    const unsigned char * end = base + size;
+    std::vector<PlyElement> elements;
+    size_t dataOffset = 0;
+    std::string error;
+    if (!parseHeader (static_cast<const char *> (mapping.get ()), size, elements, dataOffset, error)) {
+        std::cerr << "ERROR: " << filename << ": " << error << std::endl;
+        return nullptr;
+    }
+
+    // Records of every element up to the faces, which are located last: their size depends on their content
+    PlyElement * vertices = nullptr, * faces = nullptr;
+    const unsigned char * p = base + dataOffset;
+    for (PlyElement & element : elements) {
+        element.data = p;
+        if (element.name == "vertex")
+            vertices = &element;
+        if (element.name == "face") {
+            faces = &element;
+            break;
+        }
+        if (element.hasList)
+            p = walkRecords (element, p, end, element.properties.size (), [] (const unsigned char *, PlyType, size_t) {});
+        else if (element.fixedSize == 0 || element.count <= static_cast<size_t> (end - p) / element.fixedSize)
+            p += element.count * element.fixedSize;
+        else
+            p = nullptr;
+        if (!p) {
+            std::cerr << "ERROR: Truncated PLY file " << filename << std::endl;
+            return nullptr;
+        }
+    }
+    const PlyProperty * position[3] = {};
+    if (vertices) {
+        position[0] = findProperty (*vertices, { "x" });
+        position[1] = findProperty (*vertices, { "y" });
+        position[2] = findProperty (*vertices, { "z" });
+    }
+    if (!vertices || vertices->count == 0 || vertices->hasList || !position[0] || !position[1] || !position[2] || !faces) {
+        std::cerr << "ERROR: " << filename << " has no triangle mesh: expected vertex x y z and face vertex_indices" << std::endl;
+        return nullptr;
+    }
+    if (vertices->count >= std::numeric_limits<unsigned int>::max ()) {
+        std::cerr << "ERROR: PLY file " << filename << " is too large for 32-bit indices" << std::endl;
+        return nullptr;
+    }
+
+    std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> ();
+    std::shared_ptr<PlyStorage> storage = std::make_shared<PlyStorage> ();
+    VertexLayout layout;
+    bool direct = directUpload && matchesLayout (*vertices, layout);
+    std::vector<unsigned int> & indices = direct ? storage->indices : geometry->triangleIndices;
+    if (!convertFaces (*faces, end, vertices->count, indices) || indices.empty ()) {
+        std::cerr << "ERROR: " << filename << ": truncated faces, bad vertex indices or no triangles" << std::endl;
+        return nullptr;
+    }
+
+    if (direct) {
+        storage->mapping = mapping;
+        geometry->layout = layout;
+        PackedGeometry & packed = geometry->packed;
+        packed.vertices = vertices->data;
+        packed.vertexCount = vertices->count;
+        packed.indices = storage->indices.data ();
+        packed.indexCount = storage->indices.size ();
+        packed.storage = storage;
+        computeRecordBounds (*geometry, vertices->data, vertices->fixedSize, vertices->count);
+        return geometry;
+    }
+
+    const PlyProperty * normal[3] = { findProperty (*vertices, { "nx" }), findProperty (*vertices, { "ny" }), findProperty (*vertices, { "nz" }) };
+    const PlyProperty * color[3] = { findProperty (*vertices, { "red", "r", "diffuse_red" }),
+                                     findProperty (*vertices, { "green", "g", "diffuse_green" }),
+                                     findProperty (*vertices, { "blue", "b", "diffuse_blue" }) };
+    bool normals = normal[0] && normal[1] && normal[2];
+    bool colors = color[0] && color[1] && color[2] && color[0]->type == color[1]->type && color[0]->type == color[2]->type;
+    size_t vertexCount = vertices->count;
+    geometry->vertexPositions.resize (3 * vertexCount); // Not allocate (), the indices are already there
+    geometry->vertexColors.resize (3 * vertexCount);
+    if (normals)
+        geometry->vertexNormals.resize (3 * vertexCount);
+    ThreadPool::instance ().parallelFor (0, vertexCount, [&] (size_t first, size_t last) {
+        convertTriple (*vertices, position, 1.f, first, last - first, end, geometry->vertexPositions.data ());
+        if (normals)
+            convertTriple (*vertices, normal, 1.f, first, last - first, end, geometry->vertexNormals.data ());
+        if (colors)
+            convertTriple (*vertices, color, typeRange (color[0]->type), first, last - first, end, geometry->vertexColors.data ());
+        else
+            std::fill (geometry->vertexColors.begin () + 3 * first, geometry->vertexColors.begin () + 3 * last, 1.f);
+    });
+    if (!normals)
+        MeshNormals::compute (*geometry);
+    geometry->computeBounds ();
+    return geometry;
+}
@@ -0,0 +1,23 @@
+#ifndef _PLY_LOADER_H
+#define _PLY_LOADER_H
+
+#include <memory>
+#include <string>
+
+#include "Geometry.hpp"
+
+// Binary little-endian PLY reader. The file is mapped and the vertex and face records are converted
+// in parallel straight from the mapping into the Geometry streams. Reads the positions, the normals
+// (nx, ny, nz) and the colors (red, green, blue) of the vertices, fanning polygons into triangles;
+// any other element or property is skipped. Vertices without normals get smooth ones (see
+// MeshNormals.hpp).
+// With directUpload, vertices stored exactly as an interleaved VertexLayout (float x y z, uchar red
+// green blue alpha, then optionally float nx ny nz) are not converted at all: they are uploaded from
+// the mapping through Geometry::packed, which the CPU passes then decode first.
+class PlyLoader {
+public:
+	// Returns nullptr, after printing why, if the file is missing, malformed or not binary little-endian
+	static std::shared_ptr<Geometry> load (const std::string & filename, bool directUpload = true);
+};
+
+#endif //_PLY_LOADER_H
@@ -0,0 +1,104 @@
+#include <glm/gtc/constants.hpp>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "RingKernel.hpp"
+
+const size_t RingTable::capacity; // Bound by reference in std::min
+
+void RingTable::compute (size_t first, size_t count, size_t divisions) {
+    for (size_t k = 0; k < count; k++) {
+        float theta = glm::two_pi<float> () * ((first + k) % divisions) / divisions; // Angle i = divisions is angle 0, bit for bit
+        cosTheta[k] = cosf (theta);
+        sinTheta[k] = sinf (theta);
+    }
+    this->count = count;
+}
+
+size_t RingTable::size () const {
+    return count;
+}
+
+#if defined(__SSE2__)
+// Interleaves four x, y and z lanes into twelve consecutive floats x0 y0 z0 x1 ... z3
+static inline void storeInterleaved (float * out, __m128 x, __m128 y, __m128 z) {
+    __m128 a0 = _mm_shuffle_ps (x, y, _MM_SHUFFLE (0, 0, 0, 0)); // x0 x0 y0 y0
+    __m128 b0 = _mm_shuffle_ps (z, x, _MM_SHUFFLE (1, 1, 0, 0)); // z0 z0 x1 x1
+    __m128 a1 = _mm_shuffle_ps (y, z, _MM_SHUFFLE (1, 1, 1, 1)); // y1 y1 z1 z1
+    __m128 b1 = _mm_shuffle_ps (x, y, _MM_SHUFFLE (2, 2, 2, 2)); // x2 x2 y2 y2
+    __m128 a2 = _mm_shuffle_ps (z, x, _MM_SHUFFLE (3, 3, 2, 2)); // z2 z2 x3 x3
+    __m128 b2 = _mm_shuffle_ps (y, z, _MM_SHUFFLE (3, 3, 3, 3)); // y3 y3 z3 z3
+    _mm_storeu_ps (out, _mm_shuffle_ps (a0, b0, _MM_SHUFFLE (2, 0, 2, 0)));
+    _mm_storeu_ps (out + 4, _mm_shuffle_ps (a1, b1, _MM_SHUFFLE (2, 0, 2, 0)));
+    _mm_storeu_ps (out + 8, _mm_shuffle_ps (a2, b2, _MM_SHUFFLE (2, 0, 2, 0)));
+}
+#endif
+
+void emitRing (const RingTable & table, const RingShape & shape, float * positions, float * colors, float * normals) {
+    size_t count = table.size ();
+    const float * cosTheta = table.cosTheta;
+    const float * sinTheta = table.sinTheta;
+    const float radius = shape.radius;
+    const float z = shape.z;
+    const float * color = shape.color;
+    const float normalRadius = shape.normal[0]; // The normals are a ring of their own
+    const float normalZ = shape.normal[1];
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // Four consecutive vertices cover three full periods of the rgb pattern
+    __m128 c0 = _mm_setr_ps (color[0], color[1], color[2], color[0]);
+    __m128 c1 = _mm_setr_ps (color[1], color[2], color[0], color[1]);
+    __m128 c2 = _mm_setr_ps (color[2], color[0], color[1], color[2]);
+    __m128 vz = _mm_set1_ps (z);
+    __m128 vnz = _mm_set1_ps (normalZ);
+
+#if defined(__AVX2__)
+    __m256 vr8 = _mm256_set1_ps (radius);
+    __m256 vnr8 = _mm256_set1_ps (normalRadius);
+    for (; i + 8 <= count; i += 8) {
+        __m256 cosines = _mm256_loadu_ps (cosTheta + i), sines = _mm256_loadu_ps (sinTheta + i);
+        __m256 x = _mm256_mul_ps (vr8, cosines);
+        __m256 y = _mm256_mul_ps (vr8, sines);
+        storeInterleaved (positions + 3*i, _mm256_castps256_ps128 (x), _mm256_castps256_ps128 (y), vz);
+        storeInterleaved (positions + 3*i + 12, _mm256_extractf128_ps (x, 1), _mm256_extractf128_ps (y, 1), vz);
+        __m256 nx = _mm256_mul_ps (vnr8, cosines);
+        __m256 ny = _mm256_mul_ps (vnr8, sines);
+        storeInterleaved (normals + 3*i, _mm256_castps256_ps128 (nx), _mm256_castps256_ps128 (ny), vnz);
+        storeInterleaved (normals + 3*i + 12, _mm256_extractf128_ps (nx, 1), _mm256_extractf128_ps (ny, 1), vnz);
+        for (size_t k = 0; k < 2; k++) {
+            float * c = colors + 3*i + 12*k;
+            _mm_storeu_ps (c, c0);
+            _mm_storeu_ps (c + 4, c1);
+            _mm_storeu_ps (c + 8, c2);
+        }
+    }
+#endif
+
+    __m128 vr = _mm_set1_ps (radius);
+    __m128 vnr = _mm_set1_ps (normalRadius);
+    for (; i + 4 <= count; i += 4) {
+        __m128 cosines = _mm_loadu_ps (cosTheta + i), sines = _mm_loadu_ps (sinTheta + i);
+        storeInterleaved (positions + 3*i, _mm_mul_ps (vr, cosines), _mm_mul_ps (vr, sines), vz);
+        storeInterleaved (normals + 3*i, _mm_mul_ps (vnr, cosines), _mm_mul_ps (vnr, sines), vnz);
+        _mm_storeu_ps (colors + 3*i, c0);
+        _mm_storeu_ps (colors + 3*i + 4, c1);
+        _mm_storeu_ps (colors + 3*i + 8, c2);
+    }
+#endif
+
+    for (; i < count; i++) {
+        positions[3*i] = radius * cosTheta[i];
+        positions[3*i+1] = radius * sinTheta[i];
+        positions[3*i+2] = z;
+        colors[3*i] = color[0];
+        colors[3*i+1] = color[1];
+        colors[3*i+2] = color[2];
+        normals[3*i] = normalRadius * cosTheta[i];
+        normals[3*i+1] = normalRadius * sinTheta[i];
+        normals[3*i+2] = normalZ;
+    }
+}
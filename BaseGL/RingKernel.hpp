@@ -0,0 +1,59 @@
+#ifndef _RING_KERNEL_H
+#define _RING_KERNEL_H
+
+#include <algorithm>
+#include <cstddef>
+
+// Surfaces of revolution (sphere, torus, cylinder, cone) are built ring by ring:
+// every vertex of a ring is (radius * cos theta, radius * sin theta, z), with the
+// same list of angles theta for every ring. The cosines and sines are evaluated
+// once per surface, and each ring is then written in one vectorized pass.
+
+// Cosines and sines of a run of consecutive angles i * 2 * pi / divisions, i taken modulo divisions
+// so that the last vertex of a closed ring is exactly the first. The table has a fixed capacity and
+// lives on the stack, so generation does not touch the heap.
+class RingTable {
+public:
+	static const size_t capacity = 256;
+
+	void compute (size_t first, size_t count, size_t divisions); // count <= capacity
+
+	size_t size () const;
+
+	float cosTheta[capacity];
+	float sinTheta[capacity];
+
+private:
+	size_t count = 0;
+};
+
+// Shape of one ring: its radius, height and the color of all its vertices, and their unit normal
+// as its radial and z components, (normal[0] cos theta, normal[0] sin theta, normal[1])
+struct RingShape {
+	float radius;
+	float z;
+	float color[3];
+	float normal[2];
+};
+
+// Writes the table.size () vertices of one ring, interleaved xyz, their constant color and their normals.
+// Uses AVX2 or SSE when the compiler targets them, with a scalar loop for the remainder.
+void emitRing (const RingTable & table, const RingShape & shape, float * positions, float * colors, float * normals);
+
+// Writes the rings [firstRing, lastRing) of a surface made of rings of ringSize vertices,
+// where ring j starts at vertex j * ringSize and is described by ringAt (j). The angles are
+// processed in runs of RingTable::capacity, each run being shared by all the rings.
+template<typename RingFunction>
+void emitRings (size_t ringSize, size_t divisions, size_t firstRing, size_t lastRing, RingFunction ringAt,
+                float * positions, float * colors, float * normals) {
+	RingTable table;
+	for (size_t first = 0; first < ringSize; first += RingTable::capacity) {
+		table.compute (first, std::min (RingTable::capacity, ringSize - first), divisions);
+		for (size_t j = firstRing; j < lastRing; j++) {
+			size_t offset = 3 * (j * ringSize + first);
+			emitRing (table, ringAt (j), positions + offset, colors + offset, normals + offset);
+		}
+	}
+}
+
+#endif //_RING_KERNEL_H
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "StaticPrimitives.hpp"
+#include "ParametricSurface.hpp"
+
+/*
+ * Compile-time trigonometry, std::cos and std::sin not being constexpr
+ */
+
+// Taylor series on [0, pi/2], in double so that the results hold full float precision
+static constexpr double quarterCos (double x) {
+    double term = 1.0, sum = 1.0;
+    for (int k = 1; k < 12; k++) {
+        term *= -x * x / ((2*k - 1) * (2*k));
+        sum += term;
+    }
+    return sum;
+}
+
+static constexpr double quarterSin (double x) {
+    double term = x, sum = x;
+    for (int k = 1; k < 12; k++) {
+        term *= -x * x / ((2*k) * (2*k + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+struct Turn {
+    float cosTheta;
+    float sinTheta;
+};
+
+// Angle of i / n turn, reduced to a quarter turn: the quarter turns are exact, and the last vertex
+// of a closed ring (i = n) is exactly the first
+static constexpr Turn turn (size_t i, size_t n) {
+    size_t quarter = 4 * (i % n) / n;
+    double angle = 1.5707963267948966 * double (4 * (i % n) - quarter * n) / double (n);
+    float c = float (quarterCos (angle)), s = float (quarterSin (angle));
+    switch (quarter) {
+    case 0: return { c, s };
+    case 1: return { -s, c };
+    case 2: return { -c, -s };
+    default: return { s, -c };
+    }
+}
+
+/*
+ * Tables
+ */
+
+// Vertices in blocks, positions, colors then normals, as VertexLayout::standard () stores them
+template<size_t VertexCount, size_t IndexCount>
+struct StaticTable {
+    static constexpr size_t vertexCount = VertexCount;
+    static constexpr size_t indexCount = IndexCount;
+
+    float vertices[9 * VertexCount] = {};
+    unsigned int indices[IndexCount] = {};
+    float boundsCenter[3] = {};
+    float boundsRadius2 = 0.f;
+
+    constexpr void computeBounds () {
+        float lo[3] = { vertices[0], vertices[1], vertices[2] }, hi[3] = { vertices[0], vertices[1], vertices[2] };
+        for (size_t v = 1; v < VertexCount; v++) {
+            for (int c = 0; c < 3; c++) {
+                lo[c] = std::min (lo[c], vertices[3*v + c]);
+                hi[c] = std::max (hi[c], vertices[3*v + c]);
+            }
+        }
+        for (int c = 0; c < 3; c++)
+            boundsCenter[c] = 0.5f * (lo[c] + hi[c]);
+        for (size_t v = 0; v < VertexCount; v++) {
+            float d2 = 0.f;
+            for (int c = 0; c < 3; c++)
+                d2 += (vertices[3*v + c] - boundsCenter[c]) * (vertices[3*v + c] - boundsCenter[c]);
+            boundsRadius2 = std::max (boundsRadius2, d2);
+        }
+    }
+};
+
+// A surface of revolution of ParametricSurface.hpp, the same vertices and triangles as ParametricGrid::fill writes
+template<typename Surface, size_t Columns, size_t Rows>
+struct StaticSurface : StaticTable<ParametricGrid::size<Surface> (Columns, Rows).vertexCount, ParametricGrid::size<Surface> (Columns, Rows).indexCount> {
+    constexpr StaticSurface () {
+        const Surface surface {};
+        const size_t ringSize = Columns + 1, firstRing = Surface::poleAtStart ? 1 : 0;
+        const size_t ringCount = Rows + 1 - firstRing - (Surface::poleAtEnd ? 1 : 0);
+        if (Surface::poleAtStart)
+            write (0, { 1.f, 0.f }, surface.ring (0.f));
+        for (size_t k = 0; k < ringCount; k++) {
+            RingShape shape = surface.ring (float (k + firstRing) / Rows);
+            for (size_t i = 0; i < ringSize; i++)
+                write (firstRing + k * ringSize + i, turn (i, Columns), shape);
+        }
+        if (Surface::poleAtEnd)
+            write (this->vertexCount - 1, { 1.f, 0.f }, surface.ring (1.f));
+        ParametricGrid::writeIndices<Surface> (Columns, Rows, this->indices);
+        this->computeBounds ();
+    }
+
+    // Where the normal has no radial part (poles, cap rings), it is exactly along z, as ParametricGrid::fill writes the poles
+    constexpr void write (size_t v, const Turn & angle, const RingShape & shape) {
+        float * position = this->vertices + 3*v, * color = position + 3 * this->vertexCount, * normal = color + 3 * this->vertexCount;
+        position[0] = shape.radius * angle.cosTheta;
+        position[1] = shape.radius * angle.sinTheta;
+        position[2] = shape.z;
+        for (int c = 0; c < 3; c++)
+            color[c] = shape.color[c];
+        bool pole = shape.normal[0] == 0.f;
+        normal[0] = pole ? 0.f : shape.normal[0] * angle.cosTheta;
+        normal[1] = pole ? 0.f : shape.normal[0] * angle.sinTheta;
+        normal[2] = pole ? (shape.normal[1] < 0.f ? -1.f : 1.f) : shape.normal[1];
+    }
+};
+
+struct StaticCube : StaticTable<8, 36> {
+    constexpr StaticCube () : StaticTable<8, 36> { {
+             1.f,  1.f,  1.f,
+            -1.f,  1.f,  1.f,
+            -1.f, -1.f,  1.f,
+             1.f, -1.f,  1.f,
+             1.f,  1.f, -1.f,
+            -1.f,  1.f, -1.f,
+            -1.f, -1.f, -1.f,
+             1.f, -1.f, -1.f,
+
+            1.f, 1.f, 1.f,
+            0.f, 1.f, 1.f,
+            0.f, 0.f, 1.f,
+            1.f, 0.f, 1.f,
+            1.f, 1.f, 0.f,
+            0.f, 1.f, 0.f,
+            1.f, 1.f, 1.f,
+            1.f, 0.f, 0.f,
+
+             0.577350f,  0.577350f,  0.577350f,
+            -0.577350f,  0.577350f,  0.577350f,
+            -0.577350f, -0.577350f,  0.577350f,
+             0.577350f, -0.577350f,  0.577350f,
+             0.577350f,  0.577350f, -0.577350f,
+            -0.577350f,  0.577350f, -0.577350f,
+            -0.577350f, -0.577350f, -0.577350f,
+             0.577350f, -0.577350f, -0.577350f
+        }, {
+            0, 1, 2,   0, 2, 3,
+            0, 5, 4,   0, 1, 5,
+            3, 4, 7,   3, 0, 4,
+            2, 7, 6,   2, 3, 7,
+            4, 5, 7,   5, 6, 7,
+            1, 6, 5,   1, 2, 6,
+        } } {
+        computeBounds ();
+    }
+};
+
+// Each table is a constant in the read-only data of the executable, built by the compiler
+template<typename Surface, size_t Columns, size_t Rows>
+static constexpr StaticSurface<Surface, Columns, Rows> surfaceTable {};
+static constexpr StaticCube cubeTable {};
+
+using StaticResolutions = std::index_sequence<4, 8, 16, 32>;
+
+template<typename Table>
+static void setPacked (const Table & table, Geometry & geometry) {
+    geometry.layout = VertexLayout::standard ();
+    geometry.packed = PackedGeometry (); // No storage to keep alive
+    geometry.packed.vertices = table.vertices;
+    geometry.packed.vertexCount = Table::vertexCount;
+    geometry.packed.indices = table.indices;
+    geometry.packed.indexCount = Table::indexCount;
+    geometry.boundsCenter = glm::vec3 (table.boundsCenter[0], table.boundsCenter[1], table.boundsCenter[2]);
+    geometry.boundsRadius = std::sqrt (table.boundsRadius2);
+}
+
+template<typename Surface, size_t Rows, size_t... Resolutions>
+static bool setSurface (size_t resolution, Geometry & geometry, std::index_sequence<Resolutions...>) {
+    return ((resolution == Resolutions && (setPacked (surfaceTable<Surface, Resolutions, Rows>, geometry), true)) || ...);
+}
+
+bool StaticPrimitives::cone (size_t resolution, Geometry & geometry) {
+    return setSurface<ConeSurface, 3> (resolution, geometry, StaticResolutions ());
+}
+
+bool StaticPrimitives::cylinder (size_t resolution, Geometry & geometry) {
+    return setSurface<CylinderSurface, 5> (resolution, geometry, StaticResolutions ());
+}
+
+void StaticPrimitives::cube (Geometry & geometry) {
+    setPacked (cubeTable, geometry);
+}
+
+void StaticPrimitives::fillCube (const GeometryView & cube) {
+    std::copy (cubeTable.vertices, cubeTable.vertices + 3 * StaticCube::vertexCount, cube.positions);
+    std::copy (cubeTable.vertices + 3 * StaticCube::vertexCount, cubeTable.vertices + 6 * StaticCube::vertexCount, cube.colors);
+    std::copy (cubeTable.vertices + 6 * StaticCube::vertexCount, cubeTable.vertices + 9 * StaticCube::vertexCount, cube.normals);
+    std::copy (cubeTable.indices, cubeTable.indices + StaticCube::indexCount, cube.indices);
+}
@@ -0,0 +1,24 @@
+#ifndef _STATIC_PRIMITIVES_H
+#define _STATIC_PRIMITIVES_H
+
+#include <cstddef>
+
+#include "Geometry.hpp"
+
+// The cube, and the cone and the cylinder at resolutions 4, 8, 16 and 32, computed at compile time
+// into read-only arrays already in the standard layout (positions, colors, normals). A geometry set up
+// on them uploads them as packed data, straight from the executable: nothing is allocated or
+// generated at startup. As with any packed data, the CPU passes unpack it first. The cube has a
+// normal along the diagonal at each corner, as smoothing over its faces gives.
+class StaticPrimitives {
+public:
+	// Point the packed data of geometry to the table, and set its layout and bounds. False, leaving
+	// the geometry unchanged, at the other resolutions.
+	static bool cone (size_t resolution, Geometry & geometry);
+	static bool cylinder (size_t resolution, Geometry & geometry);
+	static void cube (Geometry & geometry);
+
+	static void fillCube (const GeometryView & out); // The same cube, copied into float streams
+};
+
+#endif //_STATIC_PRIMITIVES_H
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "StlLoader.hpp"
+#include "MappedFile.hpp"
+#include "MeshNormals.hpp"
+#include "ThreadPool.hpp"
+
+static const size_t headerBytes = 84; // 80 free bytes, then the facet count
+static const size_t facetBytes = 50; // Normal, three corners, attribute word
+static const size_t maxProbes = 1024; // A probe this long means that the table is too small
+static const uint32_t emptySlot = 0xFFFFFFFFu;
+static const uint32_t firstUse = 0x80000000u; // Marks the corners numbering a new vertex
+
+static const unsigned char * cornerPosition (const unsigned char * facets, size_t corner) {
+    return facets + corner / 3 * facetBytes + 12 + corner % 3 * 12;
+}
+
+// Exact bits of a position, with -0 folded onto 0
+static void positionBits (const unsigned char * position, uint32_t bits[3]) {
+    std::memcpy (bits, position, 3 * sizeof (uint32_t));
+    for (int k = 0; k < 3; k++)
+        if (bits[k] == 0x80000000u)
+            bits[k] = 0;
+}
+
+// Table of the distinct positions of the corners: each slot holds the first corner at its position.
+// Corners are inserted concurrently, a slot being claimed and then lowered with compare-and-swap, so
+// the content does not depend on the order of the threads.
+class WeldTable {
+public:
+    WeldTable (size_t slotCount) : slots (new std::atomic<uint32_t>[slotCount]), mask (slotCount - 1) {
+        ThreadPool::instance ().parallelFor (0, slotCount, [&] (size_t first, size_t last) {
+            for (size_t s = first; s < last; s++)
+                slots[s].store (emptySlot, std::memory_order_relaxed);
+        });
+    }
+
+    // Returns the slot of the position of corner, or emptySlot if the table is too full
+    uint32_t insert (const unsigned char * facets, uint32_t corner) {
+        uint32_t key[3], other[3];
+        positionBits (cornerPosition (facets, corner), key);
+        uint32_t hash = (key[0] * 73856093u) ^ (key[1] * 19349663u) ^ (key[2] * 83492791u);
+        hash = (hash ^ (hash >> 16)) * 0x85EBCA6Bu; // Mix the high bits down: the low mantissa bits are often all zero
+        size_t slot = (hash ^ (hash >> 13)) & mask;
+        for (size_t probe = 0; probe < maxProbes; ) {
+            uint32_t current = slots[slot].load (std::memory_order_relaxed);
+            if (current == emptySlot) {
+                if (slots[slot].compare_exchange_weak (current, corner, std::memory_order_relaxed))
+                    return static_cast<uint32_t> (slot);
+                continue; // Claimed meanwhile, maybe by the same position: look again
+            }
+            positionBits (cornerPosition (facets, current), other);
+            if (std::equal (key, key + 3, other)) {
+                while (corner < current && !slots[slot].compare_exchange_weak (current, corner, std::memory_order_relaxed)) {}
+                return static_cast<uint32_t> (slot);
+            }
+            slot = (slot + 1) & mask;
+            probe++;
+        }
+        return emptySlot;
+    }
+
+    std::atomic<uint32_t> & operator[] (size_t slot) {
+        return slots[slot];
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint32_t>[]> slots;
+    size_t mask;
+};
+
+// Welds the corners of the facets into geometry. Returns false if the table overflowed.
+static bool weld (const unsigned char * facets, size_t cornerCount, size_t slotCount, Geometry & geometry) {
+    ThreadPool & pool = ThreadPool::instance ();
+    WeldTable table (slotCount);
+    std::vector<unsigned int> & indices = geometry.triangleIndices; // The slot of each corner, until the vertices are numbered
+    indices.resize (cornerCount);
+    std::atomic<bool> overflow (false);
+    pool.parallelFor (0, cornerCount, [&] (size_t first, size_t last) {
+        for (size_t c = first; c < last && !overflow.load (std::memory_order_relaxed); c++) {
+            indices[c] = table.insert (facets, static_cast<uint32_t> (c));
+            if (indices[c] == emptySlot)
+                overflow = true;
+        }
+    });
+    if (overflow)
+        return false;
+
+    // Vertices in order of first use: the first corners are counted per block, the prefix sums of
+    // the counts give the number of the first vertex of each block
+    size_t blockCount = 4 * pool.threadCount ();
+    std::vector<size_t> firstVertex (blockCount + 1, 0);
+    auto blockCorners = [&] (size_t b, size_t & begin, size_t & end) {
+        begin = cornerCount * b / blockCount;
+        end = cornerCount * (b + 1) / blockCount;
+    };
+    pool.parallelFor (0, blockCount, [&] (size_t firstBlock, size_t lastBlock) {
+        for (size_t b = firstBlock; b < lastBlock; b++) {
+            size_t begin, end;
+            blockCorners (b, begin, end);
+            for (size_t c = begin; c < end; c++) {
+                if (table[indices[c]].load (std::memory_order_relaxed) == c) {
+                    indices[c] |= firstUse;
+                    firstVertex[b + 1]++;
+                }
+            }
+        }
+    });
+    for (size_t b = 0; b < blockCount; b++)
+        firstVertex[b + 1] += firstVertex[b];
+
+    GeometrySize size = { firstVertex[blockCount], cornerCount };
+    geometry.vertexPositions.resize (3 * size.vertexCount);
+    geometry.vertexColors.assign (3 * size.vertexCount, 1.f);
+    pool.parallelFor (0, blockCount, [&] (size_t firstBlock, size_t lastBlock) {
+        for (size_t b = firstBlock; b < lastBlock; b++) {
+            size_t begin, end, vertex = firstVertex[b];
+            blockCorners (b, begin, end);
+            for (size_t c = begin; c < end; c++) {
+                if (indices[c] & firstUse) {
+                    table[indices[c] & ~firstUse].store (static_cast<uint32_t> (vertex), std::memory_order_relaxed);
+                    std::memcpy (&geometry.vertexPositions[3 * vertex], cornerPosition (facets, c), 3 * sizeof (float));
+                    vertex++;
+                }
+            }
+        }
+    });
+    pool.parallelFor (0, cornerCount, [&] (size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+            indices[c] = table[indices[c] & ~firstUse].load (std::memory_order_relaxed);
+    });
+    return true;
+}
+
+std::shared_ptr<Geometry> StlLoader::load (const std::string & filename) {
+    size_t size = 0;
+    std::shared_ptr<const void> mapping = MappedFile::map (filename, size);
+    if (!mapping) {
+        std::cerr << "ERROR: Cannot map STL file " << filename << std::endl;
+        return nullptr;
+    }
+    const unsigned char * base = static_cast<const unsigned char *> (mapping.get ());
+    uint32_t facetCount = 0;
+    if (size >= headerBytes)
+        std::memcpy (&facetCount, base + 80, sizeof (facetCount));
+    if (size < headerBytes || size < headerBytes + facetBytes * size_t (facetCount)) {
+        // An ASCII file starts with "solid", but so do some binary ones: only the size tells
+        if (size >= 5 && std::memcmp (base, "solid", 5) == 0)
+            std::cerr << "ERROR: " << filename << " is an ASCII STL file, only binary STL is supported" << std::endl;
+        else
+            std::cerr << "ERROR: Truncated STL file " << filename << std::endl;
+        return nullptr;
+    }
+    size_t cornerCount = 3 * size_t (facetCount);
+    if (cornerCount == 0 || cornerCount >= firstUse) {
+        std::cerr << "ERROR: STL file " << filename << (cornerCount == 0 ? " has no triangles" : " is too large for 32-bit indices") << std::endl;
+        return nullptr;
+    }
+
+    // A closed surface has about half as many vertices as triangles, a table of one and a half slot
+    // per triangle is then at most a third full. A looser soup is retried with larger tables.
+    std::shared_ptr<Geometry> geometry = std::make_shared<Geometry> ();
+    size_t slotCount = 1024;
+    while (slotCount < facetCount + facetCount / 2)
+        slotCount *= 2;
+    for (; !weld (base + headerBytes, cornerCount, slotCount, *geometry); slotCount *= 4) {
+        if (slotCount >= firstUse) {
+            std::cerr << "ERROR: STL file " << filename << " has too many vertices" << std::endl;
+            return nullptr;
+        }
+    }
+    MeshNormals::compute (*geometry);
+    geometry->computeBounds ();
+    return geometry;
+}
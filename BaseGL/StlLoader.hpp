@@ -0,0 +1,19 @@
+#ifndef _STL_LOADER_H
+#define _STL_LOADER_H
+
+#include <memory>
+#include <string>
+
+#include "Geometry.hpp"
+
+// Binary STL reader. The file is a soup of independent triangles; their corners are welded into
+// shared vertices while they are read, through a lock-free hash table of the exact positions, so the
+// soup is never copied. Vertices are numbered in order of first use. Facet normals and attribute
+// words are ignored: the vertices get smooth normals from the welded triangles (see MeshNormals.hpp).
+class StlLoader {
+public:
+	// Returns nullptr, after printing why, if the file is missing, ASCII or truncated
+	static std::shared_ptr<Geometry> load (const std::string & filename);
+};
+
+#endif //_STL_LOADER_H
@@ -0,0 +1,57 @@
+// Checks that the fill* generators never touch the heap: every operator new of the program is
+// counted, and each generator must leave the count unchanged while writing into storage sized
+// beforehand by its size function. Exits with 1, listing the offenders, otherwise.
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "Mesh.hpp"
+
+static size_t allocationCount = 0;
+
+void * operator new (size_t size) {
+    allocationCount++;
+    if (void * p = std::malloc (size ? size : 1))
+        return p;
+    throw std::bad_alloc ();
+}
+
+void operator delete (void * p) noexcept {
+    std::free (p);
+}
+
+void operator delete (void * p, size_t) noexcept {
+    std::free (p);
+}
+
+// Allocates the storage first, uncounted, then counts the allocations of fill alone
+template<typename Fill>
+static bool check (const char * name, size_t resolution, const GeometrySize & size, const Fill & fill) {
+    Geometry geometry;
+    geometry.allocate (size);
+    GeometryView view = geometry.view ();
+    size_t before = allocationCount;
+    fill (view);
+    size_t allocations = allocationCount - before;
+    if (allocations > 0)
+        std::printf ("FAILED: %s %zu: %zu allocations\n", name, resolution, allocations);
+    return allocations == 0;
+}
+
+int main () {
+    bool passed = true;
+    // Below the sizes split across the thread pool, whose job queue allocates
+    for (size_t r : { 3, 4, 16, 100, 256, 1024 }) {
+        passed &= check ("sphere", r, Mesh::sphereSize (r), [=] (const GeometryView & out) { Mesh::fillSphere (r, 1.f, out); });
+        passed &= check ("cone", r, Mesh::coneSize (r), [=] (const GeometryView & out) { Mesh::fillCone (r, out); });
+        passed &= check ("cylinder", r, Mesh::cylinderSize (r), [=] (const GeometryView & out) { Mesh::fillCylinder (r, out); });
+        passed &= check ("torus", r, Mesh::torusSize (r), [=] (const GeometryView & out) { Mesh::fillTorus (r, 0.2f, out); });
+    }
+    for (size_t s = 0; s <= 6; s++)
+        passed &= check ("icosphere", s, Mesh::icosphereSize (s), [=] (const GeometryView & out) { Mesh::fillIcosphere (s, 1.f, out); });
+    passed &= check ("cube", 0, Mesh::cubeSize (), [] (const GeometryView & out) { Mesh::fillCube (out); });
+
+    std::printf (passed ? "All generators ran without allocating\n" : "Some generators allocated\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+// Checks that marching cubes shares every vertex: spheres whose radius is a multiple of the grid
+// spacing put samples exactly on the iso value, where the edges around such a sample must not each
+// get a vertex of their own at the same place. Exits with 1, listing the offenders, otherwise.
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <vector>
+
+#include "Mesh.hpp"
+
+// Number of vertices whose position another one already has
+static size_t duplicateCount (const Geometry & geometry) {
+    std::vector<std::array<float, 3>> positions (geometry.vertexCount ());
+    for (size_t v = 0; v < positions.size (); v++)
+        positions[v] = { geometry.vertexPositions[3*v], geometry.vertexPositions[3*v+1], geometry.vertexPositions[3*v+2] };
+    std::sort (positions.begin (), positions.end ());
+    return positions.size () - (std::unique (positions.begin (), positions.end ()) - positions.begin ());
+}
+
+static bool check (float radius, size_t resolution) {
+    std::shared_ptr<Mesh> mesh = Mesh::fromVolume ([=] (const glm::vec3 & p) { return glm::length (p) - radius; },
+                                                   glm::vec3 (-1.f), glm::vec3 (1.f), resolution);
+    if (!mesh || mesh->getGeometry ()->vertexCount () == 0) {
+        std::printf ("FAILED: sphere %g on %zu^3: no surface\n", radius, resolution);
+        return false;
+    }
+    size_t duplicates = duplicateCount (*mesh->getGeometry ());
+    if (duplicates > 0)
+        std::printf ("FAILED: sphere %g on %zu^3: %zu duplicate vertices\n", radius, resolution, duplicates);
+    return duplicates == 0;
+}
+
+int main () {
+    bool passed = true;
+    for (float radius : { 0.5f, 0.7f, 0.71f, 0.75f })
+        for (size_t resolution : { 8, 20, 40 })
+            passed &= check (radius, resolution);
+
+    std::printf (passed ? "No duplicate isosurface vertices\n" : "Some isosurfaces duplicated vertices\n");
+    return passed ? 0 : 1;
+}
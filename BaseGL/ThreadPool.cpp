@@ -0,0 +1,78 @@
+#include <algorithm>
+
+#include "ThreadPool.hpp"
+
+ThreadPool & ThreadPool::instance () {
+    static ThreadPool pool (std::max (1u, std::thread::hardware_concurrency ()) - 1);
+    return pool;
+}
+
+ThreadPool::ThreadPool (size_t workerCount) {
+    for (size_t i = 0; i < workerCount; i++)
+        workers.emplace_back (&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool () {
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all ();
+    for (std::thread & worker : workers)
+        worker.join ();
+}
+
+size_t ThreadPool::threadCount () const {
+    return workers.size () + 1;
+}
+
+// Pops and runs one job with the lock released. Returns false if the queue was empty.
+bool ThreadPool::runPendingJob (std::unique_lock<std::mutex> & lock) {
+    if (jobs.empty ())
+        return false;
+    std::function<void ()> job = std::move (jobs.front ());
+    jobs.pop_front ();
+    lock.unlock ();
+    job ();
+    lock.lock ();
+    return true;
+}
+
+void ThreadPool::workerLoop () {
+    std::unique_lock<std::mutex> lock (mutex);
+    while (true) {
+        jobAvailable.wait (lock, [this] { return stopping || !jobs.empty (); });
+        if (stopping && jobs.empty ())
+            return;
+        runPendingJob (lock);
+    }
+}
+
+void ThreadPool::parallelFor (size_t begin, size_t end, const std::function<void (size_t, size_t)> & task) {
+    if (end <= begin)
+        return;
+    size_t count = end - begin;
+    size_t blockCount = std::min (count, 4 * threadCount ()); // A few blocks per thread to even out the load
+    if (blockCount <= 1) {
+        task (begin, end);
+        return;
+    }
+
+    size_t remaining = blockCount;
+    std::unique_lock<std::mutex> lock (mutex);
+    for (size_t b = 0; b < blockCount; b++) {
+        size_t blockBegin = begin + count * b / blockCount;
+        size_t blockEnd = begin + count * (b + 1) / blockCount;
+        jobs.emplace_back ([&task, &remaining, this, blockBegin, blockEnd] {
+            task (blockBegin, blockEnd);
+            std::lock_guard<std::mutex> doneLock (mutex);
+            if (--remaining == 0)
+                jobDone.notify_all ();
+        });
+    }
+    jobAvailable.notify_all ();
+
+    // Help with the queue instead of idling, then wait for the blocks still running elsewhere
+    while (remaining > 0 && runPendingJob (lock)) {}
+    jobDone.wait (lock, [&remaining] { return remaining == 0; });
+}
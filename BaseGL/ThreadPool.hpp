@@ -0,0 +1,44 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, started on first use and shared by every
+// data-parallel loop of the program (mesh generation, loaders, ...).
+class ThreadPool {
+public:
+	static ThreadPool & instance ();
+
+	size_t threadCount () const; // Workers plus the calling thread
+
+	// Splits [begin, end) into contiguous blocks and calls task (blockBegin, blockEnd) on each,
+	// returning once they are all done. The calling thread works on blocks too, so the call
+	// is safe from within a task. Blocks never overlap: a task writing only to its own
+	// range of an output array needs no synchronization.
+	void parallelFor (size_t begin, size_t end, const std::function<void (size_t, size_t)> & task);
+
+	ThreadPool (const ThreadPool &) = delete;
+	ThreadPool & operator= (const ThreadPool &) = delete;
+
+private:
+	ThreadPool (size_t workerCount);
+	~ThreadPool ();
+
+	void workerLoop ();
+	bool runPendingJob (std::unique_lock<std::mutex> & lock);
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void ()>> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobDone;
+	bool stopping = false;
+};
+
+#endif //_THREAD_POOL_H
@@ -0,0 +1,193 @@
+#include <glm/gtc/packing.hpp>
+#include <glm/packing.hpp>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#include "VertexLayout.hpp"
+
+// Attribute locations shared with VertexShader.glsl
+static const GLuint positionLocation = 0;
+static const GLuint colorLocation = 1;
+static const GLuint normalLocation = 2;
+
+// Binding points used when each attribute has its own block. Binding 2 is left to InstancedMesh.
+static const GLuint bindingOf[3] = { 0, 1, 3 };
+
+VertexLayout VertexLayout::standard () {
+    return VertexLayout ();
+}
+
+VertexLayout VertexLayout::compact () {
+    VertexLayout layout;
+    layout.position = PositionSnorm16;
+    layout.color = ColorUnorm8;
+    layout.normal = NormalOctahedral16;
+    layout.interleaved = true;
+    return layout;
+}
+
+size_t VertexLayout::attributeCount () const {
+    return normal == NormalNone ? 2 : 3;
+}
+
+GLint VertexLayout::normalEncoding () const {
+    return normal == NormalNone ? 0 : (normal == NormalFloat3 ? 1 : 2);
+}
+
+VertexLayout::Attribute VertexLayout::attribute (size_t index) const {
+    if (index == 0) {
+        switch (position) {
+        case PositionSnorm16: return { positionLocation, 4, GL_SHORT, GL_TRUE, 8 }; // w pads the record to 4-byte alignment
+        case PositionHalf: return { positionLocation, 4, GL_HALF_FLOAT, GL_FALSE, 8 };
+        default: return { positionLocation, 3, GL_FLOAT, GL_FALSE, 12 };
+        }
+    } else if (index == 1) {
+        if (color == ColorUnorm8)
+            return { colorLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4 };
+        return { colorLocation, 3, GL_FLOAT, GL_FALSE, 12 };
+    }
+    if (normal == NormalOctahedral16)
+        return { normalLocation, 2, GL_SHORT, GL_TRUE, 4 };
+    return { normalLocation, 3, GL_FLOAT, GL_FALSE, 12 };
+}
+
+size_t VertexLayout::vertexSize () const {
+    size_t size = 0;
+    for (size_t i = 0; i < attributeCount (); i++)
+        size += attribute (i).size;
+    return size;
+}
+
+void VertexLayout::bind (GLuint vao, GLuint vbo, size_t vertexCount) const {
+    GLuint offset = 0;
+    for (size_t i = 0; i < attributeCount (); i++) {
+        Attribute a = attribute (i);
+        if (interleaved) {
+            // Single binding, attributes at increasing offsets inside each record
+            glVertexArrayAttribFormat (vao, a.location, a.components, a.type, a.normalized, offset);
+            glVertexArrayAttribBinding (vao, a.location, 0);
+            offset += a.size;
+        } else {
+            // One binding per attribute, each reading its own block of the buffer
+            glVertexArrayVertexBuffer (vao, bindingOf[i], vbo, offset, a.size);
+            glVertexArrayAttribFormat (vao, a.location, a.components, a.type, a.normalized, 0);
+            glVertexArrayAttribBinding (vao, a.location, bindingOf[i]);
+            offset += a.size * vertexCount;
+        }
+        glEnableVertexArrayAttrib (vao, a.location);
+    }
+    if (interleaved)
+        glVertexArrayVertexBuffer (vao, 0, vbo, 0, vertexSize ());
+}
+
+glm::vec2 VertexLayout::octahedralEncode (const glm::vec3 & n) {
+    float l1 = std::abs (n.x) + std::abs (n.y) + std::abs (n.z);
+    if (l1 == 0.f)
+        return glm::vec2 (0.f);
+    glm::vec3 v = n / l1; // Project on the octahedron
+    glm::vec2 e (v.x, v.y);
+    if (v.z < 0.f) // Fold the lower half over the diagonals
+        e = (1.f - glm::abs (glm::vec2 (e.y, e.x))) * glm::vec2 (e.x >= 0.f ? 1.f : -1.f, e.y >= 0.f ? 1.f : -1.f);
+    return e;
+}
+
+glm::vec3 VertexLayout::octahedralDecode (const glm::vec2 & e) {
+    glm::vec3 n (e, 1.f - std::abs (e.x) - std::abs (e.y));
+    if (n.z < 0.f) // Unfold the lower half, as VertexShader.glsl does
+        n = glm::vec3 ((1.f - glm::abs (glm::vec2 (n.y, n.x))) * glm::vec2 (n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f), n.z);
+    return glm::normalize (n);
+}
+
+void VertexLayout::pack (const float * positions, const float * colors, const float * normals, size_t vertexCount,
+                         const glm::vec3 & positionScale, const glm::vec3 & positionOffset, void * out) const {
+    unsigned char * bytes = static_cast<unsigned char *> (out);
+    size_t stride = vertexSize ();
+    size_t blockOffset = 0;
+
+    for (size_t i = 0; i < attributeCount (); i++) {
+        Attribute a = attribute (i);
+        size_t elementStride = interleaved ? stride : a.size;
+        unsigned char * dst = bytes + blockOffset;
+
+        for (size_t v = 0; v < vertexCount; v++, dst += elementStride) {
+            if (i == 0) {
+                glm::vec3 p (positions[3*v], positions[3*v+1], positions[3*v+2]);
+                if (position == PositionSnorm16) {
+                    uint64_t packed = glm::packSnorm4x16 (glm::vec4 ((p - positionOffset) / positionScale, 1.f));
+                    std::memcpy (dst, &packed, 8);
+                } else if (position == PositionHalf) {
+                    uint64_t packed = glm::packHalf4x16 (glm::vec4 (p, 1.f));
+                    std::memcpy (dst, &packed, 8);
+                } else {
+                    std::memcpy (dst, &positions[3*v], 12);
+                }
+            } else if (i == 1) {
+                if (color == ColorUnorm8) {
+                    uint32_t packed = glm::packUnorm4x8 (glm::vec4 (colors[3*v], colors[3*v+1], colors[3*v+2], 1.f));
+                    std::memcpy (dst, &packed, 4);
+                } else {
+                    std::memcpy (dst, &colors[3*v], 12);
+                }
+            } else {
+                glm::vec3 n = normals ? glm::vec3 (normals[3*v], normals[3*v+1], normals[3*v+2]) : glm::vec3 (0.f, 0.f, 1.f);
+                if (normal == NormalOctahedral16) {
+                    uint32_t packed = glm::packSnorm2x16 (octahedralEncode (n));
+                    std::memcpy (dst, &packed, 4);
+                } else {
+                    std::memcpy (dst, &n, 12);
+                }
+            }
+        }
+        blockOffset += interleaved ? a.size : a.size * vertexCount;
+    }
+}
+
+void VertexLayout::unpack (const void * in, size_t vertexCount, const glm::vec3 & positionScale, const glm::vec3 & positionOffset,
+                           float * positions, float * colors, float * normals, size_t first, size_t count) const {
+    const unsigned char * bytes = static_cast<const unsigned char *> (in);
+    size_t stride = vertexSize ();
+    size_t blockOffset = 0;
+    count = first < vertexCount ? std::min (count, vertexCount - first) : 0;
+
+    for (size_t i = 0; i < attributeCount (); i++) {
+        Attribute a = attribute (i);
+        size_t elementStride = interleaved ? stride : a.size;
+        const unsigned char * src = bytes + blockOffset + first * elementStride;
+        size_t decoded = (i == 1 && !colors) || (i == 2 && !normals) ? 0 : count;
+
+        for (size_t v = 0; v < decoded; v++, src += elementStride) {
+            if (i == 0) {
+                if (position == PositionFloat3) {
+                    std::memcpy (&positions[3*v], src, 12);
+                    continue;
+                }
+                uint64_t packed;
+                std::memcpy (&packed, src, 8);
+                glm::vec3 p = position == PositionSnorm16 ? glm::vec3 (glm::unpackSnorm4x16 (packed)) * positionScale + positionOffset
+                                                          : glm::vec3 (glm::unpackHalf4x16 (packed));
+                std::memcpy (&positions[3*v], &p, 12);
+            } else if (i == 1) {
+                if (color == ColorFloat3) {
+                    std::memcpy (&colors[3*v], src, 12);
+                    continue;
+                }
+                uint32_t packed;
+                std::memcpy (&packed, src, 4);
+                glm::vec3 c (glm::unpackUnorm4x8 (packed));
+                std::memcpy (&colors[3*v], &c, 12);
+            } else {
+                if (normal == NormalFloat3) {
+                    std::memcpy (&normals[3*v], src, 12);
+                    continue;
+                }
+                uint32_t packed;
+                std::memcpy (&packed, src, 4);
+                glm::vec3 n = octahedralDecode (glm::unpackSnorm2x16 (packed));
+                std::memcpy (&normals[3*v], &n, 12);
+            }
+        }
+        blockOffset += interleaved ? a.size : a.size * vertexCount;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef _VERTEX_LAYOUT_H
+#define _VERTEX_LAYOUT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// Storage format of the vertex attributes of a Geometry on the GPU. The CPU side
+// keeps float streams (unless the data comes packed from a file); the layout decides
+// how they are packed at upload time and drives the attribute setup of the VAO and
+// the decoding in the shader.
+class VertexLayout {
+public:
+	enum PositionFormat {
+		PositionFloat3, // 12 bytes
+		PositionSnorm16, // 8 bytes, quantized in the bounding box of the geometry
+		PositionHalf // 8 bytes
+	};
+	enum ColorFormat {
+		ColorFloat3, // 12 bytes
+		ColorUnorm8 // 4 bytes, RGBA8
+	};
+	enum NormalFormat {
+		NormalNone, // No normal attribute
+		NormalFloat3, // 12 bytes
+		NormalOctahedral16 // 4 bytes, octahedral mapping stored as two snorm16
+	};
+
+	// Description of one attribute, as given to glVertexArrayAttribFormat
+	struct Attribute {
+		GLuint location;
+		GLint components;
+		GLenum type;
+		GLboolean normalized;
+		GLuint size; // Bytes per vertex
+	};
+
+	// Explicit locations of the decoding uniforms in VertexShader.glsl: drawing sets them without a lookup
+	enum DecodingUniform {
+		PositionScaleUniform = 0,
+		PositionOffsetUniform = 1,
+		NormalEncodingUniform = 2
+	};
+
+	PositionFormat position = PositionFloat3;
+	ColorFormat color = ColorFloat3;
+	NormalFormat normal = NormalFloat3; // Dropped at upload when the geometry has no normals
+	bool interleaved = false; // One record per vertex, or one block per attribute
+
+	static VertexLayout standard (); // Separate float streams, 36 bytes per vertex (24 without normals)
+	static VertexLayout compact (); // Interleaved snorm16 positions, RGBA8 colors and octahedral normals, 16 bytes per vertex
+
+	size_t attributeCount () const;
+	Attribute attribute (size_t index) const;
+	size_t vertexSize () const; // Bytes per vertex, all attributes included
+	GLint normalEncoding () const; // Value of the normalEncoding uniform: 0 without normals, 1 for floats, 2 octahedral
+
+	// Sets the formats and the buffer bindings of vao to read vertexCount vertices from vbo
+	void bind (GLuint vao, GLuint vbo, size_t vertexCount) const;
+
+	// Packs the float streams (normals may be null) into out, which holds vertexCount * vertexSize () bytes.
+	// Quantized positions are stored as (p - positionOffset) / positionScale.
+	void pack (const float * positions, const float * colors, const float * normals, size_t vertexCount,
+	           const glm::vec3 & positionScale, const glm::vec3 & positionOffset, void * out) const;
+
+	// The reverse of pack, up to the precision of the formats. Normals are written only when the layout
+	// has them, colors and normals not at all when null. With first and count, only those of the
+	// vertexCount vertices of in are decoded, to the start of the outputs.
+	void unpack (const void * in, size_t vertexCount, const glm::vec3 & positionScale, const glm::vec3 & positionOffset,
+	             float * positions, float * colors, float * normals, size_t first = 0, size_t count = ~size_t (0)) const;
+
+	static glm::vec2 octahedralEncode (const glm::vec3 & n);
+	static glm::vec3 octahedralDecode (const glm::vec2 & e); // Unit
+};
+
+#endif //_VERTEX_LAYOUT_H
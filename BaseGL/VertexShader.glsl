@@ -2,16 +2,40 @@
 
 layout(location=0) in vec3 vPosition; // The 1st input attribute is the position (CPU side: glVertexAttrib 0)
 layout(location=1) in vec3 vColor; // The 2nd input attribute is the vertex color (CPU side: glVertexAttrib 1)
+layout(location=2) in vec3 vNormal; // Optional normal attribute, see normalEncoding
+layout(location=4) in mat4 vModelMat; // Per-instance model matrix, only streamed by InstancedMesh (locations 4 to 7)
+layout(location=8) in mat4 vModelNormalMat; // Per-instance inverse transpose of the model matrix (locations 8 to 11)
 
 uniform mat4 projectionMat, modelViewMat, normalMatrix;
+uniform mat4 viewMat, normalViewMat; // View matrix and its inverse transpose, used by the instanced path
+uniform bool instanced;
+layout(location=0) uniform vec3 positionScale; // Maps quantized positions back to object space, with positionOffset (identity for float positions)
+layout(location=1) uniform vec3 positionOffset; // Explicit locations, set without a lookup (CPU side: VertexLayout::DecodingUniform)
+layout(location=2) uniform int normalEncoding; // 0: no normal attribute, 1: float xyz, 2: octahedral-encoded xy
 
 out vec3 fColor; // The vertex shader outpus a vec3 capturing vertex color
-out vec3 fNormal;
+out vec3 fNormal; // Zero without a normal attribute: the fragment shader then takes the facet normal
 out vec3 fPosition;
+out vec3 fViewPosition;
+
+vec3 octahedralDecode (vec2 e) {
+    vec3 n = vec3 (e, 1.0 - abs (e.x) - abs (e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs (n.yx)) * vec2 (n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize (n);
+}
 
 void main() {
-    gl_Position =  projectionMat * modelViewMat * vec4 (vPosition, 1.0); // mandatory to fire rasterization properly
-    fNormal = vec3 (normalMatrix * vec4 (vPosition, 1.0));
+    vec3 position = vPosition * positionScale + positionOffset;
+    mat4 mvMat = instanced ? viewMat * vModelMat : modelViewMat;
+    mat4 nMat = instanced ? normalViewMat * vModelNormalMat : normalMatrix;
+    vec4 viewPosition = mvMat * vec4 (position, 1.0);
+    gl_Position =  projectionMat * viewPosition; // mandatory to fire rasterization properly
+    if (normalEncoding == 0)
+        fNormal = vec3 (0.0);
+    else
+        fNormal = vec3 (nMat * vec4 (normalEncoding == 2 ? octahedralDecode (vNormal.xy) : vNormal, 0.0));
+    fViewPosition = viewPosition.xyz;
     fColor = vec3  (vColor); // Output passed to the next stage, interpolated at fragment barycentric coord. by default
-    fPosition = vec3 (vPosition);
+    fPosition = position;
 }